@@ -145,6 +145,7 @@ static struct device_t * fb_s5l8930_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	write32(pdat->virt + LCD_SIZE, (pdat->width << 16) | (pdat->height << 0));
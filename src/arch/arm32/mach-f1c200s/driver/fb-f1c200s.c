@@ -329,6 +329,7 @@ static struct device_t * fb_f1c200s_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	clk_enable(pdat->clkdefe);
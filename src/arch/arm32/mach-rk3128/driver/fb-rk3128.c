@@ -296,6 +296,7 @@ static struct device_t * fb_rk3128_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	regulator_enable(pdat->regulator);
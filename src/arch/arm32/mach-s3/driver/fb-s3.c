@@ -370,6 +370,7 @@ static struct device_t * fb_s3_probe(struct driver_t * drv, struct dtnode_t * n)
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	clk_enable(pdat->clkde);
@@ -104,6 +104,7 @@ static struct device_t * fb_bcm2837_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	if(!(dev = register_framebuffer(fb, drv)))
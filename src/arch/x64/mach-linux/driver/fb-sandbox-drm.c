@@ -145,6 +145,7 @@ static struct device_t * fb_sandbox_drm_probe(struct driver_t * drv, struct dtno
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = NULL;
 	fb->priv = pdat;
 
 	if(!(dev = register_framebuffer(fb, drv)))
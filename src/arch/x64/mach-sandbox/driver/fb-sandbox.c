@@ -107,6 +107,18 @@ static void fb_present(struct framebuffer_t * fb, struct surface_t * s, struct r
 	sandbox_fb_surface_present(pdat->priv, s->priv, (struct sandbox_region_list_t *)rl);
 }
 
+static int fb_acquire(struct framebuffer_t * fb, struct surface_t * s)
+{
+	struct fb_sandbox_pdata_t * pdat = (struct fb_sandbox_pdata_t *)fb->priv;
+	struct sandbox_fb_surface_t * surface = (struct sandbox_fb_surface_t *)s->priv;
+	int age;
+
+	age = sandbox_fb_surface_acquire(pdat->priv, surface);
+	if(age >= 0)
+		s->pixels = surface->pixels;
+	return age;
+}
+
 static struct device_t * fb_sandbox_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct fb_sandbox_pdata_t * pdat;
@@ -145,6 +157,7 @@ static struct device_t * fb_sandbox_probe(struct driver_t * drv, struct dtnode_t
 	fb->create = fb_create;
 	fb->destroy = fb_destroy;
 	fb->present = fb_present;
+	fb->acquire = fb_acquire;
 	fb->priv = pdat;
 
 	if(!(dev = register_framebuffer(fb, drv)))
@@ -24,8 +24,13 @@ struct sandbox_fb_drm_context_t {
 	uint32_t stride;
 	uint32_t pixlen;
 	int index;
-	struct fb_drm_buf_t * drmbuf[2];
-	struct sandbox_region_list_t * nrl, * orl;
+	int back;
+	int nbuf;
+	int crtc;
+	unsigned int seq;
+	unsigned int bseq[3];
+	struct fb_drm_buf_t * drmbuf[3];
+	struct sandbox_region_list_t * nrl, * orl[2];
 };
 
 static struct fb_drm_buf_t * fb_drm_buf_create(struct sandbox_fb_drm_context_t * ctx)
@@ -145,10 +150,17 @@ void * sandbox_fb_drm_open(const char * dev)
 	ctx->pwidth = 256;
 	ctx->pheight = 135;
 	ctx->index = 0;
+	ctx->back = 0;
+	ctx->crtc = 0;
+	ctx->seq = 0;
+	memset(ctx->bseq, 0, sizeof(ctx->bseq));
 	ctx->drmbuf[0] = fb_drm_buf_create(ctx);
 	ctx->drmbuf[1] = fb_drm_buf_create(ctx);
+	ctx->drmbuf[2] = fb_drm_buf_create(ctx);
+	ctx->nbuf = ctx->drmbuf[2] ? 3 : 2;
 	ctx->nrl = sandbox_region_list_alloc(0);
-	ctx->orl = sandbox_region_list_alloc(0);
+	ctx->orl[0] = sandbox_region_list_alloc(0);
+	ctx->orl[1] = sandbox_region_list_alloc(0);
 	ctx->stride = ctx->drmbuf[0]->stride;
 	ctx->pixlen = ctx->drmbuf[0]->pixlen;
 
@@ -163,8 +175,10 @@ void sandbox_fb_drm_close(void * context)
 	{
 		fb_drm_buf_destroy(ctx, ctx->drmbuf[0]);
 		fb_drm_buf_destroy(ctx, ctx->drmbuf[1]);
+		fb_drm_buf_destroy(ctx, ctx->drmbuf[2]);
 		sandbox_region_list_free(ctx->nrl);
-		sandbox_region_list_free(ctx->orl);
+		sandbox_region_list_free(ctx->orl[0]);
+		sandbox_region_list_free(ctx->orl[1]);
 		close(ctx->fd);
 		free(ctx);
 	}
@@ -202,35 +216,81 @@ int sandbox_fb_drm_surface_create(void * context, struct sandbox_fb_surface_t *
 	surface->stride = ctx->stride;
 	surface->pixlen = ctx->pixlen;
 	surface->pixels = memalign(4, ctx->pixlen);
+	surface->priv = surface->pixels;
 	return 1;
 }
 
 int sandbox_fb_drm_surface_destroy(void * context, struct sandbox_fb_surface_t * surface)
 {
-	if(surface && surface->pixels)
-		free(surface->pixels);
+	if(surface && surface->priv)
+		free(surface->priv);
 	return 1;
 }
 
+int sandbox_fb_drm_surface_acquire(void * context, struct sandbox_fb_surface_t * surface)
+{
+	struct sandbox_fb_drm_context_t * ctx = (struct sandbox_fb_drm_context_t *)context;
+	int back;
+
+	back = (ctx->index + 1) % ctx->nbuf;
+	ctx->back = back;
+	surface->pixels = ctx->drmbuf[back]->pixels;
+	if(ctx->bseq[back] == 0)
+		return 0;
+	return ctx->seq - ctx->bseq[back];
+}
+
+static void fb_drm_flip(struct sandbox_fb_drm_context_t * ctx, int index)
+{
+	struct fb_drm_buf_t * drmbuf = ctx->drmbuf[index];
+
+	if(!ctx->crtc || (drmModePageFlip(ctx->fd, ctx->crtc_id, drmbuf->fb, 0, NULL) != 0))
+	{
+		drmModeSetCrtc(ctx->fd, ctx->crtc_id, drmbuf->fb, 0, 0, &ctx->conn_id, 1, &ctx->conn->modes[0]);
+		ctx->crtc = 1;
+	}
+	ctx->index = index;
+	ctx->bseq[index] = ++ctx->seq;
+}
+
 int sandbox_fb_drm_surface_present(void * context, struct sandbox_fb_surface_t * surface, struct sandbox_region_list_t * rl)
 {
 	struct sandbox_fb_drm_context_t * ctx = (struct sandbox_fb_drm_context_t *)context;
 	struct sandbox_region_list_t * nrl = ctx->nrl;
+	struct sandbox_region_list_t * orl;
 	struct fb_drm_buf_t * drmbuf;
 	struct sandbox_region_t * r;
 	unsigned char * p, * q;
 	int stride = ctx->stride;
 	int offset, line, height;
+	int index, age;
 	int i, j;
 
+	/*
+	 * Rendered in place, just queue an asynchronous page flip
+	 */
+	if(surface->pixels == ctx->drmbuf[ctx->back]->pixels)
+	{
+		fb_drm_flip(ctx, ctx->back);
+		return 1;
+	}
+
+	/*
+	 * The back buffer misses the damage of the frames presented since it was last shown
+	 */
+	index = (ctx->index + 1) % ctx->nbuf;
+	drmbuf = ctx->drmbuf[index];
+	age = ctx->bseq[index] ? ctx->seq - ctx->bseq[index] : 0;
 	sandbox_region_list_clear(nrl);
-	sandbox_region_list_merge(nrl, ctx->orl);
 	sandbox_region_list_merge(nrl, rl);
-	sandbox_region_list_clone(ctx->orl, rl);
-
-	ctx->index = (ctx->index + 1) & 0x1;
-	drmbuf = ctx->drmbuf[ctx->index];
-	if(nrl && (nrl->count > 0))
+	for(i = 0; (i < age) && (i < 2); i++)
+		sandbox_region_list_merge(nrl, ctx->orl[i]);
+	orl = ctx->orl[1];
+	ctx->orl[1] = ctx->orl[0];
+	ctx->orl[0] = orl;
+	sandbox_region_list_clone(orl, rl);
+
+	if((age > 0) && (age <= 2) && nrl && (nrl->count > 0))
 	{
 		for(i = 0; i < nrl->count; i++)
 		{
@@ -249,7 +309,7 @@ int sandbox_fb_drm_surface_present(void * context, struct sandbox_fb_surface_t *
 	{
 		memcpy(drmbuf->pixels, surface->pixels, surface->pixlen);
 	}
-	drmModeSetCrtc(ctx->fd, ctx->crtc_id, drmbuf->fb, 0, 0, &ctx->conn_id, 1, &ctx->conn->modes[0]);
+	fb_drm_flip(ctx, index);
 	return 1;
 }
 
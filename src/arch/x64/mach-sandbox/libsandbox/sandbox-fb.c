@@ -7,6 +7,12 @@ struct sandbox_fb_context_t {
 	int fd;
 	int vramsz;
 	void * vram;
+	int pagesz;
+	int nbuf;
+	int index;
+	int back;
+	unsigned int seq;
+	unsigned int bseq[3];
 };
 
 void * sandbox_fb_open(const char * dev)
@@ -56,6 +62,32 @@ void * sandbox_fb_open(const char * dev)
 		return NULL;
 	}
 
+	/*
+	 * Ask for a virtual screen of up to three pages, the pages are flipped
+	 * by panning the y offset
+	 */
+	for(ctx->nbuf = 3; ctx->nbuf > 1; ctx->nbuf--)
+	{
+		ctx->vi.yres_virtual = ctx->vi.yres * ctx->nbuf;
+		ctx->vi.yoffset = 0;
+		if(ioctl(ctx->fd, FBIOPUT_VSCREENINFO, &ctx->vi) == 0)
+			break;
+	}
+	if((ioctl(ctx->fd, FBIOGET_VSCREENINFO, &ctx->vi) != 0) || (ioctl(ctx->fd, FBIOGET_FSCREENINFO, &ctx->fi) != 0))
+	{
+		close(ctx->fd);
+		free(ctx);
+		return NULL;
+	}
+	ctx->nbuf = ctx->vi.yres_virtual / ctx->vi.yres;
+	if(ctx->nbuf > 3)
+		ctx->nbuf = 3;
+	ctx->pagesz = ctx->vi.yres * ctx->fi.line_length;
+	ctx->index = 0;
+	ctx->back = 0;
+	ctx->seq = 0;
+	memset(ctx->bseq, 0, sizeof(ctx->bseq));
+
 	ctx->vramsz = ctx->vi.yres_virtual * ctx->fi.line_length;
 	ctx->vram = mmap(0, ctx->vramsz, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, 0);
 	if(ctx->vram == (void *)(-1))
@@ -120,18 +152,34 @@ int sandbox_fb_surface_create(void * context, struct sandbox_fb_surface_t * surf
 	surface->width = ctx->vi.xres;
 	surface->height = ctx->vi.yres;
 	surface->stride = ctx->fi.line_length;
-	surface->pixlen = ctx->vramsz;
-	surface->pixels = memalign(4, ctx->vramsz);
+	surface->pixlen = ctx->pagesz;
+	surface->pixels = memalign(4, ctx->pagesz);
+	surface->priv = surface->pixels;
 	return 1;
 }
 
 int sandbox_fb_surface_destroy(void * context, struct sandbox_fb_surface_t * surface)
 {
-	if(surface && surface->pixels)
-		free(surface->pixels);
+	if(surface && surface->priv)
+		free(surface->priv);
 	return 1;
 }
 
+int sandbox_fb_surface_acquire(void * context, struct sandbox_fb_surface_t * surface)
+{
+	struct sandbox_fb_context_t * ctx = (struct sandbox_fb_context_t *)context;
+	int back;
+
+	if(ctx->nbuf < 2)
+		return -1;
+	back = (ctx->index + 1) % ctx->nbuf;
+	ctx->back = back;
+	surface->pixels = (unsigned char *)ctx->vram + back * ctx->pagesz;
+	if(ctx->bseq[back] == 0)
+		return 0;
+	return ctx->seq - ctx->bseq[back];
+}
+
 int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * surface, struct sandbox_region_list_t * rl)
 {
 	struct sandbox_fb_context_t * ctx = (struct sandbox_fb_context_t *)context;
@@ -142,6 +190,17 @@ int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * sur
 	int offset, line, height;
 	int i, j;
 
+	if((ctx->nbuf > 1) && (surface->pixels == (unsigned char *)ctx->vram + ctx->back * ctx->pagesz))
+	{
+		ctx->vi.xoffset = 0;
+		ctx->vi.yoffset = ctx->back * ctx->vi.yres;
+		if(ioctl(ctx->fd, FBIOPAN_DISPLAY, &ctx->vi) != 0)
+			return 0;
+		ctx->index = ctx->back;
+		ctx->bseq[ctx->index] = ++ctx->seq;
+		return 1;
+	}
+
 	if(rl && (rl->count > 0))
 	{
 		for(i = 0; i < rl->count; i++)
@@ -151,7 +210,7 @@ int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * sur
 			line = r->w * bytes;
 			height = r->h;
 
-			p = (unsigned char *)ctx->vram + offset;
+			p = (unsigned char *)ctx->vram + ctx->index * ctx->pagesz + offset;
 			q = (unsigned char *)surface->pixels + offset;
 			for(j = 0; j < height; j++, p += stride, q += stride)
 				memcpy(p, q, line);
@@ -160,7 +219,7 @@ int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * sur
 	else
 	{
 		height = ctx->vi.yres;
-		p = (unsigned char *)ctx->vram;
+		p = (unsigned char *)ctx->vram + ctx->index * ctx->pagesz;
 		q = (unsigned char *)surface->pixels;
 		for(j = 0; j < height; j++, p += stride, q += stride)
 			memcpy(p, q, stride);
@@ -233,6 +233,7 @@ int sandbox_fb_get_pheight(void * context);
 int sandbox_fb_surface_create(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_surface_destroy(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_surface_present(void * context, struct sandbox_fb_surface_t * surface, struct sandbox_region_list_t * rl);
+int sandbox_fb_surface_acquire(void * context, struct sandbox_fb_surface_t * surface);
 void sandbox_fb_set_backlight(void * context, int brightness);
 int sandbox_fb_get_backlight(void * context);
 
@@ -246,6 +247,7 @@ int sandbox_fb_drm_get_pheight(void * context);
 int sandbox_fb_drm_surface_create(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_drm_surface_destroy(void * context, struct sandbox_fb_surface_t * surface);
 int sandbox_fb_drm_surface_present(void * context, struct sandbox_fb_surface_t * surface, struct sandbox_region_list_t * rl);
+int sandbox_fb_drm_surface_acquire(void * context, struct sandbox_fb_surface_t * surface);
 void sandbox_fb_drm_set_backlight(void * context, int brightness);
 int sandbox_fb_drm_get_backlight(void * context);
 
@@ -28,6 +28,11 @@
 
 #include <xboot.h>
 #include <audio/audio.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__X64__)
+#include <immintrin.h>
+#endif
 
 struct audio_t * search_audio(const char * name)
 {
@@ -61,6 +66,7 @@ struct device_t * register_audio(struct audio_t * audio, struct driver_t * drv)
 		return NULL;
 
 	init_list_head(&audio->soundpool.list);
+	init_list_head(&audio->soundpool.pending);
 	spin_lock_init(&audio->soundpool.lock);
 
 	dev->name = strdup(audio->name);
@@ -126,115 +132,235 @@ int audio_ioctl(struct audio_t * audio, const char * cmd, void * arg)
 	return -1;
 }
 
+/*
+ * Voices are mixed a block at a time into a 32 bits stereo accumulator, then
+ * packed back to signed 16 bits with saturation.
+ */
+#define AUDIO_MIX_FRAMES	(240)
+
+static void audio_mix_c(int32_t * acc, const int16_t * src, int n, int lvol, int rvol)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+	{
+		acc[0] += (src[0] * lvol) >> 12;
+		acc[1] += (src[1] * rvol) >> 12;
+		acc += 2;
+		src += 2;
+	}
+}
+
+static void audio_pack_c(int16_t * dst, const int32_t * acc, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+		dst[i] = clamp(acc[i], -32768, 32767);
+}
+
+#if defined(__ARM_NEON)
+static void audio_mix(int32_t * acc, const int16_t * src, int n, int lvol, int rvol)
+{
+	int16x4_t vol = vreinterpret_s16_s32(vdup_n_s32((rvol << 16) | (lvol & 0xffff)));
+	int16x8_t s;
+	int i;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		s = vld1q_s16(src);
+		vst1q_s32(acc + 0, vaddq_s32(vld1q_s32(acc + 0), vshrq_n_s32(vmull_s16(vget_low_s16(s), vol), 12)));
+		vst1q_s32(acc + 4, vaddq_s32(vld1q_s32(acc + 4), vshrq_n_s32(vmull_s16(vget_high_s16(s), vol), 12)));
+		acc += 8;
+		src += 8;
+	}
+	audio_mix_c(acc, src, n - i, lvol, rvol);
+}
+
+static void audio_pack(int16_t * dst, const int32_t * acc, int n)
+{
+	int i;
+
+	for(i = 0; i + 8 <= n; i += 8)
+		vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(vld1q_s32(acc + i)), vqmovn_s32(vld1q_s32(acc + i + 4))));
+	audio_pack_c(dst + i, acc + i, n - i);
+}
+#elif defined(__X64__)
+static void audio_mix(int32_t * acc, const int16_t * src, int n, int lvol, int rvol)
+{
+	__m128i vol = _mm_set1_epi32((rvol << 16) | (lvol & 0xffff));
+	__m128i s, lo, hi;
+	int i;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		s = _mm_loadu_si128((const __m128i *)src);
+		lo = _mm_mullo_epi16(s, vol);
+		hi = _mm_mulhi_epi16(s, vol);
+		_mm_storeu_si128((__m128i *)(acc + 0), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + 0)), _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 12)));
+		_mm_storeu_si128((__m128i *)(acc + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + 4)), _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 12)));
+		acc += 8;
+		src += 8;
+	}
+	audio_mix_c(acc, src, n - i, lvol, rvol);
+}
+
+static void audio_pack(int16_t * dst, const int32_t * acc, int n)
+{
+	int i;
+
+	for(i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(acc + i)), _mm_loadu_si128((const __m128i *)(acc + i + 4))));
+	audio_pack_c(dst + i, acc + i, n - i);
+}
+#else
+#define audio_mix	audio_mix_c
+#define audio_pack	audio_pack_c
+#endif
+
+/*
+ * Linear ramp from the current to the target volume, used for the block
+ * after a gain or pan change so it never steps
+ */
+static void audio_mix_ramp(int32_t * acc, const int16_t * src, int n, int lvol, int rvol, int dl, int dr)
+{
+	int l = lvol << 16, r = rvol << 16;
+	int i;
+
+	for(i = 0; i < n; i++)
+	{
+		acc[0] += (src[0] * (l >> 16)) >> 12;
+		acc[1] += (src[1] * (r >> 16)) >> 12;
+		l += dl;
+		r += dr;
+		acc += 2;
+		src += 2;
+	}
+}
+
+static void audio_mix_voice(struct sound_t * snd, int32_t * acc, int frames)
+{
+	int lvol = snd->lvol, rvol = snd->rvol;
+	int dl = ((lvol - snd->clvol) << 16) / frames;
+	int dr = ((rvol - snd->crvol) << 16) / frames;
+	uint32_t * buf;
+	int done = 0, n;
+
+	while((done < frames) && (snd->loop != 0))
+	{
+		if(snd->stream)
+		{
+			if((n = sound_stream_peek(snd, &buf)) <= 0)
+			{
+				if(sound_stream_eof(snd))
+					snd->loop = 0;
+				break;
+			}
+			n = min(frames - done, n);
+			if((dl == 0) && (dr == 0))
+				audio_mix(acc + (done << 1), (const int16_t *)buf, n, snd->clvol, snd->crvol);
+			else
+				audio_mix_ramp(acc + (done << 1), (const int16_t *)buf, n, snd->clvol + (lvol - snd->clvol) * done / frames, snd->crvol + (rvol - snd->crvol) * done / frames, dl, dr);
+			sound_stream_advance(snd, n);
+			done += n;
+			continue;
+		}
+		if(snd->postion >= snd->sample)
+		{
+			if(snd->sample <= 0)
+				snd->loop = 0;
+			else if(snd->loop > 0)
+				snd->loop--;
+			if(snd->loop != 0)
+				snd->postion = 0;
+			continue;
+		}
+		n = min(frames - done, snd->sample - snd->postion);
+		if((dl == 0) && (dr == 0))
+			audio_mix(acc + (done << 1), (const int16_t *)&snd->source[snd->postion], n, snd->clvol, snd->crvol);
+		else
+			audio_mix_ramp(acc + (done << 1), (const int16_t *)&snd->source[snd->postion], n, snd->clvol + (lvol - snd->clvol) * done / frames, snd->crvol + (rvol - snd->crvol) * done / frames, dl, dr);
+		snd->postion += n;
+		done += n;
+	}
+	snd->clvol = lvol;
+	snd->crvol = rvol;
+}
+
 static int audio_playback_callback(void * data, void * buf, int count)
 {
 	struct audio_t * audio = (struct audio_t *)data;
 	struct sound_t * pos, * n;
+	struct list_head done;
 	irq_flags_t flags;
 	char * pbuf = buf;
-	int32_t left[240];
-	int32_t right[240];
-	int32_t result[240];
-	int32_t * pl = left;
-	int32_t * pr = right;
-	int16_t * p;
+	int32_t acc[AUDIO_MIX_FRAMES * 2];
 	int bytes = 0;
 	int sample;
-	int length;
-	int empty;
-	int i;
 
 	spin_lock_irqsave(&audio->soundpool.lock, flags);
-	empty = list_empty_careful(&audio->soundpool.list);
+	list_splice_tail_init(&audio->soundpool.pending, &audio->soundpool.list);
 	spin_unlock_irqrestore(&audio->soundpool.lock, flags);
-	if(!empty)
+	if(!list_empty(&audio->soundpool.list))
 	{
 		while(count > 0)
 		{
-			sample = min((int)(count >> 2), 240);
-			length = sample << 2;
-			memset(left, 0, length);
-			memset(right, 0, length);
-			spin_lock_irqsave(&audio->soundpool.lock, flags);
-			list_for_each_entry_safe(pos, n, &audio->soundpool.list, list)
-			{
-				if(pos->loop != 0)
-				{
-					for(i = 0; i < sample; i++)
-					{
-						if(pos->sample > pos->postion)
-						{
-							p = (int16_t *)(&pos->source[pos->postion]);
-							left[i] += (p[0] * pos->lvol) >> 12;
-							right[i] += (p[1] * pos->rvol) >> 12;
-							pos->postion++;
-						}
-						else
-						{
-							if(pos->loop > 0)
-								pos->loop--;
-							if(pos->loop != 0)
-							{
-								pos->postion = 0;
-								p = (int16_t *)(&pos->source[pos->postion]);
-								left[i] += (p[0] * pos->lvol) >> 12;
-								right[i] += (p[1] * pos->rvol) >> 12;
-							}
-						}
-					}
-				}
-			}
-			spin_unlock_irqrestore(&audio->soundpool.lock, flags);
-			p = (int16_t *)result;
-			for(i = 0; i < sample; i++)
-			{
-				*p++ = clamp(pl[i], -32768, 32767);
-				*p++ = clamp(pr[i], -32768, 32767);
-			}
-			memcpy(pbuf, result, length);
-			bytes += length;
-			pbuf += length;
-			count -= length;
+			sample = min((int)(count >> 2), AUDIO_MIX_FRAMES);
+			if(sample <= 0)
+				break;
+			memset(acc, 0, sample << 3);
+			list_for_each_entry(pos, &audio->soundpool.list, list)
+				audio_mix_voice(pos, acc, sample);
+			audio_pack((int16_t *)pbuf, acc, sample << 1);
+			bytes += sample << 2;
+			pbuf += sample << 2;
+			count -= sample << 2;
 		}
+		/*
+		 * Finished voices stay active while they sit on the local list, so
+		 * audio_playback can't queue them again. Each one is unlinked and
+		 * marked idle under the lock before its callback, which may replay
+		 * or free the sound and so must be the last user of it here.
+		 */
+		init_list_head(&done);
 		spin_lock_irqsave(&audio->soundpool.lock, flags);
 		list_for_each_entry_safe(pos, n, &audio->soundpool.list, list)
 		{
 			if(pos->loop == 0)
-			{
-				list_del(&pos->list);
-				if(pos->cb)
-					pos->cb(pos);
-			}
+				list_move_tail(&pos->list, &done);
 		}
 		spin_unlock_irqrestore(&audio->soundpool.lock, flags);
+		list_for_each_entry_safe(pos, n, &done, list)
+		{
+			spin_lock_irqsave(&audio->soundpool.lock, flags);
+			list_del_init(&pos->list);
+			pos->active = 0;
+			spin_unlock_irqrestore(&audio->soundpool.lock, flags);
+			if(pos->cb)
+				pos->cb(pos);
+		}
 	}
 	return bytes;
 }
 
 void audio_playback(struct audio_t * audio, struct sound_t * snd)
 {
-	struct sound_t * pos, * n;
 	irq_flags_t flags;
-	int found = 0;
+	int found;
 
 	if(audio && snd)
 	{
 		spin_lock_irqsave(&audio->soundpool.lock, flags);
-		list_for_each_entry_safe(pos, n, &audio->soundpool.list, list)
+		found = snd->active;
+		if(!found)
 		{
-			if(pos == snd)
-			{
-				found = 1;
-				break;
-			}
+			snd->active = 1;
+			snd->clvol = snd->lvol;
+			snd->crvol = snd->rvol;
+			list_add_tail(&snd->list, &audio->soundpool.pending);
 		}
 		spin_unlock_irqrestore(&audio->soundpool.lock, flags);
 		if(!found)
-		{
-			spin_lock_irqsave(&audio->soundpool.lock, flags);
-			list_add_tail(&snd->list, &audio->soundpool.list);
-			spin_unlock_irqrestore(&audio->soundpool.lock, flags);
 			audio_playback_start(audio, AUDIO_RATE_48000, AUDIO_FORMAT_S16, 2, audio_playback_callback, audio);
-		}
 	}
 }
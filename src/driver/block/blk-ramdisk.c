@@ -90,6 +90,7 @@ static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_ramdisk_read;
 	blk->write = blk_ramdisk_write;
 	blk->sync = blk_ramdisk_sync;
+	blk->direct = 1;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
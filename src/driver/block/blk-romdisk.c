@@ -86,6 +86,7 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_romdisk_read;
 	blk->write = blk_romdisk_write;
 	blk->sync = blk_romdisk_sync;
+	blk->direct = 1;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
@@ -738,6 +738,7 @@ static struct device_t * blk_spinor_probe(struct driver_t * drv, struct dtnode_t
 	blk->read = blk_spinor_read;
 	blk->write = blk_spinor_write;
 	blk->sync = blk_spinor_sync;
+	blk->direct = 0;
 	blk->priv = pdat;
 	blk_spinor_init(pdat);
 
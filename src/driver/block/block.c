@@ -52,6 +52,273 @@ static ssize_t block_read_capacity(struct kobj_t * kobj, void * buf, size_t size
 	return sprintf(buf, "%lld", block_capacity(blk));
 }
 
+static ssize_t block_read_hit(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->hit);
+}
+
+static ssize_t block_read_miss(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	return sprintf(buf, "%lld", blk->miss);
+}
+
+struct block_buffer_t
+{
+	struct hlist_node node;
+	struct list_head lru;
+	struct block_t * blk;
+	u64_t blkno;
+	int dirty;
+	u8_t * data;
+};
+
+static struct block_cache_t
+{
+	struct hlist_head hash[CONFIG_BLOCK_CACHE_HASH_SIZE];
+	struct list_head lru;
+	struct mutex_t lock;
+	u64_t size;
+} __block_cache;
+
+static u64_t sub_block_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt);
+
+/*
+ * Cached buffers are keyed by the root device, so a partition and its
+ * parent never hold two copies of the same sector.
+ */
+static inline struct block_t * block_root(struct block_t * blk, u64_t * blkno)
+{
+	struct sub_block_pdata_t * pdat;
+
+	while(blk->read == sub_block_read)
+	{
+		pdat = (struct sub_block_pdata_t *)(blk->priv);
+		*blkno += pdat->blkno;
+		blk = pdat->pblk;
+	}
+	return blk;
+}
+
+static inline struct hlist_head * block_cache_bucket(struct block_t * blk, u64_t blkno)
+{
+	u64_t h = ((u64_t)(unsigned long)blk >> 4) ^ (blkno * 0x9e3779b97f4a7c15ULL);
+	return &__block_cache.hash[(h >> 32) % CONFIG_BLOCK_CACHE_HASH_SIZE];
+}
+
+static struct block_buffer_t * block_cache_find(struct block_t * blk, u64_t blkno)
+{
+	struct block_buffer_t * b;
+
+	hlist_for_each_entry(b, block_cache_bucket(blk, blkno), node)
+	{
+		if((b->blk == blk) && (b->blkno == blkno))
+			return b;
+	}
+	return NULL;
+}
+
+static struct block_buffer_t * block_cache_lookup(struct block_t * blk, u64_t blkno)
+{
+	struct block_buffer_t * b = block_cache_find(blk, blkno);
+
+	if(b)
+		list_move(&b->lru, &__block_cache.lru);
+	return b;
+}
+
+static int block_buffer_writeback(struct block_buffer_t * b)
+{
+	if(b->dirty)
+	{
+		if(b->blk->write(b->blk, b->data, b->blkno, 1) != 1)
+			return 0;
+		b->dirty = 0;
+	}
+	return 1;
+}
+
+static void block_buffer_free(struct block_buffer_t * b)
+{
+	hlist_del(&b->node);
+	list_del(&b->lru);
+	__block_cache.size -= block_size(b->blk);
+	free(b);
+}
+
+static struct block_buffer_t * block_cache_insert(struct block_t * blk, u64_t blkno)
+{
+	struct block_buffer_t * b, * n;
+	u64_t blksz = block_size(blk);
+
+	if(blksz > CONFIG_BLOCK_CACHE_SIZE)
+		return NULL;
+
+	list_for_each_entry_safe_reverse(b, n, &__block_cache.lru, lru)
+	{
+		if(__block_cache.size + blksz <= CONFIG_BLOCK_CACHE_SIZE)
+			break;
+		if(block_buffer_writeback(b))
+			block_buffer_free(b);
+	}
+	if(__block_cache.size + blksz > CONFIG_BLOCK_CACHE_SIZE)
+		return NULL;
+
+	b = malloc(sizeof(struct block_buffer_t) + blksz);
+	if(!b)
+		return NULL;
+	b->blk = blk;
+	b->blkno = blkno;
+	b->dirty = 0;
+	b->data = (u8_t *)(b + 1);
+	hlist_add_head(&b->node, block_cache_bucket(blk, blkno));
+	list_add(&b->lru, &__block_cache.lru);
+	__block_cache.size += blksz;
+	return b;
+}
+
+/*
+ * Write back the cached blocks of the root device in [blkno, blkno + blkcnt),
+ * dropping them when asked. A buffer that fails to write back is only dropped
+ * with the whole device, the root still owns it otherwise. Returns -1 if any
+ * write back failed.
+ */
+static int block_cache_flush(struct block_t * root, u64_t blkno, u64_t blkcnt, int drop)
+{
+	struct block_buffer_t * b, * n;
+	int whole = (blkno == 0) && (blkcnt == block_count(root));
+	int ret = 0;
+
+	list_for_each_entry_safe_reverse(b, n, &__block_cache.lru, lru)
+	{
+		if((b->blk == root) && (b->blkno >= blkno) && (b->blkno - blkno < blkcnt))
+		{
+			if(!block_buffer_writeback(b))
+			{
+				ret = -1;
+				if(drop && whole)
+					block_buffer_free(b);
+			}
+			else if(drop)
+				block_buffer_free(b);
+		}
+	}
+	return ret;
+}
+
+/*
+ * Read a run of missing blocks plus the read-ahead window in one request,
+ * hand the wanted part to the caller and keep the whole run in the cache.
+ * The run never covers a cached block, those may be dirty.
+ */
+static u64_t block_cache_fill(struct block_t * blk, u64_t blkno, u64_t blkcnt, u8_t * buf, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t blksz = block_size(blk);
+	u64_t ret, i;
+	u8_t * p;
+
+	p = malloc(blkcnt * blksz);
+	if(!p)
+		return blk->read(blk, buf, blkno, count);
+
+	ret = blk->read(blk, p, blkno, blkcnt);
+	memcpy(buf, p, (ret < count ? ret : count) * blksz);
+	for(i = 0; i < ret; i++)
+	{
+		if((b = block_cache_insert(blk, blkno + i)))
+			memcpy(b->data, &p[i * blksz], blksz);
+	}
+	free(p);
+	return ret < count ? ret : count;
+}
+
+static u64_t block_cache_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_buffer_t * b;
+	struct block_t * root;
+	u64_t blksz = block_size(blk);
+	u64_t rblkno = blkno;
+	u64_t i = 0, n, ra, want, ret;
+
+	root = block_root(blk, &rblkno);
+	if(root->direct)
+		return root->read(root, buf, rblkno, blkcnt);
+	while(i < blkcnt)
+	{
+		if((b = block_cache_lookup(root, rblkno + i)))
+		{
+			memcpy(&buf[i * blksz], b->data, blksz);
+			blk->hit++;
+			i++;
+			continue;
+		}
+
+		for(n = 1; (i + n < blkcnt) && !block_cache_find(root, rblkno + i + n); n++);
+		blk->miss += n;
+
+		if(n >= CONFIG_BLOCK_READ_AHEAD)
+		{
+			ret = root->read(root, &buf[i * blksz], rblkno + i, n);
+		}
+		else
+		{
+			if(blkno + i == blk->ranext)
+				blk->rawin = blk->rawin ? min(blk->rawin << 1, (u64_t)CONFIG_BLOCK_READ_AHEAD) : 4;
+			else
+				blk->rawin = 0;
+			want = block_available_count(blk, blkno + i, max(n, blk->rawin));
+			for(ra = n; (ra < want) && !block_cache_find(root, rblkno + i + ra); ra++);
+			ret = block_cache_fill(root, rblkno + i, ra, &buf[i * blksz], n);
+		}
+		i += ret;
+		if(ret != n)
+			break;
+	}
+	blk->ranext = blkno + i;
+	return i;
+}
+
+static u64_t block_cache_write(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
+{
+	struct block_buffer_t * b;
+	struct block_t * root;
+	u64_t blksz = block_size(blk);
+	u64_t rblkno = blkno;
+	u64_t i, ret;
+
+	root = block_root(blk, &rblkno);
+	if(root->direct)
+		return root->write(root, buf, rblkno, blkcnt);
+	if(blkcnt >= CONFIG_BLOCK_READ_AHEAD)
+	{
+		ret = root->write(root, buf, rblkno, blkcnt);
+		for(i = 0; i < ret; i++)
+		{
+			if((b = block_cache_find(root, rblkno + i)))
+				block_buffer_free(b);
+		}
+		return ret;
+	}
+
+	for(i = 0; i < blkcnt; i++)
+	{
+		b = block_cache_lookup(root, rblkno + i);
+		if(!b)
+			b = block_cache_insert(root, rblkno + i);
+		if(!b)
+		{
+			if(root->write(root, &buf[i * blksz], rblkno + i, 1) != 1)
+				break;
+			continue;
+		}
+		memcpy(b->data, &buf[i * blksz], blksz);
+		b->dirty = 1;
+	}
+	return i;
+}
+
 static u64_t sub_block_read(struct block_t * blk, u8_t * buf, u64_t blkno, u64_t blkcnt)
 {
 	struct sub_block_pdata_t * pdat = (struct sub_block_pdata_t *)(blk->priv);
@@ -93,9 +360,21 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	if(!blk->read || !blk->write || !blk->sync)
 		return NULL;
 
+	blk->hit = 0;
+	blk->miss = 0;
+	blk->ranext = 0;
+	blk->rawin = 0;
+	blk->bounce = malloc(block_size(blk));
+	if(!blk->bounce)
+		return NULL;
+
 	dev = malloc(sizeof(struct device_t));
 	if(!dev)
+	{
+		free(blk->bounce);
+		blk->bounce = NULL;
 		return NULL;
+	}
 
 	dev->name = strdup(blk->name);
 	dev->type = DEVICE_TYPE_BLOCK;
@@ -105,31 +384,45 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	kobj_add_regular(dev->kobj, "size", block_read_size, NULL, blk);
 	kobj_add_regular(dev->kobj, "count", block_read_count, NULL, blk);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	kobj_add_regular(dev->kobj, "hit", block_read_hit, NULL, blk);
+	kobj_add_regular(dev->kobj, "miss", block_read_miss, NULL, blk);
 
 	if(!register_device(dev))
 	{
 		kobj_remove_self(dev->kobj);
 		free(dev->name);
 		free(dev);
+		free(blk->bounce);
+		blk->bounce = NULL;
 		return NULL;
 	}
 	return dev;
 }
 
-void unregister_block(struct block_t * blk)
+int unregister_block(struct block_t * blk)
 {
 	struct device_t * dev;
+	struct block_t * root;
+	u64_t blkno = 0;
+	int ret = 0;
 
 	if(blk && blk->name)
 	{
 		dev = search_device(blk->name, DEVICE_TYPE_BLOCK);
 		if(dev && unregister_device(dev))
 		{
+			root = block_root(blk, &blkno);
+			mutex_lock(&__block_cache.lock);
+			ret = block_cache_flush(root, blkno, block_count(blk), 1);
+			mutex_unlock(&__block_cache.lock);
 			kobj_remove_self(dev->kobj);
 			free(dev->name);
 			free(dev);
+			free(blk->bounce);
+			blk->bounce = NULL;
 		}
 	}
+	return ret;
 }
 
 struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t length, const char * name)
@@ -175,6 +468,7 @@ struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t
 	blk->read = sub_block_read;
 	blk->write = sub_block_write;
 	blk->sync = sub_block_sync;
+	blk->direct = pblk->direct;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, NULL)))
@@ -236,9 +530,8 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > tmp)
 		count = tmp;
 
-	p = malloc(blksz);
-	if(!p)
-		return 0;
+	mutex_lock(&__block_cache.lock);
+	p = blk->bounce;
 
 	blkno = offset / blksz;
 	tmp = offset % blksz;
@@ -248,9 +541,9 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(block_cache_read(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
@@ -266,9 +559,9 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->read(blk, buf, blkno, tmp) != tmp)
+		if(block_cache_read(blk, buf, blkno, tmp) != tmp)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
@@ -282,9 +575,9 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(block_cache_read(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
@@ -292,7 +585,7 @@ u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		ret += len;
 	}
 
-	free(p);
+	mutex_unlock(&__block_cache.lock);
 	return ret;
 }
 
@@ -319,9 +612,8 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	if(count > tmp)
 		count = tmp;
 
-	p = malloc(blksz);
-	if(!p)
-		return 0;
+	mutex_lock(&__block_cache.lock);
+	p = blk->bounce;
 
 	blkno = offset / blksz;
 	tmp = offset % blksz;
@@ -331,17 +623,17 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 		if(count < len)
 			len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(block_cache_read(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
 		memcpy((void *)(&p[tmp]), (const void *)buf, len);
 
-		if(blk->write(blk, p, blkno, 1) != 1)
+		if(block_cache_write(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
@@ -356,9 +648,9 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = tmp * blksz;
 
-		if(blk->write(blk, buf, blkno, tmp) != tmp)
+		if(block_cache_write(blk, buf, blkno, tmp) != tmp)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
@@ -372,29 +664,52 @@ u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 	{
 		len = count;
 
-		if(blk->read(blk, p, blkno, 1) != 1)
+		if(block_cache_read(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
 		memcpy((void *)(&p[0]), (const void *)buf, len);
 
-		if(blk->write(blk, p, blkno, 1) != 1)
+		if(block_cache_write(blk, p, blkno, 1) != 1)
 		{
-			free(p);
+			mutex_unlock(&__block_cache.lock);
 			return ret;
 		}
 
 		ret += len;
 	}
 
-	free(p);
+	mutex_unlock(&__block_cache.lock);
 	return ret;
 }
 
-void block_sync(struct block_t * blk)
+int block_sync(struct block_t * blk)
 {
+	struct block_t * root;
+	u64_t blkno = 0;
+	int ret = 0;
+
 	if(blk && blk->sync)
+	{
+		root = block_root(blk, &blkno);
+		mutex_lock(&__block_cache.lock);
+		ret = block_cache_flush(root, blkno, block_count(blk), 0);
+		mutex_unlock(&__block_cache.lock);
 		blk->sync(blk);
+	}
+	return ret;
+}
+
+static __init void block_cache_pure_init(void)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(__block_cache.hash); i++)
+		init_hlist_head(&__block_cache.hash[i]);
+	init_list_head(&__block_cache.lru);
+	mutex_init(&__block_cache.lock);
+	__block_cache.size = 0;
 }
+pure_initcall(block_cache_pure_init);
@@ -49,6 +49,18 @@ struct camera_t * search_first_camera(void)
 	return (struct camera_t *)dev->priv;
 }
 
+static ssize_t camera_read_frames(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct camera_t * cam = (struct camera_t *)kobj->priv;
+	return sprintf(buf, "%lld", cam->queue.sequence);
+}
+
+static ssize_t camera_read_dropped(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct camera_t * cam = (struct camera_t *)kobj->priv;
+	return sprintf(buf, "%lld", cam->queue.dropped);
+}
+
 struct device_t * register_camera(struct camera_t * cam, struct driver_t * drv)
 {
 	struct device_t * dev;
@@ -63,11 +75,24 @@ struct device_t * register_camera(struct camera_t * cam, struct driver_t * drv)
 	if(!dev)
 		return NULL;
 
+	cam->queue.buffers = NULL;
+	cam->queue.count = 0;
+	init_list_head(&cam->queue.free);
+	init_list_head(&cam->queue.ready);
+	spin_lock_init(&cam->queue.lock);
+	cam->queue.task = NULL;
+	cam->queue.waiter = NULL;
+	cam->queue.running = 0;
+	cam->queue.sequence = 0;
+	cam->queue.dropped = 0;
+
 	dev->name = strdup(cam->name);
 	dev->type = DEVICE_TYPE_CAMERA;
 	dev->driver = drv;
 	dev->priv = cam;
 	dev->kobj = kobj_alloc_directory(dev->name);
+	kobj_add_regular(dev->kobj, "frames", camera_read_frames, NULL, cam);
+	kobj_add_regular(dev->kobj, "dropped", camera_read_dropped, NULL, cam);
 
 	if(!register_device(dev))
 	{
@@ -119,6 +144,7 @@ int camera_capture(struct camera_t * cam, struct video_frame_t * frame, int time
 			do {
 				if(cam->capture(cam, frame))
 					return 1;
+				task_sleep(CONFIG_CAMERA_POLL_INTERVAL * 1000000ULL);
 			} while(ktime_before(ktime_get(), t));
 		}
 		else
@@ -135,3 +161,193 @@ int camera_ioctl(struct camera_t * cam, const char * cmd, void * arg)
 		return cam->ioctl(cam, cmd, arg);
 	return -1;
 }
+
+/*
+ * Drivers only offer a polling capture, the capture task polls it on its own
+ * and sleeps in between, copying each new frame into a free pool buffer. When
+ * no buffer is free the oldest ready frame is recycled and counted as dropped.
+ */
+static void camera_capture_task(struct task_t * task, void * data)
+{
+	struct camera_t * cam = (struct camera_t *)data;
+	struct camera_buffer_t * b;
+	struct video_frame_t frame;
+	struct task_t * waiter;
+	irq_flags_t flags;
+	void * mem;
+
+	while(cam->queue.running)
+	{
+		if(cam->capture(cam, &frame) && (frame.buflen > 0))
+		{
+			spin_lock_irqsave(&cam->queue.lock, flags);
+			if(!list_empty(&cam->queue.free))
+			{
+				b = list_first_entry(&cam->queue.free, struct camera_buffer_t, entry);
+			}
+			else if(!list_empty(&cam->queue.ready))
+			{
+				b = list_first_entry(&cam->queue.ready, struct camera_buffer_t, entry);
+				cam->queue.dropped++;
+			}
+			else
+			{
+				b = NULL;
+				cam->queue.dropped++;
+			}
+			if(b)
+				list_del_init(&b->entry);
+			cam->queue.sequence++;
+			spin_unlock_irqrestore(&cam->queue.lock, flags);
+
+			if(b)
+			{
+				if(b->size < frame.buflen)
+				{
+					if((mem = realloc(b->frame.buf, frame.buflen)))
+					{
+						b->frame.buf = mem;
+						b->size = frame.buflen;
+					}
+				}
+				if(b->size >= frame.buflen)
+				{
+					memcpy(b->frame.buf, frame.buf, frame.buflen);
+					b->frame.fmt = frame.fmt;
+					b->frame.width = frame.width;
+					b->frame.height = frame.height;
+					b->frame.buflen = frame.buflen;
+					b->timestamp = ktime_get();
+				}
+				spin_lock_irqsave(&cam->queue.lock, flags);
+				b->sequence = cam->queue.sequence;
+				if(b->size >= frame.buflen)
+					list_add_tail(&b->entry, &cam->queue.ready);
+				else
+					list_add_tail(&b->entry, &cam->queue.free);
+				waiter = cam->queue.waiter;
+				spin_unlock_irqrestore(&cam->queue.lock, flags);
+				task_wakeup(waiter);
+			}
+		}
+		task_sleep(CONFIG_CAMERA_POLL_INTERVAL * 1000000ULL);
+	}
+	cam->queue.task = NULL;
+}
+
+int camera_stream_start(struct camera_t * cam, enum video_format_t fmt, int width, int height, int count)
+{
+	struct camera_buffer_t * b;
+	int i;
+
+	if(!cam || cam->queue.running || (count <= 0))
+		return 0;
+	cam->queue.buffers = malloc(sizeof(struct camera_buffer_t) * count);
+	if(!cam->queue.buffers)
+		return 0;
+	cam->queue.count = count;
+	init_list_head(&cam->queue.free);
+	init_list_head(&cam->queue.ready);
+	for(i = 0; i < count; i++)
+	{
+		b = &cam->queue.buffers[i];
+		memset(b, 0, sizeof(struct camera_buffer_t));
+		b->index = i;
+		list_add_tail(&b->entry, &cam->queue.free);
+	}
+	cam->queue.sequence = 0;
+	cam->queue.dropped = 0;
+	if(!camera_start(cam, fmt, width, height))
+	{
+		free(cam->queue.buffers);
+		cam->queue.buffers = NULL;
+		cam->queue.count = 0;
+		return 0;
+	}
+	cam->queue.running = 1;
+	cam->queue.task = task_create(NULL, "camera", camera_capture_task, cam, 0, 0);
+	if(!cam->queue.task)
+	{
+		cam->queue.running = 0;
+		camera_stop(cam);
+		free(cam->queue.buffers);
+		cam->queue.buffers = NULL;
+		cam->queue.count = 0;
+		return 0;
+	}
+	task_resume(cam->queue.task);
+	return 1;
+}
+
+void camera_stream_stop(struct camera_t * cam)
+{
+	int i;
+
+	if(cam && cam->queue.running)
+	{
+		cam->queue.running = 0;
+		while(cam->queue.task)
+		{
+			task_wakeup(cam->queue.task);
+			task_yield();
+		}
+		camera_stop(cam);
+		for(i = 0; i < cam->queue.count; i++)
+		{
+			if(cam->queue.buffers[i].frame.buf)
+				free(cam->queue.buffers[i].frame.buf);
+		}
+		free(cam->queue.buffers);
+		cam->queue.buffers = NULL;
+		cam->queue.count = 0;
+		init_list_head(&cam->queue.free);
+		init_list_head(&cam->queue.ready);
+	}
+}
+
+/*
+ * Take the oldest ready frame, waiting up to timeout milliseconds for one.
+ * The caller sleeps until the capture task wakes it, a negative timeout
+ * waits forever.
+ */
+struct camera_buffer_t * camera_dequeue(struct camera_t * cam, int timeout)
+{
+	struct camera_buffer_t * b = NULL;
+	irq_flags_t flags;
+	ktime_t now, t;
+
+	if(!cam || !cam->queue.running)
+		return NULL;
+	t = ktime_add_ms(ktime_get(), timeout);
+	while(1)
+	{
+		spin_lock_irqsave(&cam->queue.lock, flags);
+		if(!list_empty(&cam->queue.ready))
+		{
+			b = list_first_entry(&cam->queue.ready, struct camera_buffer_t, entry);
+			list_del_init(&b->entry);
+		}
+		cam->queue.waiter = b ? NULL : task_self();
+		spin_unlock_irqrestore(&cam->queue.lock, flags);
+		if(b || (timeout == 0))
+			break;
+		now = ktime_get();
+		if((timeout > 0) && !ktime_before(now, t))
+			break;
+		task_sleep((timeout > 0) ? ktime_to_ns(ktime_sub(t, now)) : UINT64_MAX);
+	}
+	cam->queue.waiter = NULL;
+	return b;
+}
+
+void camera_enqueue(struct camera_t * cam, struct camera_buffer_t * buf)
+{
+	irq_flags_t flags;
+
+	if(cam && buf)
+	{
+		spin_lock_irqsave(&cam->queue.lock, flags);
+		list_add_tail(&buf->entry, &cam->queue.free);
+		spin_unlock_irqrestore(&cam->queue.lock, flags);
+	}
+}
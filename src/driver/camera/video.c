@@ -25,11 +25,15 @@
  * SOFTWARE.
  *
  */
-
 #include <xboot.h>
 #include <jpeglib.h>
 #include <jerror.h>
 #include <camera/video.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__X64__)
+#include <immintrin.h>
+#endif
 
 static inline unsigned char yuv_to_red(int y, int u, int v)
 {
@@ -49,160 +53,228 @@ static inline unsigned char yuv_to_blue(int y, int u, int v)
 	return (b < 0) ? 0 : ((b > 255) ? 255 : b);
 }
 
-static inline void yuyv_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+/*
+ * Convert one row of planar yuv into argb, the chroma is shared by each pixel pair
+ */
+static void yuv_row_to_argb_c(unsigned char * q, unsigned char * py, unsigned char * pu, unsigned char * pv, int width)
 {
-	unsigned char * q = argb;
-	unsigned char * p = yuv;
-	int len = width * height;
-	int y0, u, y1, v;
+	int y, u, v;
 	int i;
 
-	for(i = 0; i < len; i += 2)
+	for(i = 0; i < width; i++)
 	{
-		y0 = *p++;
-		u = *p++;
-		y1 = *p++;
-		v = *p++;
+		y = py[i];
+		u = pu[i >> 1];
+		v = pv[i >> 1];
 
-		*q++ = yuv_to_blue(y0, u, v);
-		*q++ = yuv_to_green(y0, u, v);
-		*q++ = yuv_to_red(y0, u, v);
-		*q++ = 255;
-
-		*q++ = yuv_to_blue(y1, u, v);
-		*q++ = yuv_to_green(y1, u, v);
-		*q++ = yuv_to_red(y1, u, v);
+		*q++ = yuv_to_blue(y, u, v);
+		*q++ = yuv_to_green(y, u, v);
+		*q++ = yuv_to_red(y, u, v);
 		*q++ = 255;
 	}
 }
 
-static inline void uyvy_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+#if defined(__ARM_NEON)
+static void yuv_row_to_argb_neon(unsigned char * q, unsigned char * py, unsigned char * pu, unsigned char * pv, int width)
 {
-	unsigned char * q = argb;
-	unsigned char * p = yuv;
-	int len = width * height;
-	int y0, u, y1, v;
+	int16x8_t c128 = vdupq_n_s16(128);
+	int16x8_t d, e, rd, gd, bd, y0, y1;
+	int16x8x2_t r, g, b;
+	uint8x16x4_t o;
+	uint8x16_t y;
 	int i;
 
-	for(i = 0; i < len; i += 2)
+	o.val[3] = vdupq_n_u8(255);
+	for(i = 0; i + 16 <= width; i += 16)
 	{
-		u = *p++;
-		y0 = *p++;
-		v = *p++;
-		y1 = *p++;
-
-		*q++ = yuv_to_blue(y0, u, v);
-		*q++ = yuv_to_green(y0, u, v);
-		*q++ = yuv_to_red(y0, u, v);
-		*q++ = 255;
-
-		*q++ = yuv_to_blue(y1, u, v);
-		*q++ = yuv_to_green(y1, u, v);
-		*q++ = yuv_to_red(y1, u, v);
-		*q++ = 255;
+		y = vld1q_u8(py + i);
+		e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pu + (i >> 1)))), c128);
+		d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pv + (i >> 1)))), c128);
+		rd = vaddq_s16(d, vshrq_n_s16(vmulq_n_s16(d, 103), 8));
+		gd = vaddq_s16(vshrq_n_s16(vmulq_n_s16(e, 88), 8), vshrq_n_s16(vmulq_n_s16(d, 183), 8));
+		bd = vaddq_s16(e, vshrq_n_s16(vmulq_n_s16(e, 198), 8));
+		r = vzipq_s16(rd, rd);
+		g = vzipq_s16(gd, gd);
+		b = vzipq_s16(bd, bd);
+		y0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+		y1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+		o.val[0] = vcombine_u8(vqmovun_s16(vaddq_s16(y0, b.val[0])), vqmovun_s16(vaddq_s16(y1, b.val[1])));
+		o.val[1] = vcombine_u8(vqmovun_s16(vsubq_s16(y0, g.val[0])), vqmovun_s16(vsubq_s16(y1, g.val[1])));
+		o.val[2] = vcombine_u8(vqmovun_s16(vaddq_s16(y0, r.val[0])), vqmovun_s16(vaddq_s16(y1, r.val[1])));
+		vst4q_u8(q + (i << 2), o);
 	}
+	if(i < width)
+		yuv_row_to_argb_c(q + (i << 2), py + i, pu + (i >> 1), pv + (i >> 1), width - i);
 }
-
-static inline void nv12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+#define yuv_row_to_argb		yuv_row_to_argb_neon
+#elif defined(__X64__)
+static void yuv_row_to_argb_sse2(unsigned char * q, unsigned char * py, unsigned char * pu, unsigned char * pv, int width)
 {
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * puv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
+	__m128i zero = _mm_setzero_si128();
+	__m128i c128 = _mm_set1_epi16(128);
+	__m128i c103 = _mm_set1_epi16(103);
+	__m128i c88 = _mm_set1_epi16(88);
+	__m128i c183 = _mm_set1_epi16(183);
+	__m128i c198 = _mm_set1_epi16(198);
+	__m128i a = _mm_set1_epi8(-1);
+	__m128i y, y0, y1, d, e, rd, gd, bd;
+	__m128i r, g, b, bg0, bg1, ra0, ra1;
+	int i;
 
-	for(j = 0; j < height; j++)
+	for(i = 0; i + 16 <= width; i += 16)
 	{
-		for(i = 0; i < width; i++)
-		{
-			y = *py++;
-			t = ((j >> 1) * ((width + 1) >> 1) + (i >> 1)) << 1;
-			u = puv[t];
-			v = puv[t + 1];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
-		}
+		y = _mm_loadu_si128((__m128i *)(py + i));
+		e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(pu + (i >> 1))), zero), c128);
+		d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(pv + (i >> 1))), zero), c128);
+		rd = _mm_add_epi16(d, _mm_srai_epi16(_mm_mullo_epi16(d, c103), 8));
+		gd = _mm_add_epi16(_mm_srai_epi16(_mm_mullo_epi16(e, c88), 8), _mm_srai_epi16(_mm_mullo_epi16(d, c183), 8));
+		bd = _mm_add_epi16(e, _mm_srai_epi16(_mm_mullo_epi16(e, c198), 8));
+		y0 = _mm_unpacklo_epi8(y, zero);
+		y1 = _mm_unpackhi_epi8(y, zero);
+		r = _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(rd, rd)), _mm_add_epi16(y1, _mm_unpackhi_epi16(rd, rd)));
+		g = _mm_packus_epi16(_mm_sub_epi16(y0, _mm_unpacklo_epi16(gd, gd)), _mm_sub_epi16(y1, _mm_unpackhi_epi16(gd, gd)));
+		b = _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(bd, bd)), _mm_add_epi16(y1, _mm_unpackhi_epi16(bd, bd)));
+		bg0 = _mm_unpacklo_epi8(b, g);
+		bg1 = _mm_unpackhi_epi8(b, g);
+		ra0 = _mm_unpacklo_epi8(r, a);
+		ra1 = _mm_unpackhi_epi8(r, a);
+		_mm_storeu_si128((__m128i *)(q + (i << 2) + 0), _mm_unpacklo_epi16(bg0, ra0));
+		_mm_storeu_si128((__m128i *)(q + (i << 2) + 16), _mm_unpackhi_epi16(bg0, ra0));
+		_mm_storeu_si128((__m128i *)(q + (i << 2) + 32), _mm_unpacklo_epi16(bg1, ra1));
+		_mm_storeu_si128((__m128i *)(q + (i << 2) + 48), _mm_unpackhi_epi16(bg1, ra1));
 	}
+	if(i < width)
+		yuv_row_to_argb_c(q + (i << 2), py + i, pu + (i >> 1), pv + (i >> 1), width - i);
 }
+#define yuv_row_to_argb		yuv_row_to_argb_sse2
+#else
+#define yuv_row_to_argb		yuv_row_to_argb_c
+#endif
 
-static inline void nv21_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+/*
+ * Nearest neighbour sampling table, maps each destination column or row to the source
+ */
+static int * video_sample_table(int dst, int src)
 {
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * puv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
+	int * t = malloc(sizeof(int) * dst);
+	int i;
 
-	for(j = 0; j < height; j++)
+	if(t)
 	{
-		for(i = 0; i < width; i++)
-		{
-			y = *py++;
-			t = ((j >> 1) * ((width + 1) >> 1) + (i >> 1)) << 1;
-			u = puv[t + 1];
-			v = puv[t];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
-		}
+		for(i = 0; i < dst; i++)
+			t[i] = (int)((int64_t)i * src / dst);
 	}
+	return t;
 }
 
-static inline void yu12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+static void yuv_to_argb(struct video_frame_t * frame, unsigned char * argb, int width, int height)
 {
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * pu = yuv + width * height;
-	unsigned char * pv = yuv + width * height + ((width + 1) >> 1) * ((height + 1) >> 1);
-	int y, u, v, t;
-	int i, j;
-
-	for(j = 0; j < height; j++)
+	unsigned char * yuv = frame->buf;
+	unsigned char * ty, * tu, * tv;
+	unsigned char * py, * pu, * pv, * p;
+	int sw = frame->width;
+	int sh = frame->height;
+	int cw = (sw + 1) >> 1;
+	int ch = (sh + 1) >> 1;
+	int yo, uo, vo, pair;
+	int * xs;
+	int i, j, sy, t;
+
+	xs = video_sample_table(width, sw);
+	ty = malloc(width + ((width + 1) >> 1) * 2);
+	if(!xs || !ty)
 	{
-		for(i = 0; i < width; i++)
-		{
-			y = *py++;
-			t = (j >> 1) * ((width + 1) >> 1) + (i >> 1);
-			u = pu[t];
-			v = pv[t];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
-		}
+		if(xs)
+			free(xs);
+		if(ty)
+			free(ty);
+		return;
 	}
-}
-
-static inline void yv12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
-{
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * pu = yuv + width * height + ((width + 1) >> 1) * ((height + 1) >> 1);
-	unsigned char * pv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
+	tu = ty + width;
+	tv = tu + ((width + 1) >> 1);
+	pair = (sw >> 1) - 1;
+	if(pair < 0)
+		pair = 0;
 
 	for(j = 0; j < height; j++)
 	{
-		for(i = 0; i < width; i++)
+		sy = (height == sh) ? j : (int)((int64_t)j * sh / height);
+		py = ty;
+		pu = tu;
+		pv = tv;
+		switch(frame->fmt)
 		{
-			y = *py++;
-			t = (j >> 1) * ((width + 1) >> 1) + (i >> 1);
-			u = pu[t];
-			v = pv[t];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
+		case VIDEO_FORMAT_YUYV:
+		case VIDEO_FORMAT_UYVY:
+			if(frame->fmt == VIDEO_FORMAT_YUYV)
+			{
+				yo = 0; uo = 1; vo = 3;
+			}
+			else
+			{
+				yo = 1; uo = 0; vo = 2;
+			}
+			p = yuv + sy * (sw << 1);
+			for(i = 0; i < width; i++)
+				ty[i] = p[(xs[i] << 1) + yo];
+			for(i = 0; i < width; i += 2)
+			{
+				t = min(xs[i] >> 1, pair) << 2;
+				tu[i >> 1] = p[t + uo];
+				tv[i >> 1] = p[t + vo];
+			}
+			break;
+		case VIDEO_FORMAT_NV12:
+		case VIDEO_FORMAT_NV21:
+			uo = (frame->fmt == VIDEO_FORMAT_NV12) ? 0 : 1;
+			p = yuv + sy * sw;
+			if(width == sw)
+				py = p;
+			else
+			{
+				for(i = 0; i < width; i++)
+					ty[i] = p[xs[i]];
+			}
+			p = yuv + sw * sh + (sy >> 1) * (cw << 1);
+			for(i = 0; i < width; i += 2)
+			{
+				t = (xs[i] >> 1) << 1;
+				tu[i >> 1] = p[t + uo];
+				tv[i >> 1] = p[t + (uo ^ 1)];
+			}
+			break;
+		case VIDEO_FORMAT_YU12:
+		case VIDEO_FORMAT_YV12:
+			p = yuv + sy * sw;
+			pu = yuv + sw * sh + (sy >> 1) * cw;
+			pv = pu + cw * ch;
+			if(frame->fmt == VIDEO_FORMAT_YV12)
+			{
+				pv = pu;
+				pu = pv + cw * ch;
+			}
+			if(width == sw)
+				py = p;
+			else
+			{
+				for(i = 0; i < width; i++)
+					ty[i] = p[xs[i]];
+				for(i = 0; i < width; i += 2)
+				{
+					tu[i >> 1] = pu[xs[i] >> 1];
+					tv[i >> 1] = pv[xs[i] >> 1];
+				}
+				pu = tu;
+				pv = tv;
+			}
+			break;
+		default:
+			break;
 		}
+		yuv_row_to_argb(argb + j * (width << 2), py, pu, pv, width);
 	}
+	free(xs);
+	free(ty);
 }
 
 static const unsigned char dc_lumi_len[] = {
@@ -298,13 +370,18 @@ static void x_emit_message(j_common_ptr dinfo, int msg_level)
 		err->num_warnings++;
 }
 
-static void mjpg_to_argb(unsigned char * argb, unsigned char * mjpg, int len, int stride)
+/*
+ * Decode motion jpeg, let libjpeg do the coarse downscale and sample the scanlines for the rest
+ */
+static void mjpg_decode(struct video_frame_t * frame, unsigned char * pixels, int width, int height, int gray)
 {
 	struct jpeg_decompress_struct dinfo;
 	struct x_error_mgr jerr;
 	JSAMPARRAY buf;
-	unsigned char * p;
-	int scanline, offset, i;
+	unsigned char * p, * q;
+	int * volatile xs = NULL;
+	int bpp = gray ? 1 : 4;
+	int denom, sy, i, j = 0;
 
 	dinfo.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = x_error_exit;
@@ -312,65 +389,179 @@ static void mjpg_to_argb(unsigned char * argb, unsigned char * mjpg, int len, in
 	if(setjmp(jerr.setjmp_buffer))
 	{
 		jpeg_destroy_decompress(&dinfo);
+		if(xs)
+			free(xs);
 		return;
 	}
 	jpeg_create_decompress(&dinfo);
-	jpeg_mem_src(&dinfo, mjpg, len);
+	jpeg_mem_src(&dinfo, frame->buf, frame->buflen);
 	jpeg_read_header(&dinfo, TRUE);
 	if(dinfo.dc_huff_tbl_ptrs[0] == NULL)
 		insert_huff_tables(&dinfo);
-	dinfo.out_color_space = JCS_RGB;
+	for(denom = 8; denom > 1; denom >>= 1)
+	{
+		if((dinfo.image_width / denom >= width) && (dinfo.image_height / denom >= height))
+			break;
+	}
+	dinfo.scale_num = 1;
+	dinfo.scale_denom = denom;
+	dinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
 	dinfo.dct_method = JDCT_IFAST;
 	jpeg_start_decompress(&dinfo);
+	xs = video_sample_table(width, dinfo.output_width);
+	if(!xs)
+	{
+		jpeg_destroy_decompress(&dinfo);
+		return;
+	}
 	buf = (*dinfo.mem->alloc_sarray)((j_common_ptr)&dinfo, JPOOL_IMAGE, dinfo.output_width * dinfo.output_components, 1);
-	p = argb;
 	while(dinfo.output_scanline < dinfo.output_height)
 	{
-		scanline = dinfo.output_scanline * stride;
+		sy = dinfo.output_scanline;
 		jpeg_read_scanlines(&dinfo, buf, 1);
-		for(i = 0; i < dinfo.output_width; i++)
+		for(; (j < height) && ((int)((int64_t)j * dinfo.output_height / height) == sy); j++)
 		{
-			offset = scanline + (i * 4);
-			p[offset + 3] = 0xff;
-			p[offset + 2] = buf[0][(i * 3) + 0];
-			p[offset + 1] = buf[0][(i * 3) + 1];
-			p[offset + 0] = buf[0][(i * 3) + 2];
+			q = pixels + j * width * bpp;
+			if(gray)
+			{
+				if(width == dinfo.output_width)
+					memcpy(q, buf[0], width);
+				else
+				{
+					for(i = 0; i < width; i++)
+						q[i] = buf[0][xs[i]];
+				}
+			}
+			else
+			{
+				for(i = 0; i < width; i++, q += 4)
+				{
+					p = &buf[0][xs[i] * 3];
+					q[3] = 0xff;
+					q[2] = p[0];
+					q[1] = p[1];
+					q[0] = p[2];
+				}
+			}
 		}
 	}
 	jpeg_finish_decompress(&dinfo);
 	jpeg_destroy_decompress(&dinfo);
+	free(xs);
 }
 
-void video_frame_to_argb(struct video_frame_t * frame, void * pixels)
+static void argb_scale(struct video_frame_t * frame, uint32_t * argb, int width, int height)
 {
+	uint32_t * p;
+	int * xs = video_sample_table(width, frame->width);
+	int i, j;
+
+	if(xs)
+	{
+		for(j = 0; j < height; j++, argb += width)
+		{
+			p = (uint32_t *)frame->buf + (int)((int64_t)j * frame->height / height) * frame->width;
+			for(i = 0; i < width; i++)
+				argb[i] = p[xs[i]];
+		}
+		free(xs);
+	}
+}
+
+void video_frame_to_argb_scaled(struct video_frame_t * frame, void * pixels, int width, int height)
+{
+	if(!frame || !pixels || (width <= 0) || (height <= 0))
+		return;
+
 	switch(frame->fmt)
 	{
-	case VIDEO_FORMAT_ARGB:
-		memcpy(pixels, frame->buf, frame->buflen);
-		break;
 	case VIDEO_FORMAT_YUYV:
-		yuyv_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_UYVY:
-		uyvy_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_NV12:
-		nv12_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_NV21:
-		nv21_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_YU12:
-		yu12_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_YV12:
-		yv12_to_argb(pixels, frame->buf, frame->width, frame->height);
+		yuv_to_argb(frame, pixels, width, height);
 		break;
 	case VIDEO_FORMAT_MJPG:
-		mjpg_to_argb(pixels, frame->buf, frame->buflen, frame->width << 2);
+		mjpg_decode(frame, pixels, width, height, 0);
+		break;
+	case VIDEO_FORMAT_ARGB:
+	default:
+		if((width == frame->width) && (height == frame->height))
+			memcpy(pixels, frame->buf, frame->buflen);
+		else
+			argb_scale(frame, pixels, width, height);
+		break;
+	}
+}
+
+void video_frame_to_argb(struct video_frame_t * frame, void * pixels)
+{
+	video_frame_to_argb_scaled(frame, pixels, frame->width, frame->height);
+}
+
+void video_frame_to_gray(struct video_frame_t * frame, void * gray, int width, int height)
+{
+	unsigned char * q = gray;
+	unsigned char * p;
+	int sw, sh, yo;
+	int * xs;
+	int i, j;
+
+	if(!frame || !gray || (width <= 0) || (height <= 0))
+		return;
+
+	sw = frame->width;
+	sh = frame->height;
+	switch(frame->fmt)
+	{
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_NV21:
+	case VIDEO_FORMAT_YU12:
+	case VIDEO_FORMAT_YV12:
+		if((width == sw) && (height == sh))
+		{
+			memcpy(gray, frame->buf, sw * sh);
+			return;
+		}
 		break;
+	case VIDEO_FORMAT_MJPG:
+		mjpg_decode(frame, gray, width, height, 1);
+		return;
 	default:
-		memcpy(pixels, frame->buf, frame->buflen);
 		break;
 	}
+
+	xs = video_sample_table(width, sw);
+	if(!xs)
+		return;
+	for(j = 0; j < height; j++, q += width)
+	{
+		switch(frame->fmt)
+		{
+		case VIDEO_FORMAT_YUYV:
+		case VIDEO_FORMAT_UYVY:
+			yo = (frame->fmt == VIDEO_FORMAT_YUYV) ? 0 : 1;
+			p = (unsigned char *)frame->buf + (int)((int64_t)j * sh / height) * (sw << 1);
+			for(i = 0; i < width; i++)
+				q[i] = p[(xs[i] << 1) + yo];
+			break;
+		case VIDEO_FORMAT_NV12:
+		case VIDEO_FORMAT_NV21:
+		case VIDEO_FORMAT_YU12:
+		case VIDEO_FORMAT_YV12:
+			p = (unsigned char *)frame->buf + (int)((int64_t)j * sh / height) * sw;
+			for(i = 0; i < width; i++)
+				q[i] = p[xs[i]];
+			break;
+		case VIDEO_FORMAT_ARGB:
+		default:
+			p = (unsigned char *)frame->buf + (int)((int64_t)j * sh / height) * (sw << 2);
+			for(i = 0; i < width; i++)
+				q[i] = (p[(xs[i] << 2) + 2] * 19595L + p[(xs[i] << 2) + 1] * 38469L + p[(xs[i] << 2) + 0] * 7472L) >> 16;
+			break;
+		}
+	}
+	free(xs);
 }
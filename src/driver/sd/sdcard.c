@@ -732,6 +732,7 @@ static void sdcard_scan(struct sdcard_pdata_t * pdat)
 				pdat->blk.read = sdcard_blk_read;
 				pdat->blk.write = sdcard_blk_write;
 				pdat->blk.sync = sdcard_blk_sync;
+				pdat->blk.direct = 0;
 				pdat->blk.priv = pdat;
 				if(register_block(&pdat->blk, NULL))
 				{
@@ -104,7 +104,7 @@ return M
 
 int luaopen_assets(lua_State * L)
 {
-	if(luaL_loadbuffer(L, assets_lua, sizeof(assets_lua) - 1, "Assets.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, assets_lua, sizeof(assets_lua) - 1, "Assets.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
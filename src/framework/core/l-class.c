@@ -75,7 +75,7 @@ end
 
 int luaopen_class(lua_State * L)
 {
-	if(luaL_loadbuffer(L, class_lua, sizeof(class_lua) - 1, "Class.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, class_lua, sizeof(class_lua) - 1, "Class.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
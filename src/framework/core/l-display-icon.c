@@ -81,7 +81,7 @@ return M
 
 int luaopen_display_icon(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_icon_lua, sizeof(display_icon_lua) - 1, "DisplayIcon.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_icon_lua, sizeof(display_icon_lua) - 1, "DisplayIcon.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
@@ -62,7 +62,7 @@ return M
 
 int luaopen_display_image(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_image_lua, sizeof(display_image_lua) - 1, "DisplayImage.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_image_lua, sizeof(display_image_lua) - 1, "DisplayImage.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
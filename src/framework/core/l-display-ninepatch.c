@@ -70,7 +70,7 @@ return M
 
 int luaopen_display_ninepatch(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_ninepatch_lua, sizeof(display_ninepatch_lua) - 1, "DisplayNinepatch.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_ninepatch_lua, sizeof(display_ninepatch_lua) - 1, "DisplayNinepatch.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
@@ -32,6 +32,7 @@ static const char display_object_lua[] = X(
 local Dobject = Dobject
 local Easing = Easing
 local Event = Event
+local EventDispatcher = EventDispatcher
 local table = table
 
 local M = Class(EventDispatcher)
@@ -41,6 +42,34 @@ function M:init(width, height, content)
 	self._parent = nil
 	self._children = {}
 	self._dobj = Dobject.new(width, height, content)
+	self._dobj:setOwner(self)
+end
+
+function M:addEventListener(type, listener, data, phase)
+	EventDispatcher.addEventListener(self, type, listener, data, phase)
+	self:updateEventListening(type)
+	return self
+end
+
+function M:removeEventListener(type, listener, data, phase)
+	EventDispatcher.removeEventListener(self, type, listener, data, phase)
+	self:updateEventListening(type)
+	return self
+end
+
+function M:updateEventListening(type)
+	local broadcast, phased = false, false
+	local elm = self._elms[type]
+	if elm then
+		for i, v in ipairs(elm) do
+			if v.phase then
+				phased = true
+			else
+				broadcast = true
+			end
+		end
+	end
+	self._dobj:setEventListening(type, broadcast, phased)
 end
 
 function M:getParent()
@@ -386,6 +415,15 @@ function M:getTouchable()
 	return self._dobj:getTouchable()
 end
 
+function M:setCacheAsBitmap(enable)
+	self._dobj:setCacheAsBitmap(enable)
+	return self
+end
+
+function M:getCacheAsBitmap()
+	return self._dobj:getCacheAsBitmap()
+end
+
 function M:globalToLocal(x, y)
 	return self._dobj:globalToLocal(x, y)
 end
@@ -584,11 +622,7 @@ function M:spring(properties, velocity, tension, friction)
 end
 
 function M:dispatch(event)
-	self:dispatchEvent(event)
-	local children = self._children
-	for i = #children, 1, -1 do
-		children[i]:dispatch(event)
-	end
+	self._dobj:dispatch(event)
 end
 
 function M:render(display)
@@ -600,7 +634,7 @@ return M
 
 int luaopen_display_object(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_object_lua, sizeof(display_object_lua) - 1, "DisplayObject.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_object_lua, sizeof(display_object_lua) - 1, "DisplayObject.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
@@ -508,7 +508,7 @@ return M
 
 int luaopen_display_pager(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_pager_lua, sizeof(display_pager_lua) - 1, "DisplayPager.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_pager_lua, sizeof(display_pager_lua) - 1, "DisplayPager.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
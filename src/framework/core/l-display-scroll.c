@@ -324,7 +324,7 @@ return M
 
 int luaopen_display_scroll(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_scroll_lua, sizeof(display_scroll_lua) - 1, "DisplayScroll.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_scroll_lua, sizeof(display_scroll_lua) - 1, "DisplayScroll.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
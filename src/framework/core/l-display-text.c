@@ -92,7 +92,7 @@ return M
 
 int luaopen_display_text(lua_State * L)
 {
-	if(luaL_loadbuffer(L, display_text_lua, sizeof(display_text_lua) - 1, "DisplayText.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, display_text_lua, sizeof(display_text_lua) - 1, "DisplayText.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
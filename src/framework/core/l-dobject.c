@@ -35,6 +35,8 @@
 #include <core/l-window.h>
 #include <core/l-dobject.h>
 
+#define MT_DOBJECT_OWNER	"__mt_dobject_owner__"
+
 enum {
 	MFLAG_TRANSLATE					= (0x1 << 0),
 	MFLAG_ROTATE					= (0x1 << 1),
@@ -45,6 +47,8 @@ enum {
 	MFLAG_GLOBAL_MATRIX				= (0x1 << 6),
 	MFLAG_GLOBAL_BOUNDS				= (0x1 << 7),
 	MFLAG_DIRTY						= (0x1 << 8),
+	MFLAG_LAYOUT					= (0x1 << 9),
+	MFLAG_LAYOUT_CHILD				= (0x1 << 10),
 };
 
 static inline struct matrix_t * dobject_local_matrix(struct ldobject_t * o)
@@ -173,6 +177,10 @@ static void dobject_mark_children(struct ldobject_t * o, int mark)
 
 static inline void dobject_mark_dirty(struct ldobject_t * o)
 {
+	struct ldobject_t * p;
+
+	for(p = o; p; p = p->parent)
+		p->cache.valid = 0;
 	if(!(o->mflag & MFLAG_DIRTY))
 	{
 		region_clone(&o->dirty_bounds, dobject_global_bounds(o));
@@ -277,6 +285,95 @@ static inline enum layout_align_self_t dobject_layout_get_align_self(struct ldob
 	return (o->layout.style >> 12) & 0xf;
 }
 
+/*
+ * The children of an object marked MFLAG_LAYOUT must be placed again, and every
+ * ancestor on the way to the root carries MFLAG_LAYOUT_CHILD so the next pass
+ * only walks the branches that actually changed.
+ */
+static void dobject_mark_layout(struct ldobject_t * o)
+{
+	struct ldobject_t * p;
+
+	o->mflag |= MFLAG_LAYOUT;
+	for(p = o->parent; p && !(p->mflag & MFLAG_LAYOUT_CHILD); p = p->parent)
+		p->mflag |= MFLAG_LAYOUT_CHILD;
+}
+
+/*
+ * Event types are folded into one bit each, unknown types share the last bit.
+ * The subtree mask of a node is the union of its own broadcast listeners and
+ * the subtree masks of its children, so dispatch can skip silent subtrees.
+ */
+static const char * dobject_event_types[] = {
+	"enter-frame",
+	"animate-complete",
+	"key-down",
+	"key-up",
+	"rotary-turn",
+	"mouse-down",
+	"mouse-move",
+	"mouse-up",
+	"mouse-wheel",
+	"touch-begin",
+	"touch-move",
+	"touch-end",
+	"joystick-left-stick",
+	"joystick-right-stick",
+	"joystick-left-trigger",
+	"joystick-right-trigger",
+	"joystick-button-down",
+	"joystick-button-up",
+	"system-exit",
+	"click",
+	"press",
+	"release",
+	"change",
+};
+#define DOBJECT_EVENT_POINTER	(0x7fU << 5)
+#define DOBJECT_EVENT_OTHER		(1U << 31)
+
+static uint32_t dobject_event_bit(const char * type)
+{
+	int i;
+
+	if(type)
+	{
+		for(i = 0; i < ARRAY_SIZE(dobject_event_types); i++)
+		{
+			if(strcmp(dobject_event_types[i], type) == 0)
+				return 1U << i;
+		}
+	}
+	return DOBJECT_EVENT_OTHER;
+}
+
+static void dobject_update_smask(struct ldobject_t * o)
+{
+	struct ldobject_t * pos;
+	uint32_t mask, pmask;
+
+	for(; o; o = o->parent)
+	{
+		mask = o->emask;
+		pmask = o->pmask;
+		list_for_each_entry(pos, &o->children, entry)
+		{
+			mask |= pos->smask;
+			pmask |= pos->spmask;
+		}
+		if((mask == o->smask) && (pmask == o->spmask))
+			break;
+		o->smask = mask;
+		o->spmask = pmask;
+	}
+}
+
+static inline void dobject_mark_layout_item(struct ldobject_t * o)
+{
+	if(o->parent && dobject_layout_get_enable(o))
+		dobject_mark_layout(o->parent);
+}
+
 static inline double dobject_layout_main_leading_margin(struct ldobject_t * o)
 {
 	struct ldobject_t * parent = o->parent;
@@ -504,8 +601,19 @@ static void dobject_layout(struct ldobject_t * o)
 	double basis, ms, cp, cs;
 	enum layout_direction_t direction;
 	enum layout_align_t align;
-	int count, n;
+	int count, n, flag;
 
+	flag = o->mflag & (MFLAG_LAYOUT | MFLAG_LAYOUT_CHILD);
+	o->mflag &= ~(MFLAG_LAYOUT | MFLAG_LAYOUT_CHILD);
+	if(!(flag & MFLAG_LAYOUT))
+	{
+		list_for_each_entry(pos, &o->children, entry)
+		{
+			if(pos->mflag & (MFLAG_LAYOUT | MFLAG_LAYOUT_CHILD))
+				dobject_layout(pos);
+		}
+		return;
+	}
 	if(list_empty(&o->children))
 		return;
 
@@ -756,127 +864,126 @@ static void dobject_layout(struct ldobject_t * o)
 				pos->scalex != scalex || pos->scaley != scaley || pos->skewx != 0 || pos->skewy != 0 || pos->anchorx != 0 || pos->anchory != 0)
 			{
 				dobject_mark_dirty(pos);
+				if(pos->width != width || pos->height != height)
+					pos->mflag |= MFLAG_LAYOUT;
+				pos->width = width;
+				pos->height = height;
+				pos->x = pos->layout.x;
+				pos->y = pos->layout.y;
+				pos->rotation = 0.0;
+				pos->scalex = scalex;
+				pos->scaley = scaley;
+				pos->skewx = 0.0;
+				pos->skewy = 0.0;
+				pos->anchorx = 0.0;
+				pos->anchory = 0.0;
+				pos->mflag &= ~(MFLAG_TRANSLATE | MFLAG_ROTATE | MFLAG_SCALE | MFLAG_SKEW | MFLAG_ANCHOR);
+				if((pos->x != 0.0) || (pos->y != 0.0))
+					pos->mflag |= MFLAG_TRANSLATE;
+				if((pos->scalex != 1.0) || (pos->scaley != 1.0))
+					pos->mflag |= MFLAG_SCALE;
+				dobject_mark(pos, MFLAG_LOCAL_MATRIX);
+				dobject_mark_children(pos, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
 			}
-			pos->width = width;
-			pos->height = height;
-			pos->x = pos->layout.x;
-			pos->y = pos->layout.y;
-			pos->rotation = 0.0;
-			pos->scalex = scalex;
-			pos->scaley = scaley;
-			pos->skewx = 0.0;
-			pos->skewy = 0.0;
-			pos->anchorx = 0.0;
-			pos->anchory = 0.0;
-			pos->mflag &= ~(MFLAG_TRANSLATE | MFLAG_ROTATE | MFLAG_SCALE | MFLAG_SKEW | MFLAG_ANCHOR | MFLAG_LOCAL_MATRIX | MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
-			pos->mflag |= MFLAG_LOCAL_MATRIX | MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS;
-			if((pos->x == 0.0) && (pos->y == 0.0))
-				pos->mflag &= ~MFLAG_TRANSLATE;
-			else
-				pos->mflag |= MFLAG_TRANSLATE;
-			if((pos->scalex == 1.0) && (pos->scaley == 1.0))
-				pos->mflag &= ~MFLAG_SCALE;
-			else
-				pos->mflag |= MFLAG_SCALE;
 		}
-		dobject_layout(pos);
+		if(pos->mflag & (MFLAG_LAYOUT | MFLAG_LAYOUT_CHILD))
+			dobject_layout(pos);
 	}
 }
 
-static void dobject_draw_image(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_image(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m)
 {
 	struct limage_t * img = o->priv;
-	surface_blit(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), img->s, RENDER_TYPE_GOOD);
+	surface_blit(s, clip, m, img->s, RENDER_TYPE_GOOD);
 }
 
-static void dobject_draw_ninepatch(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_ninepatch(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m)
 {
 	struct lninepatch_t * ninepatch = o->priv;
-	struct surface_t * s = w->s;
-	struct matrix_t m;
+	struct matrix_t t;
 	if(ninepatch->lt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, 0);
+		surface_blit(s, clip, &t, ninepatch->lt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, 0);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, 0);
+		matrix_scale(&t, ninepatch->__sx, 1);
+		surface_blit(s, clip, &t, ninepatch->mt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rt)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rt, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, 0);
+		surface_blit(s, clip, &t, ninepatch->rt, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->lm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, ninepatch->top);
+		matrix_scale(&t, 1, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->lm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->top);
-		matrix_scale(&m, ninepatch->__sx, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, ninepatch->top);
+		matrix_scale(&t, ninepatch->__sx, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->mm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rm)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rm, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, ninepatch->top);
+		matrix_scale(&t, 1, ninepatch->__sy);
+		surface_blit(s, clip, &t, ninepatch->rm, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->lb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, 0, ninepatch->__h - ninepatch->bottom);
+		surface_blit(s, clip, &t, ninepatch->lb, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->mb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->__h - ninepatch->bottom);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->left, ninepatch->__h - ninepatch->bottom);
+		matrix_scale(&t, ninepatch->__sx, 1);
+		surface_blit(s, clip, &t, ninepatch->mb, RENDER_TYPE_FAST);
 	}
 	if(ninepatch->rb)
 	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rb, RENDER_TYPE_FAST);
+		memcpy(&t, m, sizeof(struct matrix_t));
+		matrix_translate(&t, ninepatch->__w - ninepatch->right, ninepatch->__h - ninepatch->bottom);
+		surface_blit(s, clip, &t, ninepatch->rb, RENDER_TYPE_FAST);
 	}
 }
 
-static void dobject_draw_text(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_text(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m)
 {
 	struct ltext_t * text = o->priv;
-	surface_text(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), &text->txt);
+	surface_text(s, clip, m, &text->txt);
 }
 
-static void dobject_draw_icon(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_icon(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m)
 {
 	struct licon_t * icon = o->priv;
-	surface_icon(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), &icon->ico);
+	surface_icon(s, clip, m, &icon->ico);
 }
 
-static void dobject_draw_container(struct ldobject_t * o, struct window_t * w)
+static void dobject_draw_container(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m)
 {
 	if(o->bgcolor.a != 0)
-		surface_fill(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
+		surface_fill(s, clip, m, o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
 }
 
 static int l_dobject_new(lua_State * L)
 {
 	enum dobject_type_t dtype;
-	void (*draw)(struct ldobject_t *, struct window_t *);
+	void (*draw)(struct ldobject_t *, struct surface_t *, struct region_t *, struct matrix_t *);
 	void * userdata;
 	double width = luaL_optnumber(L, 1, 0);
 	double height = luaL_optnumber(L, 2, 0);
@@ -943,11 +1050,19 @@ static int l_dobject_new(lua_State * L)
 	o->ctype = COLLIDER_TYPE_NONE;
 	o->visible = 1;
 	o->touchable = 1;
-	o->mflag = 0;
+	o->mflag = MFLAG_LAYOUT;
+	o->emask = 0;
+	o->pmask = 0;
+	o->smask = 0;
+	o->spmask = 0;
 	matrix_init_identity(&o->local_matrix);
 	matrix_init_identity(&o->global_matrix);
 	region_init(&o->global_bounds, o->x, o->y, o->width, o->height);
 	region_init(&o->dirty_bounds, o->x, o->y, o->width, o->height);
+	region_init(&o->subtree_bounds, o->x, o->y, o->width, o->height);
+	o->cache.enable = 0;
+	o->cache.valid = 0;
+	o->cache.s = NULL;
 	o->dtype = dtype;
 	o->draw = draw;
 	o->priv = userdata;
@@ -973,6 +1088,17 @@ static int m_dobject_gc(lua_State * L)
 			o->hit.polygon.length = 0;
 		}
 	}
+	if(o->cache.s)
+	{
+		surface_free(o->cache.s);
+		o->cache.s = NULL;
+	}
+	if(lua_getfield(L, LUA_REGISTRYINDEX, MT_DOBJECT_OWNER) == LUA_TTABLE)
+	{
+		lua_pushnil(L);
+		lua_rawsetp(L, -2, o);
+	}
+	lua_pop(L, 1);
 	return 0;
 }
 
@@ -980,13 +1106,16 @@ static int m_add_child(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	struct ldobject_t * c = luaL_checkudata(L, 2, MT_DOBJECT);
-	if(c->parent != o)
+	struct ldobject_t * p = c->parent;
+	if(p != o)
 	{
-		if(c->parent)
+		if(p)
 		{
 			dobject_mark_dirty(c);
+			list_del(&c->entry);
 			c->parent = o;
 			list_add_tail(&c->entry, &o->children);
+			dobject_update_smask(p);
 		}
 		else
 		{
@@ -996,6 +1125,8 @@ static int m_add_child(lua_State * L)
 			dobject_mark_dirty(c);
 		}
 		dobject_mark_children(c, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout(o);
+		dobject_update_smask(o);
 	}
 	return 0;
 }
@@ -1022,6 +1153,8 @@ static int m_remove_child(lua_State * L)
 		c->parent = NULL;
 		list_del_init(&c->entry);
 		dobject_mark_children(c, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout(o);
+		dobject_update_smask(o);
 	}
 	return 0;
 }
@@ -1032,6 +1165,7 @@ static int m_to_front(lua_State * L)
 	if(o->parent && !list_is_last(&o->entry, &o->parent->children))
 	{
 		dobject_mark_dirty(o);
+		dobject_mark_layout_item(o);
 		list_move_tail(&o->entry, &o->parent->children);
 	}
 	return 0;
@@ -1043,6 +1177,7 @@ static int m_to_back(lua_State * L)
 	if(o->parent && !list_is_first(&o->entry, &o->parent->children))
 	{
 		dobject_mark_dirty(o);
+		dobject_mark_layout_item(o);
 		list_move(&o->entry, &o->parent->children);
 	}
 	return 0;
@@ -1059,6 +1194,8 @@ static int m_set_width(lua_State * L)
 		o->layout.width = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout(o);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1081,6 +1218,8 @@ static int m_set_height(lua_State * L)
 		o->layout.height = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout(o);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1106,6 +1245,8 @@ static int m_set_size(lua_State * L)
 		o->layout.height = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout(o);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1132,6 +1273,7 @@ static int m_set_x(lua_State * L)
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1157,6 +1299,7 @@ static int m_set_y(lua_State * L)
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1184,6 +1327,7 @@ static int m_set_position(lua_State * L)
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1210,6 +1354,7 @@ static int m_set_rotation(lua_State * L)
 			o->mflag |= MFLAG_ROTATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1235,6 +1380,7 @@ static int m_set_scale_x(lua_State * L)
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1260,6 +1406,7 @@ static int m_set_scale_y(lua_State * L)
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1287,6 +1434,7 @@ static int m_set_scale(lua_State * L)
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1313,6 +1461,7 @@ static int m_set_skew_x(lua_State * L)
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1338,6 +1487,7 @@ static int m_set_skew_y(lua_State * L)
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1365,6 +1515,7 @@ static int m_set_skew(lua_State * L)
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1393,6 +1544,7 @@ static int m_set_archor(lua_State * L)
 			o->mflag |= MFLAG_ANCHOR;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
 		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_layout_item(o);
 	}
 	return 0;
 }
@@ -1430,6 +1582,8 @@ static int m_set_layout_enable(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	dobject_layout_set_enable(o, lua_toboolean(L, 2));
+	if(o->parent)
+		dobject_mark_layout(o->parent);
 	return 0;
 }
 
@@ -1444,6 +1598,7 @@ static int m_set_layout_special(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	dobject_layout_set_special(o, lua_toboolean(L, 2));
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1475,6 +1630,7 @@ static int m_set_layout_direction(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1529,6 +1685,7 @@ static int m_set_layout_justify(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1583,6 +1740,7 @@ static int m_set_layout_align(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1634,6 +1792,7 @@ static int m_set_layout_align_self(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1668,6 +1827,7 @@ static int m_set_layout_grow(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.grow = luaL_checknumber(L, 2);
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1682,6 +1842,7 @@ static int m_set_layout_shrink(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.shrink = luaL_checknumber(L, 2);
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1696,6 +1857,7 @@ static int m_set_layout_basis(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.basis = luaL_checknumber(L, 2);
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1713,6 +1875,7 @@ static int m_set_layout_margin(lua_State * L)
 	o->layout.margin.top = luaL_optnumber(L, 3, 0);
 	o->layout.margin.right = luaL_optnumber(L, 4, 0);
 	o->layout.margin.bottom = luaL_optnumber(L, 5, 0);
+	dobject_mark_layout_item(o);
 	return 0;
 }
 
@@ -1878,6 +2041,30 @@ static int m_set_touchable(lua_State * L)
 	return 0;
 }
 
+static int m_set_cache_as_bitmap(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	int enable = lua_toboolean(L, 2);
+	if(o->cache.enable != enable)
+	{
+		o->cache.enable = enable;
+		o->cache.valid = 0;
+		if(!enable && o->cache.s)
+		{
+			surface_free(o->cache.s);
+			o->cache.s = NULL;
+		}
+	}
+	return 0;
+}
+
+static int m_get_cache_as_bitmap(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	lua_pushboolean(L, o->cache.enable);
+	return 1;
+}
+
 static int m_get_touchable(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
@@ -2008,14 +2195,12 @@ static inline int polygon_hit_test_point(struct ldobject_t * o, double x, double
 	return c;
 }
 
-static int m_hit_test_point(lua_State * L)
+static int dobject_hit_test_point(struct ldobject_t * o, double x, double y)
 {
-	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	int hit = 0;
 	if(o->visible && o->touchable)
 	{
-		double nx, x = luaL_checknumber(L, 2);
-		double ny, y = luaL_checknumber(L, 3);
+		double nx, ny;
 		struct matrix_t * m = dobject_global_matrix(o);
 		double id = 1.0 / (m->a * m->d - m->c * m->b);
 		nx = ((x - m->tx) * m->d + (m->ty - y) * m->c) * id;
@@ -2045,10 +2230,207 @@ static int m_hit_test_point(lua_State * L)
 			break;
 		}
 	}
-	lua_pushboolean(L, hit);
+	return hit;
+}
+
+static int m_hit_test_point(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	double x = luaL_checknumber(L, 2);
+	double y = luaL_checknumber(L, 3);
+	lua_pushboolean(L, dobject_hit_test_point(o, x, y));
 	return 1;
 }
 
+/*
+ * Topmost visible and touchable object under the point, children are tested in reverse z order
+ */
+static struct ldobject_t * dobject_hit_test(struct ldobject_t * o, double x, double y)
+{
+	struct ldobject_t * pos, * t;
+
+	if(!o->visible)
+		return NULL;
+	list_for_each_entry_reverse(pos, &o->children, entry)
+	{
+		if((t = dobject_hit_test(pos, x, y)))
+			return t;
+	}
+	if(dobject_hit_test_point(o, x, y))
+		return o;
+	return NULL;
+}
+
+static int dobject_push_owner(lua_State * L, struct ldobject_t * o)
+{
+	if(lua_getfield(L, LUA_REGISTRYINDEX, MT_DOBJECT_OWNER) == LUA_TTABLE)
+	{
+		lua_rawgetp(L, -1, o);
+		lua_remove(L, -2);
+	}
+	return !lua_isnil(L, -1);
+}
+
+static int dobject_event_stopped(lua_State * L, int event)
+{
+	int stop;
+
+	lua_getfield(L, event, "stop");
+	stop = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	return stop;
+}
+
+static void dobject_call_listener(lua_State * L, int owner, int event)
+{
+	lua_getfield(L, owner, "dispatchEvent");
+	lua_pushvalue(L, owner);
+	lua_pushvalue(L, event);
+	lua_call(L, 2, 0);
+}
+
+/*
+ * Broadcast to every listener in the subtree, skipping subtrees without one. Children
+ * are visited topmost first and anchored by their owners, so listeners may edit the tree.
+ */
+static int dobject_dispatch_broadcast(lua_State * L, struct ldobject_t * o, uint32_t bit, int event)
+{
+	struct ldobject_t * pos;
+	int top = lua_gettop(L);
+	int n = 0, i;
+
+	if(o->emask & bit)
+	{
+		if(dobject_push_owner(L, o))
+			dobject_call_listener(L, top + 1, event);
+		lua_settop(L, top);
+		if(dobject_event_stopped(L, event))
+			return 0;
+	}
+	list_for_each_entry_reverse(pos, &o->children, entry)
+	{
+		if(pos->smask & bit)
+		{
+			luaL_checkstack(L, 3, NULL);
+			lua_pushlightuserdata(L, pos);
+			if(dobject_push_owner(L, pos))
+				n++;
+			else
+				lua_pop(L, 2);
+		}
+	}
+	for(i = 0; i < n; i++)
+	{
+		if(!dobject_dispatch_broadcast(L, lua_touserdata(L, top + i * 2 + 1), bit, event))
+		{
+			lua_settop(L, top);
+			return 0;
+		}
+	}
+	lua_settop(L, top);
+	return 1;
+}
+
+static int m_set_owner(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	if(lua_getfield(L, LUA_REGISTRYINDEX, MT_DOBJECT_OWNER) != LUA_TTABLE)
+	{
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_newtable(L);
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, MT_DOBJECT_OWNER);
+	}
+	lua_pushvalue(L, 2);
+	lua_rawsetp(L, -2, o);
+	lua_pop(L, 1);
+	return 0;
+}
+
+static int m_set_event_listening(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	uint32_t bit = dobject_event_bit(luaL_checkstring(L, 2));
+	int broadcast = lua_toboolean(L, 3);
+	int phased = lua_toboolean(L, 4);
+	if(broadcast)
+		o->emask |= bit;
+	else if(bit != DOBJECT_EVENT_OTHER)
+		o->emask &= ~bit;
+	if(phased)
+		o->pmask |= bit;
+	else if(bit != DOBJECT_EVENT_OTHER)
+		o->pmask &= ~bit;
+	dobject_update_smask(o);
+	return 0;
+}
+
+/*
+ * Pointer events are first routed to the topmost object under the pointer, in a capture
+ * phase from the root down and a bubble phase back up, then broadcast as before. The hit
+ * test is skipped when no object in the tree has a phased listener for the event type.
+ */
+static int m_dispatch(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	struct ldobject_t * t, * p;
+	uint32_t bit;
+	int top, n, i;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_getfield(L, 2, "type");
+	bit = dobject_event_bit(lua_tostring(L, -1));
+	lua_pop(L, 1);
+	lua_settop(L, 2);
+	top = lua_gettop(L);
+
+	if((bit & DOBJECT_EVENT_POINTER) && (o->spmask & bit))
+	{
+		lua_getfield(L, 2, "x");
+		lua_getfield(L, 2, "y");
+		if(lua_isnumber(L, -2) && lua_isnumber(L, -1) && (t = dobject_hit_test(o, lua_tonumber(L, -2), lua_tonumber(L, -1))))
+		{
+			lua_settop(L, top);
+			if(dobject_push_owner(L, t))
+				lua_setfield(L, 2, "target");
+			else
+				lua_pop(L, 1);
+			for(p = t, n = 0; p; p = (p == o) ? NULL : p->parent)
+			{
+				if(p->pmask & bit)
+				{
+					luaL_checkstack(L, 2, NULL);
+					if(dobject_push_owner(L, p))
+						n++;
+					else
+						lua_pop(L, 1);
+				}
+			}
+			if(n > 0)
+			{
+				lua_pushstring(L, "capture");
+				lua_setfield(L, 2, "phase");
+				for(i = n; (i > 0) && !dobject_event_stopped(L, 2); i--)
+					dobject_call_listener(L, top + i, 2);
+				lua_pushstring(L, "bubble");
+				lua_setfield(L, 2, "phase");
+				for(i = 1; (i <= n) && !dobject_event_stopped(L, 2); i++)
+					dobject_call_listener(L, top + i, 2);
+				lua_pushnil(L);
+				lua_setfield(L, 2, "phase");
+			}
+		}
+		lua_settop(L, top);
+	}
+	if(!dobject_event_stopped(L, 2))
+		dobject_dispatch_broadcast(L, o, bit, 2);
+	return 0;
+}
+
 static int m_mark_dirty(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
@@ -2067,8 +2449,13 @@ static int m_get_bounds(lua_State * L)
 	return 4;
 }
 
+/*
+ * Collect the damage and, on the same walk, the bounds of every visible
+ * subtree, which the draw pass uses to skip subtrees missing a damage rect
+ */
 static void window_region_list_fill(struct window_t * w, struct ldobject_t * o)
 {
+	struct region_t * sb = &o->subtree_bounds;
 	struct ldobject_t * pos;
 
 	if(o->mflag & MFLAG_DIRTY)
@@ -2077,27 +2464,144 @@ static void window_region_list_fill(struct window_t * w, struct ldobject_t * o)
 		window_region_list_add(w, dobject_dirty_bounds(o));
 		o->mflag &= ~MFLAG_DIRTY;
 	}
+	region_clone(sb, dobject_global_bounds(o));
 
 	list_for_each_entry(pos, &o->children, entry)
 	{
 		window_region_list_fill(w, pos);
+		if(pos->visible)
+			region_union(sb, sb, &pos->subtree_bounds);
 	}
 }
 
-static void display_draw(struct window_t * w, struct ldobject_t * o)
+static inline int dobject_clip(struct region_t * r, struct region_t * a, struct region_t * b)
 {
+	return (region_intersect(r, a, b) && (r->w > 0) && (r->h > 0));
+}
+
+static void dobject_draw_tree(struct ldobject_t * o, struct surface_t * s, struct region_t * r, int ox, int oy);
+
+/*
+ * A cached object renders itself and its subtree, limited to its own
+ * bounds, into an offscreen surface. The surface stays valid until
+ * something below marks itself dirty or the shape of the global matrix
+ * changes, integer moves just blit it somewhere else.
+ */
+static struct surface_t * dobject_cache_surface(struct ldobject_t * o)
+{
+	struct region_t * b = dobject_global_bounds(o);
 	struct ldobject_t * pos;
+	struct region_t r;
+	struct matrix_t m;
+
+	memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
+	m.tx -= b->x;
+	m.ty -= b->y;
+	if(o->cache.s && o->cache.valid && (surface_get_width(o->cache.s) == b->w) && (surface_get_height(o->cache.s) == b->h) && (memcmp(&m, &o->cache.matrix, sizeof(struct matrix_t)) == 0))
+		return o->cache.s;
+
+	if(o->cache.s && ((surface_get_width(o->cache.s) != b->w) || (surface_get_height(o->cache.s) != b->h)))
+	{
+		surface_free(o->cache.s);
+		o->cache.s = NULL;
+	}
+	if(!o->cache.s)
+	{
+		o->cache.s = surface_alloc(b->w, b->h, NULL);
+		if(!o->cache.s)
+			return NULL;
+	}
+	else
+	{
+		surface_clear(o->cache.s, NULL, 0, 0, 0, 0);
+	}
+	region_init(&r, 0, 0, b->w, b->h);
+	o->draw(o, o->cache.s, &r, &m);
+	list_for_each_entry(pos, &o->children, entry)
+	{
+		dobject_draw_tree(pos, o->cache.s, &r, b->x, b->y);
+	}
+	memcpy(&o->cache.matrix, &m, sizeof(struct matrix_t));
+	o->cache.valid = 1;
+	return o->cache.s;
+}
+
+/*
+ * Draw a subtree into the damage rectangle r, given in the coordinates of
+ * the target surface whose origin sits at (ox, oy) in global space. Each
+ * object is clipped to its parent bounds as before, and only issues its
+ * draw call when that clip touches r. Children are clipped to their own
+ * parent and may overflow an ancestor, so a subtree is skipped as a whole
+ * only when its subtree bounds miss r.
+ */
+static void dobject_draw_tree(struct ldobject_t * o, struct surface_t * s, struct region_t * r, int ox, int oy)
+{
+	struct ldobject_t * pos;
+	struct surface_t * cs;
+	struct region_t clip, b;
+	struct matrix_t m;
+	int draw;
 
 	if(o->visible)
 	{
-		o->draw(o, w);
+		region_clone(&b, &o->subtree_bounds);
+		b.x -= ox;
+		b.y -= oy;
+		if(!dobject_clip(&clip, r, &b))
+			return;
+		if(o->parent)
+		{
+			region_clone(&b, dobject_global_bounds(o->parent));
+			b.x -= ox;
+			b.y -= oy;
+			draw = dobject_clip(&clip, r, &b);
+		}
+		else
+		{
+			region_clone(&clip, r);
+			draw = 1;
+		}
+		if(draw)
+		{
+			region_clone(&b, dobject_global_bounds(o));
+			b.x -= ox;
+			b.y -= oy;
+			draw = region_intersect(&b, &b, &clip);
+		}
+		if(o->cache.enable)
+		{
+			if(!draw)
+				return;
+			if((cs = dobject_cache_surface(o)))
+			{
+				matrix_init_translate(&m, dobject_global_bounds(o)->x - ox, dobject_global_bounds(o)->y - oy);
+				surface_blit(s, &clip, &m, cs, RENDER_TYPE_FAST);
+				return;
+			}
+		}
+		if(draw)
+		{
+			memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
+			m.tx -= ox;
+			m.ty -= oy;
+			o->draw(o, s, &clip, &m);
+		}
 		list_for_each_entry(pos, &o->children, entry)
 		{
-			display_draw(w, pos);
+			dobject_draw_tree(pos, s, r, ox, oy);
 		}
 	}
 }
 
+static void display_draw(struct window_t * w, struct ldobject_t * o)
+{
+	struct region_list_t * rl = w->rl;
+	int i;
+
+	for(i = 0; i < rl->count; i++)
+		dobject_draw_tree(o, w->s, &rl->region[i], 0, 0);
+}
+
 static int m_render(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
@@ -2107,7 +2611,8 @@ static int m_render(lua_State * L)
 		dobject_layout(o);
 		window_region_list_clear(w);
 		window_region_list_fill(w, o);
-		window_present(w, o, (void (*)(struct window_t *, void *))display_draw);
+		if(window_is_dirty(w))
+			window_present(w, o, (void (*)(struct window_t *, void *))display_draw);
 	}
 	return 0;
 }
@@ -2174,9 +2679,14 @@ static const luaL_Reg m_dobject[] = {
 	{"getVisible",			m_get_visible},
 	{"setTouchable",		m_set_touchable},
 	{"getTouchable",		m_get_touchable},
+	{"setCacheAsBitmap",	m_set_cache_as_bitmap},
+	{"getCacheAsBitmap",	m_get_cache_as_bitmap},
 	{"globalToLocal",		m_global_to_local},
 	{"localToGlobal",		m_local_to_global},
 	{"hitTestPoint",		m_hit_test_point},
+	{"setOwner",			m_set_owner},
+	{"setEventListening",	m_set_event_listening},
+	{"dispatch",			m_dispatch},
 	{"markDirty",			m_mark_dirty},
 	{"getBounds",			m_get_bounds},
 	{"render",				m_render},
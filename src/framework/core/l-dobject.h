@@ -98,12 +98,24 @@ struct ldobject_t {
 	int visible;
 	int touchable;
 	int mflag;
+	uint32_t emask;
+	uint32_t pmask;
+	uint32_t smask;
+	uint32_t spmask;
 	struct matrix_t local_matrix;
 	struct matrix_t global_matrix;
 	struct region_t global_bounds;
 	struct region_t dirty_bounds;
+	struct region_t subtree_bounds;
 
-	void (*draw)(struct ldobject_t * o, struct window_t * w);
+	struct {
+		int enable;
+		int valid;
+		struct matrix_t matrix;
+		struct surface_t * s;
+	} cache;
+
+	void (*draw)(struct ldobject_t * o, struct surface_t * s, struct region_t * clip, struct matrix_t * m);
 	void * priv;
 };
 
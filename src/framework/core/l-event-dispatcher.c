@@ -36,7 +36,7 @@ function M:init()
 	self._elms = {}
 end
 
-function M:hasEventListener(type, listener, data)
+function M:hasEventListener(type, listener, data, phase)
 	local data = data or self
 	local elm = self._elms[type]
 
@@ -45,7 +45,7 @@ function M:hasEventListener(type, listener, data)
 	end
 
 	for i, v in ipairs(elm) do
-		if v.listener == listener and v.data == data then
+		if v.listener == listener and v.data == data and v.phase == phase then
 			return true
 		end
 	end
@@ -53,10 +53,10 @@ function M:hasEventListener(type, listener, data)
 	return false
 end
 
-function M:addEventListener(type, listener, data)
+function M:addEventListener(type, listener, data, phase)
 	local data = data or self
 
-	if self:hasEventListener(type, listener, data) then
+	if self:hasEventListener(type, listener, data, phase) then
 		return self
 	end
 
@@ -65,13 +65,13 @@ function M:addEventListener(type, listener, data)
 	end
 
 	local elm = self._elms[type]
-	local el = {type = type, listener = listener, data = data}
+	local el = {type = type, listener = listener, data = data, phase = phase}
 	table.insert(elm, el)
 
 	return self
 end
 
-function M:removeEventListener(type, listener, data)
+function M:removeEventListener(type, listener, data, phase)
 	local data = data or self
 	local elm = self._elms[type]
 
@@ -80,7 +80,7 @@ function M:removeEventListener(type, listener, data)
 	end
 
 	for i, v in ipairs(elm) do
-		if v.type == type and v.listener == listener and v.data == data then
+		if v.type == type and v.listener == listener and v.data == data and v.phase == phase then
 			table.remove(elm, i)
 			break
 		end
@@ -101,7 +101,7 @@ function M:dispatchEvent(event)
 	end
 
 	for i, v in ipairs(elm) do
-		if v.type == event.type then
+		if v.type == event.type and v.phase == event.phase then
 			v.listener(v.data, event)
 		end
 	end
@@ -114,7 +114,7 @@ return M
 
 int luaopen_event_dispatcher(lua_State * L)
 {
-	if(luaL_loadbuffer(L, event_dispatcher_lua, sizeof(event_dispatcher_lua) - 1, "EventDispatcher.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, event_dispatcher_lua, sizeof(event_dispatcher_lua) - 1, "EventDispatcher.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
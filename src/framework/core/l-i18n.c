@@ -62,7 +62,7 @@ return M
 
 int luaopen_i18n(lua_State * L)
 {
-	if(luaL_loadbuffer(L, i18n_lua, sizeof(i18n_lua) - 1, "I18n.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, i18n_lua, sizeof(i18n_lua) - 1, "I18n.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
@@ -57,7 +57,7 @@ end
 
 int luaopen_printr(lua_State * L)
 {
-	if(luaL_loadbuffer(L, printr_lua, sizeof(printr_lua) - 1, "Printr.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, printr_lua, sizeof(printr_lua) - 1, "Printr.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
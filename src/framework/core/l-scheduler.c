@@ -0,0 +1,385 @@
+/*
+ * framework/core/l-scheduler.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <core/l-scheduler.h>
+
+#define	MT_SCHEDULER		"__mt_scheduler__"
+
+/*
+ * Hierarchical timer wheel with one millisecond ticks, four levels of sixty
+ * four slots cover about 4.6 hours, longer delays wait in the last level.
+ */
+#define WHEEL_BITS		(6)
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	(4)
+
+struct wheel_timer_t {
+	struct list_head entry;
+	uint64_t expire;
+	int ref;
+};
+
+struct wheel_t {
+	struct list_head wheel[WHEEL_LEVELS][WHEEL_SIZE];
+	struct list_head expired;
+	struct wheel_timer_t * firing;
+	uint64_t now;
+	int count;
+};
+
+static inline uint64_t scheduler_ticks(void)
+{
+	return (uint64_t)ktime_to_ms(ktime_get());
+}
+
+/*
+ * Delays beyond the wheel range keep their true expiry and are parked in the
+ * farthest slot of the last level, its cascade inserts them again.
+ */
+static void scheduler_insert(struct wheel_t * s, struct wheel_timer_t * t)
+{
+	uint64_t delta, slot;
+	int level;
+
+	if(t->expire < s->now)
+		t->expire = s->now;
+	delta = t->expire - s->now;
+	for(level = 0; level < WHEEL_LEVELS - 1; level++)
+	{
+		if(delta < ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+	if(delta >= ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+		slot = s->now + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	else
+		slot = t->expire;
+	list_add_tail(&t->entry, &s->wheel[level][(slot >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+}
+
+static void scheduler_cascade(struct wheel_t * s, int level)
+{
+	struct wheel_timer_t * pos, * n;
+	struct list_head list;
+	int idx = (s->now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+	if((idx == 0) && (level + 1 < WHEEL_LEVELS))
+		scheduler_cascade(s, level + 1);
+	list_replace_init(&s->wheel[level][idx], &list);
+	list_for_each_entry_safe(pos, n, &list, entry)
+	{
+		list_del(&pos->entry);
+		scheduler_insert(s, pos);
+	}
+}
+
+/*
+ * Move the wheel forward to the current tick, due timers are collected on the expired list
+ */
+static void scheduler_advance(struct wheel_t * s)
+{
+	uint64_t ticks = scheduler_ticks();
+
+	if(s->count <= 0)
+	{
+		if(ticks > s->now)
+			s->now = ticks;
+		return;
+	}
+	while(s->now < ticks)
+	{
+		s->now++;
+		if((s->now & WHEEL_MASK) == 0)
+			scheduler_cascade(s, 1);
+		list_splice_tail_init(&s->wheel[0][s->now & WHEEL_MASK], &s->expired);
+	}
+}
+
+/*
+ * The first user value maps timer tables to their wheel entries, the second
+ * one holds the references the entries use to find their timer table again.
+ */
+static struct wheel_timer_t * scheduler_lookup(lua_State * L, int idx)
+{
+	struct wheel_timer_t * t;
+
+	lua_getiuservalue(L, 1, 1);
+	lua_pushvalue(L, idx);
+	lua_rawget(L, -2);
+	t = lua_touserdata(L, -1);
+	lua_pop(L, 2);
+	return t;
+}
+
+static void scheduler_unlink(lua_State * L, struct wheel_t * s, struct wheel_timer_t * t)
+{
+	lua_getiuservalue(L, 1, 2);
+	lua_rawgeti(L, -1, t->ref);
+	lua_getiuservalue(L, 1, 1);
+	lua_insert(L, -2);
+	lua_pushnil(L);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	luaL_unref(L, -1, t->ref);
+	lua_pop(L, 1);
+	if(!list_empty(&t->entry))
+		list_del_init(&t->entry);
+	s->count--;
+	free(t);
+}
+
+static uint64_t scheduler_delay(lua_State * L, int idx)
+{
+	lua_Number delay;
+
+	lua_getfield(L, idx, "_delay");
+	delay = lua_tonumber(L, -1);
+	lua_pop(L, 1);
+	return (delay > 0.001) ? (uint64_t)(delay * 1000 + 0.5) : 1;
+}
+
+static int l_scheduler_new(lua_State * L)
+{
+	struct wheel_t * s = lua_newuserdatauv(L, sizeof(struct wheel_t), 2);
+	int i, j;
+
+	for(i = 0; i < WHEEL_LEVELS; i++)
+	{
+		for(j = 0; j < WHEEL_SIZE; j++)
+			init_list_head(&s->wheel[i][j]);
+	}
+	init_list_head(&s->expired);
+	s->now = scheduler_ticks();
+	s->count = 0;
+	lua_newtable(L);
+	lua_setiuservalue(L, -2, 1);
+	lua_newtable(L);
+	lua_setiuservalue(L, -2, 2);
+	luaL_setmetatable(L, MT_SCHEDULER);
+	return 1;
+}
+
+static const luaL_Reg l_scheduler[] = {
+	{"new",	l_scheduler_new},
+	{NULL,	NULL}
+};
+
+static int m_scheduler_gc(lua_State * L)
+{
+	struct wheel_t * s = luaL_checkudata(L, 1, MT_SCHEDULER);
+
+	lua_getiuservalue(L, 1, 1);
+	lua_pushnil(L);
+	while(lua_next(L, -2))
+	{
+		free(lua_touserdata(L, -1));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+	s->count = 0;
+	return 0;
+}
+
+static int m_scheduler_has(lua_State * L)
+{
+	luaL_checkudata(L, 1, MT_SCHEDULER);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_pushboolean(L, scheduler_lookup(L, 2) ? 1 : 0);
+	return 1;
+}
+
+static int m_scheduler_add(lua_State * L)
+{
+	struct wheel_t * s = luaL_checkudata(L, 1, MT_SCHEDULER);
+	struct wheel_timer_t * t;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	if(scheduler_lookup(L, 2) || !(t = malloc(sizeof(struct wheel_timer_t))))
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	lua_getiuservalue(L, 1, 2);
+	lua_pushvalue(L, 2);
+	t->ref = luaL_ref(L, -2);
+	lua_pop(L, 1);
+	lua_getiuservalue(L, 1, 1);
+	lua_pushvalue(L, 2);
+	lua_pushlightuserdata(L, t);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+	scheduler_advance(s);
+	t->expire = s->now + scheduler_delay(L, 2);
+	scheduler_insert(s, t);
+	s->count++;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int m_scheduler_remove(lua_State * L)
+{
+	struct wheel_t * s = luaL_checkudata(L, 1, MT_SCHEDULER);
+	struct wheel_timer_t * t;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	if(!(t = scheduler_lookup(L, 2)))
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if(t == s->firing)
+		s->firing = NULL;
+	scheduler_unlink(L, s, t);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ * Fire every due timer. The listener may add or remove timers, including
+ * its own one, so each timer is taken off the expired list before it runs.
+ * A failing listener still has its timer re-armed or removed, the first
+ * error is raised once every due timer has run.
+ */
+static int m_scheduler_schedule(lua_State * L)
+{
+	struct wheel_t * s = luaL_checkudata(L, 1, MT_SCHEDULER);
+	struct wheel_timer_t * t;
+	lua_Integer count, iteration;
+	uint64_t delay;
+	int base, err = 0;
+
+	scheduler_advance(s);
+	lua_getiuservalue(L, 1, 2);
+	base = lua_gettop(L);
+	while(!list_empty(&s->expired))
+	{
+		t = list_first_entry(&s->expired, struct wheel_timer_t, entry);
+		list_del_init(&t->entry);
+		lua_rawgeti(L, -1, t->ref);
+		delay = scheduler_delay(L, -1);
+		if(lua_getfield(L, -1, "_running") && lua_toboolean(L, -1))
+		{
+			lua_getfield(L, -2, "_runcount");
+			count = lua_tointeger(L, -1) + 1;
+			lua_pop(L, 1);
+			lua_pushinteger(L, count);
+			lua_setfield(L, -3, "_runcount");
+			lua_pushinteger(L, 0);
+			lua_setfield(L, -3, "_runtime");
+			lua_getfield(L, -2, "_iteration");
+			iteration = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			s->firing = t;
+			lua_getfield(L, -2, "_listener");
+			lua_pushvalue(L, -3);
+			if(lua_pcall(L, 1, 0, 0) != LUA_OK)
+			{
+				if(err++ == 0)
+					lua_insert(L, base);
+				else
+					lua_pop(L, 1);
+			}
+			if(s->firing != t)
+			{
+				lua_pop(L, 2);
+				continue;
+			}
+			s->firing = NULL;
+			if((iteration != 0) && (count >= iteration))
+			{
+				lua_pop(L, 1);
+				lua_pushboolean(L, 0);
+				lua_setfield(L, -2, "_running");
+				lua_pushcfunction(L, m_scheduler_remove);
+				lua_pushvalue(L, 1);
+				lua_pushvalue(L, -3);
+				lua_call(L, 2, 0);
+				lua_pop(L, 1);
+				continue;
+			}
+		}
+		lua_pop(L, 2);
+		t->expire += delay;
+		if(t->expire <= s->now)
+			t->expire = s->now + delay;
+		scheduler_insert(s, t);
+	}
+	lua_pop(L, 1);
+	if(err)
+		return lua_error(L);
+	return 0;
+}
+
+/*
+ * Seconds until the next timer may be due, capped at one second. Slots in
+ * the upper levels only give a lower bound, an early wake up just cascades.
+ */
+static int m_scheduler_idle(lua_State * L)
+{
+	struct wheel_t * s = luaL_checkudata(L, 1, MT_SCHEDULER);
+	uint64_t next = 1000, delta, base;
+	int level, i, idx;
+
+	scheduler_advance(s);
+	if(!list_empty(&s->expired))
+		next = 0;
+	for(level = 0; (level < WHEEL_LEVELS) && (next > 0); level++)
+	{
+		base = s->now >> (WHEEL_BITS * level);
+		for(i = 1; i <= WHEEL_SIZE; i++)
+		{
+			idx = (base + i) & WHEEL_MASK;
+			if(!list_empty(&s->wheel[level][idx]))
+			{
+				delta = ((base + i) << (WHEEL_BITS * level)) - s->now;
+				if(delta < next)
+					next = delta;
+				break;
+			}
+		}
+	}
+	lua_pushnumber(L, (lua_Number)next / 1000);
+	return 1;
+}
+
+static const luaL_Reg m_scheduler[] = {
+	{"__gc",		m_scheduler_gc},
+	{"has",			m_scheduler_has},
+	{"add",			m_scheduler_add},
+	{"remove",		m_scheduler_remove},
+	{"schedule",	m_scheduler_schedule},
+	{"idle",		m_scheduler_idle},
+	{NULL,			NULL}
+};
+
+int luaopen_scheduler(lua_State * L)
+{
+	luaL_newlib(L, l_scheduler);
+	luahelper_create_metatable(L, MT_SCHEDULER, m_scheduler);
+	return 1;
+}
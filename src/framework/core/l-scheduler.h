@@ -0,0 +1,16 @@
+#ifndef __FRAMEWORK_CORE_L_SCHEDULER_H__
+#define __FRAMEWORK_CORE_L_SCHEDULER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <luahelper.h>
+
+int luaopen_scheduler(lua_State * L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMEWORK_CORE_L_SCHEDULER_H__ */
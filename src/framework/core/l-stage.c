@@ -33,7 +33,7 @@ local M = Class(DisplayObject)
 
 function M:init()
 	self._running = true
-	self._timerlist = {}
+	self._scheduler = Scheduler.new()
 	self._window = Window.new()
 	self.super:init(self._window:getSize())
 	self:markDirty()
@@ -45,65 +45,33 @@ function M:exit()
 end
 
 function M:hasTimer(timer)
-	local tl = self._timerlist
-
-	if not tl or #tl == 0 then
-		return false
-	end
-
-	for i, v in ipairs(tl) do
-		if v == timer then
-			return true
-		end
-	end
-
-	return false
+	return self._scheduler:has(timer)
 end
 
 function M:addTimer(timer)
-	if self:hasTimer(timer) then
+	if self._scheduler:has(timer) then
 		return false
 	end
 
 	timer:start()
-	table.insert(self._timerlist, timer)
-	return true
+	return self._scheduler:add(timer)
 end
 
 function M:removeTimer(timer)
-	local tl = self._timerlist
-
-	if not tl or #tl == 0 then
-		return false
-	end
-
-	for i, v in ipairs(tl) do
-		if v == timer then
-			v:pause()
-			table.remove(tl, i)
-			return true
-		end
+	if self._scheduler:remove(timer) then
+		timer:pause()
+		return true
 	end
 
 	return false
 end
 
-function M:schedTimer(dt)
-	for i, v in ipairs(self._timerlist) do
-		if v._running then
-			v._runtime = v._runtime + dt
-
-			if v._runtime >= v._delay then
-				v._runcount = v._runcount + 1
-				v._listener(v)
-				v._runtime = 0
+function M:schedTimer()
+	self._scheduler:schedule()
+end
 
-				if v._iteration ~= 0 and v._runcount >= v._iteration then
-					self:removeTimer(v)
-				end
-			end
-		end
-	end
+function M:getIdleTime()
+	return self._scheduler:idle()
 end
 
 function M:getDotsPerInch()
@@ -131,7 +99,7 @@ end
 function M:loop()
 	local Event = Event
 	local window = self._window
-	local stopwatch = Stopwatch.new()
+	local scheduler = self._scheduler
 
 	self:addTimer(Timer.new(1 / 60, 0, function(t)
 		self:dispatch(Event.new("enter-frame"))
@@ -148,10 +116,10 @@ function M:loop()
 			self:dispatch(e)
 		end
 
-		local elapsed = stopwatch:elapsed()
-		if elapsed > 0 then
-			stopwatch:reset()
-			self:schedTimer(elapsed)
+		scheduler:schedule()
+
+		if e == nil then
+			window:wait(scheduler:idle())
 		end
 	end
 end
@@ -161,7 +129,7 @@ return M
 
 int luaopen_stage(lua_State * L)
 {
-	if(luaL_loadbuffer(L, stage_lua, sizeof(stage_lua) - 1, "Stage.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, stage_lua, sizeof(stage_lua) - 1, "Stage.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
@@ -57,7 +57,7 @@ return M
 
 int luaopen_timer(lua_State * L)
 {
-	if(luaL_loadbuffer(L, timer_lua, sizeof(timer_lua) - 1, "Timer.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, timer_lua, sizeof(timer_lua) - 1, "Timer.lua") == LUA_OK)
 		lua_call(L, 0, 1);
 	return 1;
 }
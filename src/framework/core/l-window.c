@@ -126,6 +126,14 @@ static int m_window_add_font(lua_State * L)
 	return 0;
 }
 
+static int m_window_wait(lua_State * L)
+{
+	struct window_t * w = luaL_checkudata(L, 1, MT_WINDOW);
+	lua_Number t = luaL_optnumber(L, 2, 0);
+	window_wait(w, (t > 0) ? (uint64_t)(t * (lua_Number)1000000000.0) : 0);
+	return 0;
+}
+
 static const luaL_Reg m_window[] = {
 	{"getSize",				m_window_get_size},
 	{"getPhysicalSize",		m_window_get_physical_size},
@@ -135,6 +143,7 @@ static const luaL_Reg m_window[] = {
 	{"toBack",				m_window_to_back},
 	{"snapshot",			m_window_snapshot},
 	{"addFont",				m_window_add_font},
+	{"wait",				m_window_wait},
 	{NULL, NULL}
 };
 
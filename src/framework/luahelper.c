@@ -232,3 +232,121 @@ int luahelper_pcall(lua_State * L, int narg, int nres)
 	lua_remove(L, base);
 	return status;
 }
+
+struct dump_data_t
+{
+	char * buf;
+	size_t len;
+	size_t size;
+};
+
+static int dump_writer(lua_State * L, const void * p, size_t sz, void * ud)
+{
+	struct dump_data_t * d = (struct dump_data_t *)ud;
+	size_t size;
+	char * buf;
+
+	if(d->len + sz > d->size)
+	{
+		size = max(d->size << 1, d->len + sz);
+		buf = realloc(d->buf, size);
+		if(!buf)
+			return 1;
+		d->buf = buf;
+		d->size = size;
+	}
+	memcpy(d->buf + d->len, p, sz);
+	d->len += sz;
+	return 0;
+}
+
+/*
+ * Dump the function on the top of stack as bytecode, leaving reserve bytes
+ * in front of it for the caller. The buffer must be released with free.
+ */
+void * luahelper_dump(lua_State * L, size_t reserve, size_t * len)
+{
+	struct dump_data_t d;
+
+	d.size = max(reserve, (size_t)SZ_4K);
+	d.buf = malloc(d.size);
+	d.len = reserve;
+	if(!d.buf)
+		return NULL;
+	if(lua_dump(L, dump_writer, &d, CONFIG_VM_BYTECODE_STRIP) != 0)
+	{
+		free(d.buf);
+		return NULL;
+	}
+	*len = d.len;
+	return d.buf;
+}
+
+#if (CONFIG_VM_BYTECODE_CACHE > 0)
+struct bytecode_t
+{
+	struct bytecode_t * next;
+	const char * key;
+	size_t len;
+	char data[0];
+};
+
+static struct bytecode_t * __bytecode_list = NULL;
+static spinlock_t __bytecode_lock = SPIN_LOCK_INIT();
+
+static struct bytecode_t * bytecode_search(const char * key)
+{
+	struct bytecode_t * bc;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__bytecode_lock, flags);
+	for(bc = __bytecode_list; bc; bc = bc->next)
+	{
+		if(bc->key == key)
+			break;
+	}
+	spin_unlock_irqrestore(&__bytecode_lock, flags);
+	return bc;
+}
+#endif
+
+/*
+ * Load a chunk embedded in the firmware. The buffer must be static, its
+ * address keys a bytecode cache shared by all vms, so each chunk is only
+ * parsed once per boot.
+ */
+int luahelper_loadbuffer(lua_State * L, const char * buf, size_t len, const char * name)
+{
+#if (CONFIG_VM_BYTECODE_CACHE > 0)
+	struct bytecode_t * bc, * pos;
+	irq_flags_t flags;
+	size_t l;
+	int status;
+
+	if((bc = bytecode_search(buf)))
+		return luaL_loadbufferx(L, bc->data, bc->len, name, "b");
+	status = luaL_loadbuffer(L, buf, len, name);
+	if((status == LUA_OK) && (bc = luahelper_dump(L, sizeof(struct bytecode_t), &l)))
+	{
+		bc->key = buf;
+		bc->len = l - sizeof(struct bytecode_t);
+		spin_lock_irqsave(&__bytecode_lock, flags);
+		for(pos = __bytecode_list; pos; pos = pos->next)
+		{
+			if(pos->key == buf)
+				break;
+		}
+		if(!pos)
+		{
+			bc->next = __bytecode_list;
+			__bytecode_list = bc;
+		}
+		spin_unlock_irqrestore(&__bytecode_lock, flags);
+		if(pos)
+			free(bc);
+	}
+	return status;
+#else
+	return luaL_loadbuffer(L, buf, len, name);
+#endif
+}
@@ -31,6 +31,8 @@ void luahelper_preload(lua_State * L, const char * name, lua_CFunction f);
 void luahelper_create_metatable(lua_State * L, const char * name, const luaL_Reg * funcs);
 void luahelper_create_class(lua_State * L, const char * parent, const luaL_Reg * funcs);
 int luahelper_pcall(lua_State * L, int narg, int nres);
+void * luahelper_dump(lua_State * L, size_t reserve, size_t * len);
+int luahelper_loadbuffer(lua_State * L, const char * buf, size_t len, const char * name);
 
 #ifdef __cplusplus
 }
@@ -26,6 +26,7 @@
  *
  */
 
+#include <crc32.h>
 #include <xfs/xfs.h>
 #include <luahelper.h>
 #include <core/l-application.h>
@@ -49,6 +50,7 @@
 #include <core/l-matrix.h>
 #include <core/l-ninepatch.h>
 #include <core/l-printr.h>
+#include <core/l-scheduler.h>
 #include <core/l-setting.h>
 #include <core/l-spring.h>
 #include <core/l-stage.h>
@@ -91,6 +93,7 @@ static void luaopen_glblibs(lua_State * L)
 		{ "DisplayText",			luaopen_display_text },
 		{ "DisplayIcon",			luaopen_display_icon },
 		{ "Timer",					luaopen_timer },
+		{ "Scheduler",				luaopen_scheduler },
 		{ "Vision",					luaopen_vision },
 		{ "Stage",					luaopen_stage },
 		{ "Assets",					luaopen_assets },
@@ -160,66 +163,145 @@ static const char boot_lua[] = X(
 
 static int luaopen_boot(lua_State * L)
 {
-	if(luaL_loadbuffer(L, boot_lua, sizeof(boot_lua) - 1, "Boot.lua") == LUA_OK)
+	if(luahelper_loadbuffer(L, boot_lua, sizeof(boot_lua) - 1, "Boot.lua") == LUA_OK)
 		lua_call(L, 0, 0);
 	return 0;
 }
 
-struct reader_data_t
+#if (CONFIG_VM_BYTECODE_CACHE > 0)
+struct bytecode_header_t
 {
-	struct xfs_file_t * file;
-	char buffer[LUAL_BUFFERSIZE];
+	char magic[4];
+	uint32_t length;
+	uint32_t crc;
 };
 
-static const char * reader(lua_State * L, void * data, size_t * size)
+static int bytecode_cache_load(lua_State * L, struct xfs_context_t * ctx, const char * path, const char * filename, size_t len, uint32_t crc)
 {
-	struct reader_data_t * rd = (struct reader_data_t *)data;
-	s64_t ret;
+	struct bytecode_header_t * h;
+	struct xfs_file_t * file;
+	char * buf;
+	s64_t l;
+	int status = LUA_ERRFILE;
 
-	ret = xfs_read(rd->file, rd->buffer, LUAL_BUFFERSIZE);
-	if(ret < 0)
+	if(!(file = xfs_open_read(ctx, path)))
+		return status;
+	l = xfs_length(file);
+	if((l > sizeof(struct bytecode_header_t)) && (buf = malloc(l)))
 	{
-		lua_error(L);
-		return NULL;
+		h = (struct bytecode_header_t *)buf;
+		if((xfs_read(file, buf, l) == l) && (memcmp(h->magic, "XLBC", 4) == 0) && (h->length == len) && (h->crc == crc))
+		{
+			status = luaL_loadbufferx(L, buf + sizeof(struct bytecode_header_t), l - sizeof(struct bytecode_header_t), filename, "b");
+			if(status != LUA_OK)
+				lua_pop(L, 1);
+		}
+		free(buf);
 	}
+	xfs_close(file);
+	return status;
+}
+
+static void bytecode_cache_store(lua_State * L, struct xfs_context_t * ctx, const char * path, size_t len, uint32_t crc)
+{
+	struct bytecode_header_t * h;
+	struct xfs_file_t * file;
+	char * buf;
+	size_t l;
 
-	*size = (size_t)ret;
-	return rd->buffer;
+	if(!(file = xfs_open_write(ctx, path)))
+		return;
+	if((buf = luahelper_dump(L, sizeof(struct bytecode_header_t), &l)))
+	{
+		h = (struct bytecode_header_t *)buf;
+		memcpy(h->magic, "XLBC", 4);
+		h->length = len;
+		h->crc = crc;
+		if(xfs_write(file, buf, l) == l)
+		{
+			xfs_close(file);
+			free(buf);
+			return;
+		}
+		free(buf);
+	}
+	xfs_close(file);
+	xfs_remove(ctx, path);
+}
+#endif
+
+/*
+ * Text chunks are compiled once and the bytecode is kept in the
+ * writable directory of the application, keyed by the file name and checked
+ * against the length and crc of the source before being used.
+ */
+static int load_chunk(lua_State * L, struct xfs_context_t * ctx, const char * filename, const char * buf, size_t len)
+{
+#if (CONFIG_VM_BYTECODE_CACHE > 0)
+	char path[32];
+	uint32_t crc;
+	int status;
+
+	if((len > 0) && (buf[0] == LUA_SIGNATURE[0]))
+		return luaL_loadbuffer(L, buf, len, filename);
+	crc = crc32_sum(0, (const uint8_t *)buf, len);
+	sprintf(path, "/.luacache/%08x.luac", crc32_sum(0, (const uint8_t *)filename, strlen(filename)));
+	if(bytecode_cache_load(L, ctx, path, filename, len, crc) == LUA_OK)
+		return LUA_OK;
+	status = luaL_loadbuffer(L, buf, len, filename);
+	if(status == LUA_OK)
+		bytecode_cache_store(L, ctx, path, len, crc);
+	return status;
+#else
+	return luaL_loadbuffer(L, buf, len, filename);
+#endif
 }
 
 static int l_loadfile(lua_State * L)
 {
 	struct xfs_context_t * ctx = ((struct vmctx_t *)luahelper_vmctx(L))->xfs;
 	const char * filename = luaL_optstring(L, 1, NULL);
-	struct reader_data_t * rd;
+	struct xfs_file_t * file;
+	char * buf;
+	s64_t len;
+	int status;
 
-	rd = malloc(sizeof(struct reader_data_t));
-	if(!rd)
+	file = xfs_open_read(ctx, filename);
+	if(!file)
 	{
 		lua_pushnil(L);
-		lua_pushfstring(L, "cannot malloc memory", filename);
+		lua_pushfstring(L, "cannot open %s", filename);
 		return 2;
 	}
 
-	rd->file = xfs_open_read(ctx, filename);
-	if(!rd->file)
+	len = xfs_length(file);
+	buf = malloc(len > 0 ? len : 1);
+	if(!buf)
 	{
-		free(rd);
+		xfs_close(file);
 		lua_pushnil(L);
-		lua_pushfstring(L, "cannot open %s", filename);
+		lua_pushfstring(L, "cannot malloc memory");
 		return 2;
 	}
 
-	if(lua_load(L, reader, rd, filename, NULL))
+	if((len < 0) || (xfs_read(file, buf, len) != len))
 	{
-		free(rd);
+		free(buf);
+		xfs_close(file);
 		lua_pushnil(L);
 		lua_pushfstring(L, "cannot read %s", filename);
 		return 2;
 	}
+	xfs_close(file);
 
-	xfs_close(rd->file);
-	free(rd);
+	status = load_chunk(L, ctx, filename, buf, len);
+	free(buf);
+	if(status != LUA_OK)
+	{
+		lua_pushnil(L);
+		lua_insert(L, -2);
+		return 2;
+	}
 	return 1;
 }
 
@@ -316,6 +398,16 @@ static int l_xboot_uniqueid(lua_State * L)
 	return 1;
 }
 
+static int l_xboot_memory(lua_State * L)
+{
+	struct vmheap_t * h = &((struct vmctx_t *)luahelper_vmctx(L))->heap;
+	lua_pushnumber(L, (lua_Number)h->used / 1024);
+	lua_pushnumber(L, (lua_Number)h->peak / 1024);
+	lua_pushnumber(L, (lua_Number)h->narena / 1024);
+	lua_pushnumber(L, (lua_Number)h->limit / 1024);
+	return 4;
+}
+
 static int l_xboot_keygen(lua_State * L)
 {
 	const char * msg = luaL_optstring(L, 1, "");
@@ -365,6 +457,8 @@ static int pmain(lua_State * L)
 	lua_setfield(L, -2, "sleep");
 	lua_pushcfunction(L, l_xboot_uniqueid);
 	lua_setfield(L, -2, "uniqueid");
+	lua_pushcfunction(L, l_xboot_memory);
+	lua_setfield(L, -2, "memory");
 	lua_pushcfunction(L, l_xboot_keygen);
 	lua_setfield(L, -2, "keygen");
 
@@ -372,17 +466,170 @@ static int pmain(lua_State * L)
 	return 0;
 }
 
+#define VMHEAP_LARGE_SIZE		(CONFIG_VM_ARENA_SIZE >> 2)
+
+static inline int vmheap_class(size_t size)
+{
+	if(size <= VMHEAP_CLASS_MAX)
+		return (size - 1) >> VMHEAP_CLASS_SHIFT;
+	return -1;
+}
+
+static int vmheap_grow(struct vmheap_t * h)
+{
+	struct vmheap_arena_t * a;
+	void * mem;
+	size_t size;
+
+	a = malloc(CONFIG_VM_ARENA_SIZE);
+	if(!a)
+		return 0;
+	mem = (void *)(a + 1);
+	size = CONFIG_VM_ARENA_SIZE - sizeof(struct vmheap_arena_t);
+	if(!(h->mm ? mm_add_pool(h->mm, mem, size) : (h->mm = mm_create(mem, size))))
+	{
+		free(a);
+		return 0;
+	}
+	a->next = h->arena;
+	a->size = CONFIG_VM_ARENA_SIZE;
+	h->arena = a;
+	h->narena += a->size;
+	return 1;
+}
+
+static void * vmheap_tlsf_alloc(struct vmheap_t * h, size_t size)
+{
+	void * p = NULL;
+
+	if(h->mm)
+		p = mm_malloc(h->mm, size);
+	if(!p && vmheap_grow(h))
+		p = mm_malloc(h->mm, size);
+	return p;
+}
+
+/*
+ * Class caches take their slabs from the private heap, so they are created
+ * once it exists and the heap grows whenever a cache runs dry
+ */
+static void * vmheap_class_alloc(struct vmheap_t * h, int idx)
+{
+	char name[32];
+	void * p;
+
+	if(!h->cls[idx])
+	{
+		if(!h->mm && !vmheap_grow(h))
+			return NULL;
+		sprintf(name, "vm-%d", (idx + 1) << VMHEAP_CLASS_SHIFT);
+		h->cls[idx] = kmem_cache_create_mm(h->mm, name, (idx + 1) << VMHEAP_CLASS_SHIFT, sizeof(double));
+		if(!h->cls[idx])
+			return NULL;
+	}
+	p = kmem_cache_alloc(h->cls[idx]);
+	if(!p && vmheap_grow(h))
+		p = kmem_cache_alloc(h->cls[idx]);
+	return p;
+}
+
+static void * vmheap_alloc(struct vmheap_t * h, size_t size)
+{
+	int idx = vmheap_class(size);
+
+	if(idx >= 0)
+		return vmheap_class_alloc(h, idx);
+	else if(size <= VMHEAP_LARGE_SIZE)
+		return vmheap_tlsf_alloc(h, size);
+	return malloc(size);
+}
+
+static void vmheap_free(struct vmheap_t * h, void * ptr, size_t size)
+{
+	int idx = vmheap_class(size);
+
+	if(idx >= 0)
+		kmem_cache_free(h->cls[idx], ptr);
+	else if(size <= VMHEAP_LARGE_SIZE)
+		mm_free(h->mm, ptr);
+	else
+		free(ptr);
+}
+
+static void vmheap_init(struct vmheap_t * h)
+{
+	memset(h, 0, sizeof(struct vmheap_t));
+	h->limit = CONFIG_VM_MEMORY_LIMIT;
+}
+
+static void vmheap_exit(struct vmheap_t * h)
+{
+	struct vmheap_arena_t * a, * n;
+	int i;
+
+	for(i = 0; i < VMHEAP_CLASS_COUNT; i++)
+	{
+		if(h->cls[i])
+			kmem_cache_destroy(h->cls[i]);
+	}
+	if(h->mm)
+		mm_destroy(h->mm);
+	for(a = h->arena; a; a = n)
+	{
+		n = a->next;
+		free(a);
+	}
+	memset(h, 0, sizeof(struct vmheap_t));
+}
+
+/*
+ * Lua passes the old size of every block, so the allocator keeps no headers and
+ * the size alone tells which of the three heaps owns a block.
+ */
 static void * l_alloc(void * ud, void * ptr, size_t osize, size_t nsize)
 {
+	struct vmheap_t * h = &((struct vmctx_t *)ud)->heap;
+	void * p;
+
+	if(!ptr)
+		osize = 0;
 	if(nsize == 0)
 	{
-		free(ptr);
+		if(ptr)
+		{
+			vmheap_free(h, ptr, osize);
+			h->used -= osize;
+		}
 		return NULL;
 	}
+	if((h->limit > 0) && (nsize > osize) && (h->used + nsize - osize > h->limit))
+		return NULL;
+
+	if(ptr && (vmheap_class(osize) >= 0) && (vmheap_class(osize) == vmheap_class(nsize)))
+		p = ptr;
+	else if(ptr && (osize > VMHEAP_CLASS_MAX) && (osize <= VMHEAP_LARGE_SIZE) && (nsize > VMHEAP_CLASS_MAX) && (nsize <= VMHEAP_LARGE_SIZE))
+	{
+		p = mm_realloc(h->mm, ptr, nsize);
+		if(!p && vmheap_grow(h))
+			p = mm_realloc(h->mm, ptr, nsize);
+	}
+	else if(ptr && (osize > VMHEAP_LARGE_SIZE) && (nsize > VMHEAP_LARGE_SIZE))
+		p = realloc(ptr, nsize);
 	else
 	{
-		return realloc(ptr, nsize);
+		p = vmheap_alloc(h, nsize);
+		if(p && ptr)
+		{
+			memcpy(p, ptr, min(osize, nsize));
+			vmheap_free(h, ptr, osize);
+		}
 	}
+	if(!p)
+		return NULL;
+	h->used += nsize - osize;
+	if(h->used > h->peak)
+		h->peak = h->used;
+	return p;
 }
 
 static int l_panic(lua_State *L)
@@ -407,7 +654,12 @@ static struct vmctx_t * vmctx_alloc(const char * path, const char * fb, const ch
 	if(!ctx)
 		return NULL;
 
+	vmheap_init(&ctx->heap);
 	ctx->xfs = xfs_alloc(path, 1);
+#if (CONFIG_VM_BYTECODE_CACHE > 0)
+	if(ctx->xfs)
+		xfs_mkdir(ctx->xfs, "/.luacache");
+#endif
 	ctx->f = font_context_alloc();
 	ctx->w = window_alloc(fb, input);
 	ctx->priv = data;
@@ -423,6 +675,7 @@ static void vmctx_free(struct vmctx_t * ctx)
 	xfs_free(ctx->xfs);
 	font_context_free(ctx->f);
 	window_free(ctx->w);
+	vmheap_exit(&ctx->heap);
 	free(ctx);
 }
 
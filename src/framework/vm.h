@@ -5,12 +5,39 @@
 extern "C" {
 #endif
 
+#include <slab.h>
 #include <xfs/xfs.h>
 #include <graphic/font.h>
 #include <xboot/window.h>
 
+/*
+ * Small objects are served from per class slab caches carved out of the
+ * private tlsf heap, anything up to a quarter of an arena from that heap
+ * directly and the rest from the system heap. Arenas are only given back
+ * when the vm exits.
+ */
+#define VMHEAP_CLASS_SHIFT		(4)
+#define VMHEAP_CLASS_MAX		(256)
+#define VMHEAP_CLASS_COUNT		(VMHEAP_CLASS_MAX >> VMHEAP_CLASS_SHIFT)
+
+struct vmheap_arena_t {
+	struct vmheap_arena_t * next;
+	size_t size;
+};
+
+struct vmheap_t {
+	void * mm;
+	struct vmheap_arena_t * arena;
+	struct kmem_cache_t * cls[VMHEAP_CLASS_COUNT];
+	size_t narena;
+	size_t used;
+	size_t peak;
+	size_t limit;
+};
+
 struct vmctx_t
 {
+	struct vmheap_t heap;
 	struct xfs_context_t * xfs;
 	struct font_context_t * f;
 	struct window_t * w;
@@ -36,9 +36,10 @@ struct audio_t
 	/* The audio name */
 	char * name;
 
-	/* The sound pool */
+	/* The sound pool, voices are owned by the mixer once moved off pending */
 	struct {
 		struct list_head list;
+		struct list_head pending;
 		spinlock_t lock;
 	} soundpool;
 
@@ -27,6 +27,18 @@ struct block_t
 	/* Sync cache to block device */
 	void (*sync)(struct block_t * blk);
 
+	/* Memory backed device, bypass the buffer cache */
+	int direct;
+
+	/* Buffer cache statistics and read-ahead state, maintained by block core */
+	u64_t hit;
+	u64_t miss;
+	u64_t ranext;
+	u64_t rawin;
+
+	/* Bounce block for partial accesses, owned by block core */
+	u8_t * bounce;
+
 	/* Private data */
 	void * priv;
 };
@@ -71,13 +83,13 @@ static inline u64_t block_available_length(struct block_t * blk, u64_t blkno, u6
 
 struct block_t * search_block(const char * name);
 struct device_t * register_block(struct block_t * blk, struct driver_t * drv);
-void unregister_block(struct block_t * blk);
+int unregister_block(struct block_t * blk);
 struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t length, const char * name);
 void unregister_sub_block(struct block_t * pblk);
 
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
-void block_sync(struct block_t * blk);
+int block_sync(struct block_t * blk);
 
 #ifdef __cplusplus
 }
@@ -8,10 +8,34 @@ extern "C" {
 #include <xboot.h>
 #include <camera/video.h>
 
+struct camera_buffer_t
+{
+	struct list_head entry;
+	struct video_frame_t frame;
+	ktime_t timestamp;
+	uint64_t sequence;
+	int index;
+	int size;
+};
+
 struct camera_t
 {
 	char * name;
 
+	/* The frame queue, filled by the capture task */
+	struct {
+		struct camera_buffer_t * buffers;
+		int count;
+		struct list_head free;
+		struct list_head ready;
+		spinlock_t lock;
+		struct task_t * task;
+		struct task_t * waiter;
+		int running;
+		uint64_t sequence;
+		uint64_t dropped;
+	} queue;
+
 	int (*start)(struct camera_t * cam, enum video_format_t fmt, int width, int height);
 	int (*stop)(struct camera_t * cam);
 	int (*capture)(struct camera_t * cam, struct video_frame_t * frame);
@@ -30,6 +54,11 @@ int camera_stop(struct camera_t * cam);
 int camera_capture(struct camera_t * cam, struct video_frame_t * frame, int timeout);
 int camera_ioctl(struct camera_t * cam, const char * cmd, void * arg);
 
+int camera_stream_start(struct camera_t * cam, enum video_format_t fmt, int width, int height, int count);
+void camera_stream_stop(struct camera_t * cam);
+struct camera_buffer_t * camera_dequeue(struct camera_t * cam, int timeout);
+void camera_enqueue(struct camera_t * cam, struct camera_buffer_t * buf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,8 @@ struct video_frame_t {
 };
 
 void video_frame_to_argb(struct video_frame_t * frame, void * pixels);
+void video_frame_to_argb_scaled(struct video_frame_t * frame, void * pixels, int width, int height);
+void video_frame_to_gray(struct video_frame_t * frame, void * gray, int width, int height);
 
 #ifdef __cplusplus
 }
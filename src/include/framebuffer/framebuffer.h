@@ -35,6 +35,9 @@ struct framebuffer_t
 	/* Present a surface */
 	void (*present)(struct framebuffer_t * fb, struct surface_t * s, struct region_list_t * rl);
 
+	/* Bind a surface to the next scanout buffer, return the buffer age or -1 for copy present */
+	int (*acquire)(struct framebuffer_t * fb, struct surface_t * s);
+
 	/* Private data */
 	void * priv;
 };
@@ -97,6 +100,18 @@ static inline void framebuffer_present_surface(struct framebuffer_t * fb, struct
 	fb->present(fb, s, rl);
 }
 
+/*
+ * Direct rendering into scanout buffers. The age is the number of presents
+ * since the bound buffer was last shown, so a double buffered device reports
+ * one. Zero means its content is undefined.
+ */
+static inline int framebuffer_acquire_surface(struct framebuffer_t * fb, struct surface_t * s)
+{
+	if(fb->acquire)
+		return fb->acquire(fb, s);
+	return -1;
+}
+
 struct framebuffer_t * search_framebuffer(const char * name);
 struct framebuffer_t * search_first_framebuffer(void);
 struct device_t * register_framebuffer(struct framebuffer_t * fb, struct driver_t * drv);
@@ -5,10 +5,51 @@
 extern "C" {
 #endif
 
+#include <xconfigs.h>
 #include <types.h>
 #include <list.h>
 #include <xfs/xfs.h>
 
+struct font_glyph_t {
+	struct hlist_node node;
+	char * family;
+	uint32_t code;
+	int size;
+	int left;
+	int top;
+	int width;
+	int height;
+	int pitch;
+	int xadvance;
+	int yadvance;
+	uint8_t * buffer;
+};
+
+struct font_atlas_t {
+	uint8_t * pixels;
+	int x, y;
+	int h;
+};
+
+struct font_run_glyph_t {
+	struct font_glyph_t * g;
+	int x, y;
+};
+
+struct font_run_t {
+	struct hlist_node node;
+	struct list_head entry;
+	uint32_t hash;
+	char * family;
+	int size;
+	int wrap;
+	char * utf8;
+	int ox, oy;
+	int width, height;
+	int count;
+	struct font_run_glyph_t * glyphs;
+};
+
 struct font_context_t {
 	void * library;
 	void * manager;
@@ -16,6 +57,13 @@ struct font_context_t {
 	void * sbit;
 	void * image;
 	struct list_head list;
+
+	struct hlist_head glyph[CONFIG_FONT_GLYPH_HASH_SIZE];
+	struct font_atlas_t atlas[CONFIG_FONT_ATLAS_PAGES];
+	struct hlist_head run[CONFIG_FONT_RUN_CACHE_SIZE];
+	struct list_head rlru;
+	int nrun;
+	unsigned int generation;
 };
 
 struct font_context_t * font_context_alloc(void);
@@ -24,6 +72,12 @@ void * font_lookup_bitmap(struct font_context_t * ctx, const char * family, int
 void * font_lookup_glyph(struct font_context_t * ctx, const char * family, int size, uint32_t code);
 void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const char * family, const char * path);
 
+struct font_glyph_t * font_glyph_lookup(struct font_context_t * ctx, const char * family, int size, uint32_t code);
+struct font_run_t * font_run_lookup(struct font_context_t * ctx, const char * family, int size, int wrap, const char * utf8);
+struct font_run_t * font_run_alloc(struct font_context_t * ctx, const char * family, int size, int wrap, const char * utf8);
+void font_run_insert(struct font_context_t * ctx, struct font_run_t * run);
+void font_run_free(struct font_run_t * run);
+
 #ifdef __cplusplus
 }
 #endif
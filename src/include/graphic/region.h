@@ -112,6 +112,9 @@ void region_list_free(struct region_list_t * rl);
 void region_list_clone(struct region_list_t * rl, struct region_list_t * o);
 void region_list_merge(struct region_list_t * rl, struct region_list_t * o);
 void region_list_add(struct region_list_t * rl, struct region_t * r);
+void region_list_subtract(struct region_list_t * rl, struct region_t * r);
+void region_list_intersect(struct region_list_t * rl, struct region_t * r);
+int region_list_area(struct region_list_t * rl);
 void region_list_clear(struct region_list_t * rl);
 
 #ifdef __cplusplus
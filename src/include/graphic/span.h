@@ -0,0 +1,32 @@
+#ifndef __GRAPHIC_SPAN_H__
+#define __GRAPHIC_SPAN_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <stdint.h>
+
+/*
+ * Span kernels over premultiplied ARGB32 pixels
+ */
+struct span_ops_t {
+	const char * name;
+	void (*blend)(uint32_t * d, uint32_t * s, int n);
+	void (*fill)(uint32_t * d, uint32_t c, int n);
+	void (*gray)(uint32_t * p, int n);
+	void (*sepia)(uint32_t * p, int n);
+	void (*invert)(uint32_t * p, int n);
+	void (*opacity)(uint32_t * p, int n, int v);
+	void (*brightness)(uint32_t * p, int n, int v);
+	void (*contrast)(uint32_t * p, int n, int v);
+};
+
+struct span_ops_t * span_ops_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GRAPHIC_SPAN_H__ */
@@ -0,0 +1,41 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+
+struct kmem_cache_t {
+	struct list_head list;
+	struct list_head full;
+	struct list_head partial;
+	struct list_head empty;
+	char * name;
+	size_t size;
+	size_t align;
+	size_t pgsize;
+	void * mm;
+	unsigned int nobjs;
+	unsigned int nslabs;
+	unsigned int nempty;
+	unsigned int active;
+	spinlock_t lock;
+};
+
+struct kmem_cache_t * kmem_cache_create_mm(void * mm, const char * name, size_t size, size_t align);
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align);
+void kmem_cache_destroy(struct kmem_cache_t * c);
+void * kmem_cache_alloc(struct kmem_cache_t * c);
+void * kmem_cache_zalloc(struct kmem_cache_t * c);
+void kmem_cache_free(struct kmem_cache_t * c, void * obj);
+void kmem_cache_shrink(struct kmem_cache_t * c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SLAB_H__ */
@@ -5,10 +5,13 @@
 extern "C" {
 #endif
 
+#include <xconfigs.h>
 #include <types.h>
 #include <stdint.h>
 #include <xfs/xfs.h>
 
+struct sound_stream_t;
+
 /*
  * The sound is short audio, fixed to stereo, 48khz, 16bits signed format.
  */
@@ -21,9 +24,13 @@ struct sound_t
 	int loop;
 	int lvol;
 	int rvol;
+	int clvol;
+	int crvol;
+	int active;
 	float gain;
 	float pan;
 	void (*cb)(struct sound_t *);
+	struct sound_stream_t * stream;
 };
 
 static inline uint32_t * sound_get_source(struct sound_t * snd)
@@ -97,6 +104,10 @@ struct sound_t * sound_alloc_from_xfs(struct xfs_context_t * ctx, const char * f
 struct sound_t * sound_alloc_tone(int frequency, int millisecond);
 void sound_free(struct sound_t * snd);
 
+int sound_stream_peek(struct sound_t * snd, uint32_t ** buf);
+void sound_stream_advance(struct sound_t * snd, int n);
+int sound_stream_eof(struct sound_t * snd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,15 @@ extern "C" {
 #include <vfs/fat/fat.h>
 
 
+/*
+ * Run of clusters contiguous on disk, mapping file cluster index to disk cluster
+ */
+struct fatfs_run_t {
+	u32_t index;
+	u32_t clust;
+	u32_t count;
+};
+
 /*
  * Information for accessing a FAT file/directory
  */
@@ -25,9 +34,12 @@ struct fatfs_node_t {
 	/* First cluster */
 	u32_t first_cluster;
 
-	/* Current cluster */
-	u32_t cur_cluster;
-	u32_t cur_pos;
+	/* Cluster runs, built lazily from first cluster */
+	struct fatfs_run_t * runs;
+	u32_t runs_first;
+	u32_t runs_count;
+	u32_t runs_size;
+	bool_t runs_end;
 
 	/* Cached clusters */
 	u8_t *cached_data;
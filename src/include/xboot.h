@@ -46,6 +46,7 @@ extern "C" {
 #include <ssize.h>
 #include <spring.h>
 #include <malloc.h>
+#include <slab.h>
 #include <charset.h>
 #include <version.h>
 #include <xboot/kref.h>
@@ -63,6 +64,7 @@ extern "C" {
 #include <xboot/task.h>
 #include <xboot/mutex.h>
 #include <xboot/channel.h>
+#include <xboot/parallel.h>
 #include <xboot/window.h>
 #include <xboot/module.h>
 #include <xboot/setting.h>
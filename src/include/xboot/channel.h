@@ -7,22 +7,39 @@ extern "C" {
 
 #include <types.h>
 #include <list.h>
+#include <atomic.h>
 #include <spinlock.h>
 
+enum channel_type_t {
+	CHANNEL_TYPE_MPMC	= 0,
+	CHANNEL_TYPE_SPSC	= 1,
+	CHANNEL_TYPE_MPSC	= 2,
+};
+
+struct channel_vec_t {
+	unsigned char * buf;
+	unsigned int len;
+};
+
 struct channel_t {
 	unsigned char * buffer;
 	unsigned int size;
 	unsigned int in;
 	unsigned int out;
+	atomic_t reserve;
+	enum channel_type_t type;
 	struct list_head swait;
 	struct list_head rwait;
 	spinlock_t lock;
 };
 
 struct channel_t * channel_alloc(unsigned int size);
+struct channel_t * channel_alloc_with_type(unsigned int size, enum channel_type_t type);
 void channel_free(struct channel_t * c);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
+void channel_sendv(struct channel_t * c, struct channel_vec_t * vec, int n);
+void channel_recvv(struct channel_t * c, struct channel_vec_t * vec, int n);
 
 #ifdef __cplusplus
 }
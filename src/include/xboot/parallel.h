@@ -0,0 +1,28 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <atomic.h>
+
+typedef void (*parallel_func_t)(int start, int end, void * data);
+
+struct parallel_job_t {
+	parallel_func_t func;
+	void * data;
+	int count;
+	int grain;
+	atomic_t next;
+};
+
+int parallel_cpus(void);
+void parallel_for(int count, int grain, parallel_func_t func, void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PARALLEL_H__ */
@@ -12,6 +12,7 @@ extern "C" {
 #include <irqflags.h>
 #include <spinlock.h>
 #include <smp.h>
+#include <atomic.h>
 #include <rbtree_augmented.h>
 
 struct task_t;
@@ -38,9 +39,12 @@ struct task_t {
 	struct list_head mlist;
 	struct scheduler_t * sched;
 	enum task_status_t status;
+	int oncpu;
 	uint64_t start;
 	uint64_t time;
 	uint64_t vtime;
+	uint64_t wtime;
+	atomic_t wakeup;
 	char * name;
 	void * fctx;
 	void * stack;
@@ -56,9 +60,15 @@ struct task_t {
 struct scheduler_t {
 	struct rb_root_cached ready;
 	struct list_head suspend;
+	struct list_head sleep;
 	struct task_t * running;
+	struct task_t * idle;
+	struct task_t * zombie;
 	uint64_t min_vtime;
 	uint64_t weight;
+	uint64_t nready;
+	uint64_t balance;
+	uint64_t nmigrate;
 	spinlock_t lock;
 };
 
@@ -80,6 +90,8 @@ void task_renice(struct task_t * task, int nice);
 void task_suspend(struct task_t * task);
 void task_resume(struct task_t * task);
 void task_yield(void);
+void task_sleep(uint64_t timeout);
+void task_wakeup(struct task_t * task);
 
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data);
 void task_data_free(struct task_data_t * td);
@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <xconfigs.h>
 #include <types.h>
 #include <stdint.h>
 #include <list.h>
@@ -40,6 +41,7 @@ struct window_t {
 	struct window_manager_t * wm;
 	struct surface_t * s;
 	struct region_list_t * rl;
+	struct region_list_t * hrl[CONFIG_FRAMEBUFFER_MAX_BUFFERS];
 	struct fifo_t * event;
 	struct hmap_t * map;
 	int launcher;
@@ -84,6 +86,17 @@ static inline int window_is_active(struct window_t * w)
 	return list_is_first(&w->list, &w->wm->window);
 }
 
+static inline int window_is_dirty(struct window_t * w)
+{
+	return (w->wm->refresh || (w->wm->cursor.show && w->wm->cursor.dirty) || (w->rl->count > 0));
+}
+
+static inline void window_wakeup(struct window_t * w)
+{
+	if(w)
+		task_wakeup(w->task);
+}
+
 static inline int window_get_width(struct window_t * w)
 {
 	if(w)
@@ -133,6 +146,7 @@ void window_region_list_add(struct window_t * w, struct region_t * r);
 void window_region_list_clear(struct window_t * w);
 void window_present(struct window_t * w, void * o, void (*draw)(struct window_t *, void *));
 void window_exit(struct window_t * w);
+void window_wait(struct window_t * w, uint64_t timeout);
 int window_pump_event(struct window_t * w, struct event_t * e);
 void push_event(struct event_t * e);
 
@@ -19,6 +19,34 @@ extern "C" {
 #define CONFIG_TASK_STACK_SIZE				(512 * 1024)
 #endif
 
+#if !defined(CONFIG_SCHED_WORK_STEALING)
+#define CONFIG_SCHED_WORK_STEALING			(1)
+#endif
+
+#if !defined(CONFIG_SCHED_BALANCE_INTERVAL)
+#define CONFIG_SCHED_BALANCE_INTERVAL		(10)
+#endif
+
+#if !defined(CONFIG_MALLOC_MAGAZINE_SIZE)
+#define CONFIG_MALLOC_MAGAZINE_SIZE			(32)
+#endif
+
+#if !defined(CONFIG_VM_ARENA_SIZE)
+#define CONFIG_VM_ARENA_SIZE				(SZ_256K)
+#endif
+
+#if !defined(CONFIG_VM_MEMORY_LIMIT)
+#define CONFIG_VM_MEMORY_LIMIT				(0)
+#endif
+
+#if !defined(CONFIG_VM_BYTECODE_CACHE)
+#define CONFIG_VM_BYTECODE_CACHE			(1)
+#endif
+
+#if !defined(CONFIG_VM_BYTECODE_STRIP)
+#define CONFIG_VM_BYTECODE_STRIP			(0)
+#endif
+
 #if !defined(CONFIG_DRIVER_HASH_SIZE)
 #define CONFIG_DRIVER_HASH_SIZE				(521)
 #endif
@@ -31,6 +59,66 @@ extern "C" {
 #define CONFIG_EVENT_FIFO_SIZE				(64)
 #endif
 
+#if !defined(CONFIG_BLOCK_CACHE_SIZE)
+#define CONFIG_BLOCK_CACHE_SIZE				(256 * 1024)
+#endif
+
+#if !defined(CONFIG_BLOCK_CACHE_HASH_SIZE)
+#define CONFIG_BLOCK_CACHE_HASH_SIZE		(257)
+#endif
+
+#if !defined(CONFIG_BLOCK_READ_AHEAD)
+#define CONFIG_BLOCK_READ_AHEAD				(32)
+#endif
+
+#if !defined(CONFIG_FRAMEBUFFER_MAX_BUFFERS)
+#define CONFIG_FRAMEBUFFER_MAX_BUFFERS		(3)
+#endif
+
+#if !defined(CONFIG_REGION_MERGE_COST)
+#define CONFIG_REGION_MERGE_COST			(1024)
+#endif
+
+#if !defined(CONFIG_REGION_LIST_MAX_RECTS)
+#define CONFIG_REGION_LIST_MAX_RECTS		(32)
+#endif
+
+#if !defined(CONFIG_CAMERA_POLL_INTERVAL)
+#define CONFIG_CAMERA_POLL_INTERVAL			(5)
+#endif
+
+#if !defined(CONFIG_SOUND_STREAM_FRAMES)
+#define CONFIG_SOUND_STREAM_FRAMES			(16384)
+#endif
+
+#if !defined(CONFIG_FONT_CACHE_MAX_FACES)
+#define CONFIG_FONT_CACHE_MAX_FACES			(4)
+#endif
+
+#if !defined(CONFIG_FONT_CACHE_MAX_SIZES)
+#define CONFIG_FONT_CACHE_MAX_SIZES			(16)
+#endif
+
+#if !defined(CONFIG_FONT_CACHE_MAX_BYTES)
+#define CONFIG_FONT_CACHE_MAX_BYTES			(512 * 1024)
+#endif
+
+#if !defined(CONFIG_FONT_GLYPH_HASH_SIZE)
+#define CONFIG_FONT_GLYPH_HASH_SIZE			(509)
+#endif
+
+#if !defined(CONFIG_FONT_ATLAS_SIZE)
+#define CONFIG_FONT_ATLAS_SIZE				(512)
+#endif
+
+#if !defined(CONFIG_FONT_ATLAS_PAGES)
+#define CONFIG_FONT_ATLAS_PAGES				(2)
+#endif
+
+#if !defined(CONFIG_FONT_RUN_CACHE_SIZE)
+#define CONFIG_FONT_RUN_CACHE_SIZE			(128)
+#endif
+
 #if !defined(CONFIG_MOUNT_PRIVATE_DEVICE)
 #define CONFIG_MOUNT_PRIVATE_DEVICE			""
 #endif
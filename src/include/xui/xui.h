@@ -25,6 +25,8 @@ extern "C" {
 #define XUI_COLLAPSE_POOL_SIZE		(128)
 #define XUI_TREE_POOL_SIZE			(128)
 #define XUI_MAX_WIDTHS				(32)
+#define XUI_FRAME_RATE				(60)
+#define XUI_IDLE_TIMEOUT			(250)
 
 #define T(s)						xui_translate(ctx, (s))
 
@@ -294,6 +296,11 @@ union xui_cmd_t {
 	struct xui_cmd_checkerboard_t checkerboard;
 };
 
+struct xui_bin_t {
+	union xui_cmd_t * cmd;
+	struct region_t clip;
+};
+
 struct xui_pool_item_t {
 	unsigned int id;
 	int last_update;
@@ -489,6 +496,12 @@ struct xui_context_t {
 	unsigned int cheight;
 	unsigned int * cells[2];
 	unsigned int cindex;
+	unsigned int * tstart;
+	unsigned int * tlist;
+	unsigned int * tmask;
+	struct xui_bin_t * bins;
+	int nbin, mbin;
+	int ntlist, mtlist;
 	unsigned int running;
 	ktime_t stamp;
 	ktime_t delta;
@@ -0,0 +1,226 @@
+/*
+ * kernel/command/cmd-channel.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/channel.h>
+#include <command/command.h>
+
+/*
+ * Producers and consumers pass (id, seq) records through a small ring with
+ * channel_sendv and channel_recvv, one vector entry per field. Records are
+ * eight bytes and the ring is a power of two, so partial transfers never
+ * split a record even with several producers or consumers.
+ */
+#define CHANNEL_TEST_SIZE		(256)
+#define CHANNEL_TEST_MAX		(4)
+#define CHANNEL_TEST_STOP		(0xffffffff)
+
+struct channel_result_t {
+	uint32_t records;
+	uint32_t errors;
+	uint64_t sum;
+};
+
+struct channel_worker_t {
+	struct channel_t * c;
+	struct channel_t * done;
+	uint32_t id;
+	uint32_t count;
+	int nprod;
+	int ordered;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    channel [count]\r\n");
+}
+
+static void channel_producer_task(struct task_t * task, void * data)
+{
+	struct channel_worker_t * w = (struct channel_worker_t *)data;
+	struct channel_result_t r = { 0, 0, 0 };
+	uint32_t id = w->id, seq;
+	struct channel_vec_t vec[2] = {
+		{ (unsigned char *)&id, sizeof(uint32_t) },
+		{ (unsigned char *)&seq, sizeof(uint32_t) },
+	};
+
+	for(seq = 0; seq < w->count; seq++)
+		channel_sendv(w->c, vec, 2);
+	r.records = w->count;
+	channel_send(w->done, (unsigned char *)&r, sizeof(struct channel_result_t));
+}
+
+static void channel_consumer_task(struct task_t * task, void * data)
+{
+	struct channel_worker_t * w = (struct channel_worker_t *)data;
+	struct channel_result_t r = { 0, 0, 0 };
+	uint32_t last[CHANNEL_TEST_MAX];
+	uint32_t id, seq;
+	struct channel_vec_t vec[2] = {
+		{ (unsigned char *)&id, sizeof(uint32_t) },
+		{ (unsigned char *)&seq, sizeof(uint32_t) },
+	};
+	int i;
+
+	for(i = 0; i < CHANNEL_TEST_MAX; i++)
+		last[i] = CHANNEL_TEST_STOP;
+	while(1)
+	{
+		channel_recvv(w->c, vec, 2);
+		if(id == CHANNEL_TEST_STOP)
+			break;
+		if(id >= w->nprod)
+		{
+			r.errors++;
+			continue;
+		}
+		if(w->ordered && (seq != last[id] + 1))
+			r.errors++;
+		last[id] = seq;
+		r.records++;
+		r.sum += seq;
+	}
+	channel_send(w->done, (unsigned char *)&r, sizeof(struct channel_result_t));
+}
+
+static int channel_test(const char * name, enum channel_type_t type, int nprod, int ncons, uint32_t count)
+{
+	struct channel_worker_t prod[CHANNEL_TEST_MAX], cons[CHANNEL_TEST_MAX];
+	struct channel_result_t r, total = { 0, 0, 0 };
+	struct channel_t * c, * done;
+	uint32_t stop = CHANNEL_TEST_STOP;
+	struct channel_vec_t vec[2] = {
+		{ (unsigned char *)&stop, sizeof(uint32_t) },
+		{ (unsigned char *)&stop, sizeof(uint32_t) },
+	};
+	ktime_t t;
+	int i, ok;
+
+	c = channel_alloc_with_type(CHANNEL_TEST_SIZE, type);
+	done = channel_alloc(sizeof(struct channel_result_t) * CHANNEL_TEST_MAX * 2);
+	if(!c || !done)
+	{
+		channel_free(c);
+		channel_free(done);
+		printf("%s: can't alloc channel\r\n", name);
+		return -1;
+	}
+
+	t = ktime_get();
+	for(i = 0; i < ncons; i++)
+	{
+		cons[i].c = c;
+		cons[i].done = done;
+		cons[i].id = i;
+		cons[i].count = 0;
+		cons[i].nprod = nprod;
+		cons[i].ordered = (ncons == 1) ? 1 : 0;
+		task_resume(task_create(NULL, "channel-rx", channel_consumer_task, &cons[i], 0, 0));
+	}
+	for(i = 0; i < nprod; i++)
+	{
+		prod[i].c = c;
+		prod[i].done = done;
+		prod[i].id = i;
+		prod[i].count = count;
+		prod[i].nprod = nprod;
+		prod[i].ordered = 0;
+		task_resume(task_create(NULL, "channel-tx", channel_producer_task, &prod[i], 0, 0));
+	}
+
+	/*
+	 * Consumers only stop on a sentinel, so the first results are the producers'
+	 */
+	for(i = 0; i < nprod; i++)
+		channel_recv(done, (unsigned char *)&r, sizeof(struct channel_result_t));
+	for(i = 0; i < ncons; i++)
+		channel_sendv(c, vec, 2);
+	for(i = 0; i < ncons; i++)
+	{
+		channel_recv(done, (unsigned char *)&r, sizeof(struct channel_result_t));
+		total.records += r.records;
+		total.errors += r.errors;
+		total.sum += r.sum;
+	}
+	t = ktime_sub(ktime_get(), t);
+
+	ok = (total.errors == 0) && (total.records == (uint32_t)nprod * count) && (total.sum == (uint64_t)nprod * count * (count - 1) / 2);
+	printf("%s: %d -> %d, %u records in %llu us, %s\r\n", name, nprod, ncons, total.records, (unsigned long long)ktime_to_us(t), ok ? "ok" : "failed");
+	channel_free(c);
+	channel_free(done);
+	return ok ? 0 : -1;
+}
+
+static int do_channel(int argc, char ** argv)
+{
+	uint32_t count = 10000;
+	int ret = 0;
+
+	if(argc > 2)
+	{
+		usage();
+		return -1;
+	}
+	if(argc == 2)
+		count = strtoul(argv[1], NULL, 0);
+	if(count == 0)
+	{
+		usage();
+		return -1;
+	}
+
+	if(channel_test("spsc", CHANNEL_TYPE_SPSC, 1, 1, count) < 0)
+		ret = -1;
+	if(channel_test("mpsc", CHANNEL_TYPE_MPSC, CHANNEL_TEST_MAX, 1, count) < 0)
+		ret = -1;
+	if(channel_test("mpmc", CHANNEL_TYPE_MPMC, CHANNEL_TEST_MAX, 2, count) < 0)
+		ret = -1;
+	return ret;
+}
+
+static struct command_t cmd_channel = {
+	.name	= "channel",
+	.desc	= "self test and benchmark of the channel modes",
+	.usage	= usage,
+	.exec	= do_channel,
+};
+
+static __init void channel_cmd_init(void)
+{
+	register_command(&cmd_channel);
+}
+
+static __exit void channel_cmd_exit(void)
+{
+	unregister_command(&cmd_channel);
+}
+
+command_initcall(channel_cmd_init);
+command_exitcall(channel_cmd_exit);
@@ -232,7 +232,8 @@ static int format_fat16(struct block_t * blk)
 		block_write(blk, block, (reserved_blocks + i + blocks_per_fat) * 512, 1 * 512);
 	}
 
-	block_sync(blk);
+	if(block_sync(blk) < 0)
+		return -1;
 	return 0;
 }
 
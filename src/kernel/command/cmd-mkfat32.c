@@ -273,7 +273,8 @@ static int format_fat32(struct block_t * blk)
 	for(i = 0; i < blocks_per_cluster; ++i)
 		block_write(blk, block, (reserved_blocks + i) * 512, 1 * 512);
 
-	block_sync(blk);
+	if(block_sync(blk) < 0)
+		return -1;
     return 0;
 }
 
@@ -0,0 +1,176 @@
+/*
+ * kernel/command/cmd-region.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <graphic/region.h>
+#include <command/command.h>
+
+/*
+ * Random rects are applied to a region list and to a pixel map side by side.
+ * Subtract and intersect must match the map exactly. Union may bridge gaps
+ * or fold rects, so it only has to cover the map, which then takes over the
+ * list's coverage. Every list must also stay banded and free of overlaps.
+ */
+#define REGION_TEST_SIZE		(64)
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    region [count]\r\n");
+}
+
+static int region_test_check(struct region_list_t * rl, uint8_t * map, int exact)
+{
+	uint8_t cover[REGION_TEST_SIZE * REGION_TEST_SIZE];
+	struct region_t * r, * p;
+	int area = 0;
+	int i, x, y;
+
+	memset(cover, 0, sizeof(cover));
+	for(i = 0; i < rl->count; i++)
+	{
+		r = &rl->region[i];
+		if(region_isempty(r) || (r->x < 0) || (r->y < 0) || (r->x + r->w > REGION_TEST_SIZE) || (r->y + r->h > REGION_TEST_SIZE))
+			return 0;
+		if(i > 0)
+		{
+			p = &rl->region[i - 1];
+			if((r->y < p->y) || ((r->y == p->y) && ((r->h != p->h) || (r->x < p->x + p->w))) || ((r->y > p->y) && (r->y < p->y + p->h)))
+				return 0;
+		}
+		for(y = r->y; y < r->y + r->h; y++)
+		{
+			for(x = r->x; x < r->x + r->w; x++)
+			{
+				if(cover[y * REGION_TEST_SIZE + x]++)
+					return 0;
+				area++;
+			}
+		}
+	}
+	if(area != region_list_area(rl))
+		return 0;
+	for(i = 0; i < REGION_TEST_SIZE * REGION_TEST_SIZE; i++)
+	{
+		if(exact ? (cover[i] != map[i]) : (map[i] && !cover[i]))
+			return 0;
+		map[i] = cover[i];
+	}
+	return 1;
+}
+
+static int do_region(int argc, char ** argv)
+{
+	uint8_t map[REGION_TEST_SIZE * REGION_TEST_SIZE];
+	struct region_list_t * rl;
+	struct region_t r;
+	int count = 10000;
+	int op, n, i, x, y;
+	ktime_t t;
+
+	if(argc > 2)
+	{
+		usage();
+		return -1;
+	}
+	if(argc == 2)
+		count = strtol(argv[1], NULL, 0);
+	if(count <= 0)
+	{
+		usage();
+		return -1;
+	}
+	if(!(rl = region_list_alloc(0)))
+		return -1;
+
+	memset(map, 0, sizeof(map));
+	t = ktime_get();
+	for(n = 0; n < count; n++)
+	{
+		region_init(&r, rand() % REGION_TEST_SIZE, rand() % REGION_TEST_SIZE, rand() % 24 + 1, rand() % 24 + 1);
+		region_intersect(&r, &r, &(struct region_t){ 0, 0, REGION_TEST_SIZE, REGION_TEST_SIZE });
+		op = (rl->count > 0) ? rand() % 4 : 0;
+		for(y = r.y; y < r.y + r.h; y++)
+		{
+			for(x = r.x; x < r.x + r.w; x++)
+			{
+				i = y * REGION_TEST_SIZE + x;
+				if(op < 2)
+					map[i] = 1;
+				else if(op == 2)
+					map[i] = 0;
+			}
+		}
+		if(op == 3)
+		{
+			for(i = 0; i < REGION_TEST_SIZE * REGION_TEST_SIZE; i++)
+			{
+				x = i % REGION_TEST_SIZE;
+				y = i / REGION_TEST_SIZE;
+				if((x < r.x) || (x >= r.x + r.w) || (y < r.y) || (y >= r.y + r.h))
+					map[i] = 0;
+			}
+		}
+		if(op < 2)
+			region_list_add(rl, &r);
+		else if(op == 2)
+			region_list_subtract(rl, &r);
+		else
+			region_list_intersect(rl, &r);
+		if(!region_test_check(rl, map, op >= 2))
+		{
+			printf("region: %s of [%d %d %d %d] failed at step %d\r\n", (op < 2) ? "union" : ((op == 2) ? "subtract" : "intersect"), r.x, r.y, r.w, r.h, n);
+			region_list_free(rl);
+			return -1;
+		}
+	}
+	t = ktime_sub(ktime_get(), t);
+	printf("region: %d ops in %llu us, ok\r\n", count, (unsigned long long)ktime_to_us(t));
+	region_list_free(rl);
+	return 0;
+}
+
+static struct command_t cmd_region = {
+	.name	= "region",
+	.desc	= "self test of the region list algebra",
+	.usage	= usage,
+	.exec	= do_region,
+};
+
+static __init void region_cmd_init(void)
+{
+	register_command(&cmd_region);
+}
+
+static __exit void region_cmd_exit(void)
+{
+	unregister_command(&cmd_region);
+}
+
+command_initcall(region_cmd_init);
+command_exitcall(region_cmd_exit);
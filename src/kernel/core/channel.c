@@ -29,7 +29,7 @@
 #include <xboot.h>
 #include <xboot/channel.h>
 
-struct channel_t * channel_alloc(unsigned int size)
+struct channel_t * channel_alloc_with_type(unsigned int size, enum channel_type_t type)
 {
 	struct channel_t * c;
 
@@ -49,6 +49,8 @@ struct channel_t * channel_alloc(unsigned int size)
 	c->size = size;
 	c->in = 0;
 	c->out = 0;
+	atomic_set(&c->reserve, 0);
+	c->type = type;
 	init_list_head(&c->swait);
 	init_list_head(&c->rwait);
 	spin_lock_init(&c->lock);
@@ -56,6 +58,11 @@ struct channel_t * channel_alloc(unsigned int size)
 	return c;
 }
 
+struct channel_t * channel_alloc(unsigned int size)
+{
+	return channel_alloc_with_type(size, CHANNEL_TYPE_MPMC);
+}
+
 void channel_free(struct channel_t * c)
 {
 	if(c)
@@ -65,214 +72,324 @@ void channel_free(struct channel_t * c)
 	}
 }
 
-static inline int channel_isempty(struct channel_t * c)
+static inline unsigned int channel_vec_len(struct channel_vec_t * vec, int n)
 {
-	int ret;
+	unsigned int len = 0;
+	int i;
 
-	spin_lock(&c->lock);
-	ret = (c->in - c->out <= 0) ? 1 : 0;
-	spin_unlock(&c->lock);
-
-	return ret;
+	for(i = 0; i < n; i++)
+		len += vec[i].len;
+	return len;
 }
 
-static inline int channel_isfull(struct channel_t * c)
+static inline void channel_copy_in(struct channel_t * c, unsigned int pos, struct channel_vec_t * vec, int n, unsigned int skip, unsigned int len)
 {
-	int ret;
-
-	spin_lock(&c->lock);
-	ret = (c->in - c->out >= c->size) ? 1 : 0;
-	spin_unlock(&c->lock);
+	unsigned int off, l, k;
+	int i;
 
-	return ret;
+	for(i = 0; (i < n) && (len > 0); i++)
+	{
+		if(skip >= vec[i].len)
+		{
+			skip -= vec[i].len;
+			continue;
+		}
+		l = min(len, vec[i].len - skip);
+		off = pos & (c->size - 1);
+		k = min(l, c->size - off);
+		memcpy(c->buffer + off, vec[i].buf + skip, k);
+		memcpy(c->buffer, vec[i].buf + skip + k, l - k);
+		pos += l;
+		len -= l;
+		skip = 0;
+	}
 }
 
-static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+static inline void channel_copy_out(struct channel_t * c, unsigned int pos, struct channel_vec_t * vec, int n, unsigned int skip, unsigned int len)
 {
-	unsigned int l;
-
-	spin_lock(&c->lock);
-	len = min(len, c->size - c->in + c->out);
-	smp_mb();
-	l = min(len, c->size - (c->in & (c->size - 1)));
-	memcpy(c->buffer + (c->in & (c->size - 1)), buf, l);
-	memcpy(c->buffer, buf + l, len - l);
-	smp_wmb();
-	c->in += len;
-	spin_unlock(&c->lock);
+	unsigned int off, l, k;
+	int i;
 
-	return len;
+	for(i = 0; (i < n) && (len > 0); i++)
+	{
+		if(skip >= vec[i].len)
+		{
+			skip -= vec[i].len;
+			continue;
+		}
+		l = min(len, vec[i].len - skip);
+		off = pos & (c->size - 1);
+		k = min(l, c->size - off);
+		memcpy(vec[i].buf + skip, c->buffer + off, k);
+		memcpy(vec[i].buf + skip + k, c->buffer, l - k);
+		pos += l;
+		len -= l;
+		skip = 0;
+	}
 }
 
-static inline unsigned int __channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+/*
+ * Pick a single waiter, the caller must hold the channel lock
+ */
+static inline struct task_t * channel_pick_reader(struct channel_t * c)
 {
-	unsigned int l;
+	struct task_t * t = NULL;
 
-	spin_lock(&c->lock);
-	len = min(len, c->in - c->out);
-	smp_rmb();
-	l = min(len, c->size - (c->out & (c->size - 1)));
-	memcpy(buf, c->buffer + (c->out & (c->size - 1)), l);
-	memcpy(buf + l, c->buffer, len - l);
-	smp_mb();
-	c->out += len;
-	spin_unlock(&c->lock);
+	if(!list_empty(&c->rwait))
+	{
+		t = list_first_entry(&c->rwait, struct task_t, rlist);
+		list_del_init(&t->rlist);
+	}
+	return t;
+}
 
-	return len;
+static inline struct task_t * channel_pick_sender(struct channel_t * c)
+{
+	struct task_t * t = NULL;
+
+	if(!list_empty(&c->swait))
+	{
+		t = list_first_entry(&c->swait, struct task_t, slist);
+		list_del_init(&t->slist);
+	}
+	return t;
 }
 
-static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+/*
+ * Wake one reader when data is available and one sender when space is left,
+ * the lock is only taken if someone is actually waiting. Waiters are taken off
+ * the list and woken through their sticky wakeup flag, so a waiter that has not
+ * gone to sleep yet returns from task_sleep at once instead of missing it.
+ */
+static inline void channel_wakeup(struct channel_t * c, int reader, int sender)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
-	unsigned int l;
+	struct task_t * r = NULL, * s = NULL;
 
-	if(channel_isfull(c))
+	smp_mb();
+	if((reader && !list_empty_careful(&c->rwait)) || (sender && !list_empty_careful(&c->swait)))
 	{
-		self = task_self();
 		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(list_empty_careful(&self->slist))
-		{
-			list_add_tail(&self->slist, &c->swait);
-		}
+		if(reader)
+			r = channel_pick_reader(c);
+		if(sender)
+			s = channel_pick_sender(c);
 		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_put(c, buf, len);
+		if(r)
+			task_wakeup(r);
+		if(s)
+			task_wakeup(s);
 	}
-	else if(channel_isempty(c))
+}
+
+static unsigned int channel_putv(struct channel_t * c, struct channel_vec_t * vec, int n, unsigned int skip, unsigned int len)
+{
+	struct task_t * r = NULL, * s = NULL;
+	unsigned int pos, l;
+	int p;
+
+	switch(c->type)
 	{
-		l = __channel_put(c, buf, len);
-		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
+	case CHANNEL_TYPE_SPSC:
+		pos = c->in;
+		smp_mb();
+		l = min(len, c->size - (pos - c->out));
+		if(l > 0)
 		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
+			channel_copy_in(c, pos, vec, n, skip, l);
+			smp_wmb();
+			c->in = pos + l;
 		}
-		if(!list_empty(&c->swait))
+		channel_wakeup(c, l > 0, (l > 0) && (pos + l - c->out < c->size));
+		break;
+
+	case CHANNEL_TYPE_MPSC:
+		do {
+			p = atomic_get(&c->reserve);
+			l = min(len, c->size - ((unsigned int)p - c->out));
+			if(l == 0)
+				break;
+		} while(atomic_cmpxchg(&c->reserve, p, (int)((unsigned int)p + l)) != p);
+		if(l > 0)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			pos = (unsigned int)p;
+			channel_copy_in(c, pos, vec, n, skip, l);
+			smp_wmb();
+			while(*((volatile unsigned int *)&c->in) != pos);
+			c->in = pos + l;
 		}
-		spin_unlock(&c->lock);
-	}
-	else
-	{
-		l = __channel_put(c, buf, len);
+		channel_wakeup(c, l > 0, (l > 0) && (pos + l - c->out < c->size));
+		break;
+
+	case CHANNEL_TYPE_MPMC:
+	default:
 		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
+		pos = c->in;
+		l = min(len, c->size - (pos - c->out));
+		if(l > 0)
 		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
+			channel_copy_in(c, pos, vec, n, skip, l);
+			c->in = pos + l;
+			r = channel_pick_reader(c);
+			if(c->in - c->out < c->size)
+				s = channel_pick_sender(c);
 		}
 		spin_unlock(&c->lock);
+		if(r)
+			task_wakeup(r);
+		if(s)
+			task_wakeup(s);
+		break;
 	}
 	return l;
 }
 
-static inline unsigned int channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+static unsigned int channel_getv(struct channel_t * c, struct channel_vec_t * vec, int n, unsigned int skip, unsigned int len)
 {
-	struct task_t * self;
-	struct task_t * pos, * n;
-	unsigned int l;
+	struct task_t * r = NULL, * s = NULL;
+	unsigned int pos, l;
 
-	if(channel_isempty(c))
+	switch(c->type)
 	{
-		self = task_self();
-		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
+	case CHANNEL_TYPE_SPSC:
+	case CHANNEL_TYPE_MPSC:
+		pos = c->out;
+		l = min(len, c->in - pos);
+		smp_rmb();
+		if(l > 0)
 		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
+			channel_copy_out(c, pos, vec, n, skip, l);
+			smp_mb();
+			c->out = pos + l;
 		}
-		if(list_empty_careful(&self->rlist))
+		channel_wakeup(c, (l > 0) && (c->in != pos + l), l > 0);
+		break;
+
+	case CHANNEL_TYPE_MPMC:
+	default:
+		spin_lock(&c->lock);
+		pos = c->out;
+		l = min(len, c->in - pos);
+		if(l > 0)
 		{
-			list_add_tail(&self->rlist, &c->rwait);
+			channel_copy_out(c, pos, vec, n, skip, l);
+			c->out = pos + l;
+			s = channel_pick_sender(c);
+			if(c->in != c->out)
+				r = channel_pick_reader(c);
 		}
 		spin_unlock(&c->lock);
-		task_suspend(self);
-		l = __channel_get(c, buf, len);
+		if(r)
+			task_wakeup(r);
+		if(s)
+			task_wakeup(s);
+		break;
 	}
-	else if(channel_isfull(c))
+	return l;
+}
+
+/*
+ * Queue the caller and check the ring under the lock, then sleep until a peer
+ * takes it off the wait list. Producers of a mpsc channel claim space on the
+ * reserve cursor, so that is what decides whether the ring is full.
+ */
+static void channel_wait_sender(struct channel_t * c)
+{
+	struct task_t * self = task_self();
+	struct task_t * r;
+	unsigned int in;
+	int full;
+
+	spin_lock(&c->lock);
+	if(list_empty_careful(&self->slist))
+		list_add_tail(&self->slist, &c->swait);
+	smp_mb();
+	in = (c->type == CHANNEL_TYPE_MPSC) ? (unsigned int)atomic_get(&c->reserve) : c->in;
+	full = (in - c->out >= c->size) ? 1 : 0;
+	if(!full)
+		list_del_init(&self->slist);
+	r = channel_pick_reader(c);
+	spin_unlock(&c->lock);
+	if(r)
+		task_wakeup(r);
+	if(full)
 	{
-		l = __channel_get(c, buf, len);
+		task_sleep(UINT64_MAX);
 		spin_lock(&c->lock);
-		if(!list_empty(&c->rwait))
-		{
-			list_for_each_entry_safe(pos, n, &c->rwait, rlist)
-			{
-				list_del_init(&pos->rlist);
-				task_resume(pos);
-			}
-		}
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
+		list_del_init(&self->slist);
 		spin_unlock(&c->lock);
 	}
-	else
+}
+
+static void channel_wait_reader(struct channel_t * c)
+{
+	struct task_t * self = task_self();
+	struct task_t * s;
+	int empty;
+
+	spin_lock(&c->lock);
+	if(list_empty_careful(&self->rlist))
+		list_add_tail(&self->rlist, &c->rwait);
+	smp_mb();
+	empty = (c->in == c->out) ? 1 : 0;
+	if(!empty)
+		list_del_init(&self->rlist);
+	s = channel_pick_sender(c);
+	spin_unlock(&c->lock);
+	if(s)
+		task_wakeup(s);
+	if(empty)
 	{
-		l = __channel_get(c, buf, len);
+		task_sleep(UINT64_MAX);
 		spin_lock(&c->lock);
-		if(!list_empty(&c->swait))
-		{
-			list_for_each_entry_safe(pos, n, &c->swait, slist)
-			{
-				list_del_init(&pos->slist);
-				task_resume(pos);
-			}
-		}
+		list_del_init(&self->rlist);
 		spin_unlock(&c->lock);
 	}
-	return l;
 }
 
-void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_sendv(struct channel_t * c, struct channel_vec_t * vec, int n)
 {
-	unsigned int l = 0;
+	unsigned int len, l = 0;
 
-	if(c && buf)
+	if(c && vec && (n > 0))
 	{
-		do {
-			l += channel_put(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
+		len = channel_vec_len(vec, n);
+		while(l < len)
+		{
+			l += channel_putv(c, vec, n, l, len - l);
+			if(l < len)
+				channel_wait_sender(c);
+		}
 	}
 }
 
-void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_recvv(struct channel_t * c, struct channel_vec_t * vec, int n)
 {
-	unsigned int l = 0;
+	unsigned int len, l = 0;
 
-	if(c && buf)
+	if(c && vec && (n > 0))
 	{
-		do {
-			l += channel_get(c, buf + l, len - l);
-			task_yield();
-		} while(l < len);
+		len = channel_vec_len(vec, n);
+		while(l < len)
+		{
+			l += channel_getv(c, vec, n, l, len - l);
+			if(l < len)
+				channel_wait_reader(c);
+		}
 	}
 }
+
+void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	struct channel_vec_t vec = { buf, len };
+
+	if(buf)
+		channel_sendv(c, &vec, 1);
+}
+
+void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	struct channel_vec_t vec = { buf, len };
+
+	if(buf)
+		channel_recvv(c, &vec, 1);
+}
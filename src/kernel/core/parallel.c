@@ -0,0 +1,134 @@
+/*
+ * kernel/core/parallel.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/parallel.h>
+
+/*
+ * One helper task per cpu. The caller publishes a job, wakes the helpers
+ * and takes chunks itself, so the job always completes even if a helper
+ * misses its wakeup or its cpu never came up.
+ */
+static struct task_t * __parallel_worker[CONFIG_MAX_SMP_CPUS] = { 0 };
+static struct parallel_job_t * volatile __parallel_job = NULL;
+static atomic_t __parallel_active = { 0 };
+static atomic_t __parallel_busy = { 0 };
+
+static void parallel_run(struct parallel_job_t * job)
+{
+	int start, end;
+
+	while(1)
+	{
+		start = atomic_add_return(&job->next, job->grain) - job->grain;
+		if(start >= job->count)
+			break;
+		end = start + job->grain;
+		if(end > job->count)
+			end = job->count;
+		job->func(start, end, job->data);
+	}
+}
+
+static void parallel_worker_task(struct task_t * task, void * data)
+{
+	struct parallel_job_t * job;
+
+	while(1)
+	{
+		atomic_inc(&__parallel_active);
+		smp_mb();
+		job = __parallel_job;
+		if(job)
+			parallel_run(job);
+		atomic_dec(&__parallel_active);
+		task_suspend(task);
+	}
+}
+
+int parallel_cpus(void)
+{
+	int i, n = 0;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if(__sched[i].idle)
+			n++;
+	}
+	return (n > 0) ? n : 1;
+}
+
+void parallel_for(int count, int grain, parallel_func_t func, void * data)
+{
+	struct parallel_job_t job;
+	struct task_t * task;
+	int cpu, i, n;
+
+	if(!func || (count <= 0))
+		return;
+	n = parallel_cpus();
+	if(grain <= 0)
+		grain = max(count / (n * 4), 1);
+	if((n <= 1) || (count <= grain) || (atomic_cmpxchg(&__parallel_busy, 0, 1) != 0))
+	{
+		func(0, count, data);
+		return;
+	}
+
+	job.func = func;
+	job.data = data;
+	job.count = count;
+	job.grain = grain;
+	atomic_set(&job.next, 0);
+	__parallel_job = &job;
+	smp_mb();
+
+	cpu = smp_processor_id();
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((i == cpu) || !__sched[i].idle)
+			continue;
+		task = __parallel_worker[i];
+		if(!task)
+		{
+			task = task_create(&__sched[i], "parallel", parallel_worker_task, NULL, 0, 0);
+			__parallel_worker[i] = task;
+		}
+		task_resume(task);
+	}
+	parallel_run(&job);
+
+	/*
+	 * Retract the job, then wait for helpers still inside a chunk
+	 */
+	__parallel_job = NULL;
+	smp_mb();
+	while(atomic_get(&__parallel_active) != 0)
+		task_yield();
+	atomic_set(&__parallel_busy, 0);
+}
@@ -41,6 +41,8 @@ extern struct transfer_t jump_fcontext(void * fctx, void * priv);
 struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 EXPORT_SYMBOL(__sched);
 
+static struct kmem_cache_t * __task_cache = NULL;
+
 static const int nice_to_weight[40] = {
  /* -20 */     88761,     71755,     56483,     46273,     36291,
  /* -15 */     29154,     23254,     18705,     14949,     11916,
@@ -145,6 +147,8 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 
 	rb_link_node(&task->node, parent, link);
 	rb_insert_color_cached(&task->node, &sched->ready, leftmost);
+	if(task != sched->idle)
+		sched->nready++;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -159,6 +163,8 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 	struct task_t * next;
 
 	rb_erase_cached(&task->node, &sched->ready);
+	if(task != sched->idle)
+		sched->nready--;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
@@ -168,13 +174,61 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 		sched->min_vtime = 0;
 }
 
+static inline void task_release(struct task_t * task)
+{
+	if(task->name)
+		free(task->name);
+	free(task->stack);
+	kmem_cache_free(__task_cache, task);
+}
+
+/*
+ * An exiting task can't free its own stack and descriptor, it parks itself as
+ * the zombie of its scheduler and the task switched to releases it here.
+ */
+static inline void scheduler_finish_switch(struct transfer_t from)
+{
+	struct scheduler_t * sched = scheduler_self();
+	struct task_t * t = (struct task_t *)from.priv;
+
+	if(unlikely(sched->zombie == t))
+	{
+		sched->zombie = NULL;
+		task_release(t);
+		return;
+	}
+	t->fctx = from.fctx;
+	if(t != scheduler_self()->running)
+	{
+		smp_wmb();
+		t->oncpu = 0;
+	}
+}
+
 static inline void scheduler_switch_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct task_t * running = sched->running;
 	sched->running = task;
-	struct transfer_t from = jump_fcontext(task->fctx, running);
-	struct task_t * t = (struct task_t *)from.priv;
-	t->fctx = from.fctx;
+	task->oncpu = 1;
+	scheduler_finish_switch(jump_fcontext(task->fctx, running));
+}
+
+/*
+ * Lock the scheduler owning a task. A ready task may be migrated while we
+ * wait for the lock, so check the owner again once it is held.
+ */
+static inline struct scheduler_t * task_lock_sched(struct task_t * task)
+{
+	struct scheduler_t * sched;
+
+	while(1)
+	{
+		sched = *((struct scheduler_t * volatile *)&task->sched);
+		spin_lock(&sched->lock);
+		if(likely(task->sched == sched))
+			return sched;
+		spin_unlock(&sched->lock);
+	}
 }
 
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
@@ -194,20 +248,91 @@ static inline struct scheduler_t * scheduler_load_balance_choice(void)
 	return sched;
 }
 
+#if (CONFIG_MAX_SMP_CPUS > 1) && (CONFIG_SCHED_WORK_STEALING > 0)
+/*
+ * Pull one ready task from the busiest peer scheduler, if that peer has at
+ * least 'imbalance' more waiting tasks than we do. The victim is taken from
+ * the right end of the peer's tree, the task that would wait there longest.
+ * Tasks still on a cpu (saving their context) and idle tasks never migrate.
+ */
+static int scheduler_pull_task(struct scheduler_t * sched, uint64_t imbalance)
+{
+	struct scheduler_t * busiest = NULL;
+	struct task_t * task = NULL, * pos;
+	struct rb_node * rn;
+	uint64_t nready = sched->nready + imbalance - 1;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((&__sched[i] != sched) && (__sched[i].nready > nready))
+		{
+			busiest = &__sched[i];
+			nready = __sched[i].nready;
+		}
+	}
+	if(!busiest)
+		return 0;
+
+	/*
+	 * Hold both runqueues, in address order, so the task moves between
+	 * them atomically and task_lock_sched never sees it in transit
+	 */
+	if(sched < busiest)
+	{
+		spin_lock(&sched->lock);
+		spin_lock(&busiest->lock);
+	}
+	else
+	{
+		spin_lock(&busiest->lock);
+		spin_lock(&sched->lock);
+	}
+	for(rn = rb_last(&busiest->ready.rb_root); rn; rn = rb_prev(rn))
+	{
+		pos = rb_entry(rn, struct task_t, node);
+		smp_rmb();
+		if((pos != busiest->idle) && !pos->oncpu)
+		{
+			task = pos;
+			break;
+		}
+	}
+	if(task)
+	{
+		scheduler_dequeue_task(busiest, task);
+		busiest->weight -= task->weight;
+		task->vtime -= busiest->min_vtime;
+		task->vtime += sched->min_vtime;
+		task->sched = sched;
+		sched->weight += task->weight;
+		sched->nmigrate++;
+		scheduler_enqueue_task(sched, task);
+	}
+	spin_unlock(&busiest->lock);
+	spin_unlock(&sched->lock);
+	return task ? 1 : 0;
+}
+#endif
+
 static void fcontext_entry_func(struct transfer_t from)
 {
-	struct task_t * t = (struct task_t *)from.priv;
-	struct scheduler_t * sched = t->sched;
+	struct scheduler_t * sched = scheduler_self();
 	struct task_t * next, * task = sched->running;
 
-	t->fctx = from.fctx;
+	scheduler_finish_switch(from);
 	task->func(task, task->data);
-	task_destroy(task);
 
+	sched = scheduler_self();
+	spin_lock(&sched->lock);
+	sched->weight -= nice_to_weight[task->nice + 20];
+	sched->zombie = task;
 	next = scheduler_next_ready_task(sched);
 	if(likely(next))
-	{
 		scheduler_dequeue_task(sched, next);
+	spin_unlock(&sched->lock);
+	if(likely(next))
+	{
 		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
@@ -233,14 +358,14 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 	else if(nice > 19)
 		nice = 19;
 
-	task = malloc(sizeof(struct task_t));
+	task = kmem_cache_alloc(__task_cache);
 	if(!task)
 		return NULL;
 
 	stack = malloc(stksz);
 	if(!stack)
 	{
-		free(task);
+		kmem_cache_free(__task_cache, task);
 		return NULL;
 	}
 
@@ -256,9 +381,12 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 	task->name = strdup(name);
 	task->status = TASK_STATUS_SUSPEND;
+	task->oncpu = 0;
 	task->start = ktime_to_ns(ktime_get());
 	task->time = 0;
 	task->vtime = 0;
+	task->wtime = 0;
+	atomic_set(&task->wakeup, 0);
 	task->sched = sched;
 	task->stack = stack;
 	task->stksz = stksz;
@@ -275,21 +403,21 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 
 void task_destroy(struct task_t * task)
 {
+	struct scheduler_t * sched;
+
 	if(task)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		spin_unlock(&task->sched->lock);
-
-		if(task->name)
-			free(task->name);
-		free(task->stack);
-		free(task);
+		sched = task_lock_sched(task);
+		sched->weight -= nice_to_weight[task->nice + 20];
+		spin_unlock(&sched->lock);
+		task_release(task);
 	}
 }
 
 void task_renice(struct task_t * task, int nice)
 {
+	struct scheduler_t * sched;
+
 	if(nice < -20)
 		nice = -20;
 	else if(nice > 19)
@@ -297,19 +425,19 @@ void task_renice(struct task_t * task, int nice)
 
 	if(task->nice != nice)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice + 20];
-		task->sched->weight += nice_to_weight[nice + 20];
-		spin_unlock(&task->sched->lock);
-
+		sched = task_lock_sched(task);
+		sched->weight -= nice_to_weight[task->nice + 20];
+		sched->weight += nice_to_weight[nice + 20];
 		task->nice = nice;
 		task->weight = nice_to_weight[nice + 20];
 		task->inv_weight = nice_to_wmult[nice + 20];
+		spin_unlock(&sched->lock);
 	}
 }
 
 void task_suspend(struct task_t * task)
 {
+	struct scheduler_t * sched;
 	struct task_t * next;
 	uint64_t now, detla;
 
@@ -317,11 +445,14 @@ void task_suspend(struct task_t * task)
 	{
 		if(task->status == TASK_STATUS_READY)
 		{
-			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
-			scheduler_dequeue_task(task->sched, task);
+			sched = task_lock_sched(task);
+			if(task->status == TASK_STATUS_READY)
+			{
+				task->status = TASK_STATUS_SUSPEND;
+				list_add_tail(&task->list, &sched->suspend);
+				scheduler_dequeue_task(sched, task);
+			}
+			spin_unlock(&sched->lock);
 		}
 		else if(task->status == TASK_STATUS_RUNNING)
 		{
@@ -330,18 +461,19 @@ void task_suspend(struct task_t * task)
 
 			task->time += detla;
 			task->vtime += calc_delta_fair(task, detla);
+			sched = task_lock_sched(task);
 			task->status = TASK_STATUS_SUSPEND;
-			spin_lock(&task->sched->lock);
-			list_add_tail(&task->list, &task->sched->suspend);
-			spin_unlock(&task->sched->lock);
+			list_add_tail(&task->list, &sched->suspend);
+			next = scheduler_next_ready_task(sched);
+			if(next)
+				scheduler_dequeue_task(sched, next);
+			spin_unlock(&sched->lock);
 
-			next = scheduler_next_ready_task(task->sched);
 			if(next)
 			{
-				scheduler_dequeue_task(task->sched, next);
 				next->status = TASK_STATUS_RUNNING;
 				next->start = now;
-				scheduler_switch_task(task->sched, next);
+				scheduler_switch_task(sched, next);
 			}
 		}
 	}
@@ -349,14 +481,44 @@ void task_suspend(struct task_t * task)
 
 void task_resume(struct task_t * task)
 {
+	struct scheduler_t * sched;
+
 	if(task && (task->status == TASK_STATUS_SUSPEND))
 	{
-		task->vtime = task->sched->min_vtime;
-		task->status = TASK_STATUS_READY;
-		spin_lock(&task->sched->lock);
-		list_del_init(&task->list);
-		spin_unlock(&task->sched->lock);
-		scheduler_enqueue_task(task->sched, task);
+		sched = task_lock_sched(task);
+		if(task->status == TASK_STATUS_SUSPEND)
+		{
+			task->vtime = sched->min_vtime;
+			task->status = TASK_STATUS_READY;
+			list_del_init(&task->list);
+			scheduler_enqueue_task(sched, task);
+		}
+		spin_unlock(&sched->lock);
+	}
+}
+
+/*
+ * Sleeping tasks are woken here, in task context, so task_wakeup only has
+ * to raise a flag and is safe to call from interrupt handlers and timers.
+ */
+static void scheduler_wake_sleepers(struct scheduler_t * sched, uint64_t now)
+{
+	struct task_t * pos, * n;
+
+	if(!list_empty(&sched->sleep))
+	{
+		spin_lock(&sched->lock);
+		list_for_each_entry_safe(pos, n, &sched->sleep, list)
+		{
+			if((atomic_cmpxchg(&pos->wakeup, 1, 0) == 1) || (now >= pos->wtime))
+			{
+				pos->vtime = sched->min_vtime;
+				pos->status = TASK_STATUS_READY;
+				list_del_init(&pos->list);
+				scheduler_enqueue_task(sched, pos);
+			}
+		}
+		spin_unlock(&sched->lock);
 	}
 }
 
@@ -369,6 +531,15 @@ void task_yield(void)
 
 	self->time += detla;
 	self->vtime += calc_delta_fair(self, detla);
+	scheduler_wake_sleepers(sched, now);
+
+#if (CONFIG_MAX_SMP_CPUS > 1) && (CONFIG_SCHED_WORK_STEALING > 0)
+	if(now - sched->balance >= (uint64_t)CONFIG_SCHED_BALANCE_INTERVAL * 1000000ULL)
+	{
+		sched->balance = now;
+		scheduler_pull_task(sched, 2);
+	}
+#endif
 
 	if((int64_t)(self->vtime - sched->min_vtime) < 0)
 	{
@@ -377,9 +548,11 @@ void task_yield(void)
 	else
 	{
 		self->status = TASK_STATUS_READY;
+		spin_lock(&sched->lock);
 		scheduler_enqueue_task(sched, self);
 		next = scheduler_next_ready_task(sched);
 		scheduler_dequeue_task(sched, next);
+		spin_unlock(&sched->lock);
 		next->status = TASK_STATUS_RUNNING;
 		next->start = now;
 		if(likely(next != self))
@@ -387,6 +560,42 @@ void task_yield(void)
 	}
 }
 
+void task_sleep(uint64_t timeout)
+{
+	struct scheduler_t * sched = scheduler_self();
+	struct task_t * next, * self = task_self();
+	uint64_t now, detla;
+
+	if(atomic_cmpxchg(&self->wakeup, 1, 0) == 1)
+		return;
+
+	now = ktime_to_ns(ktime_get());
+	detla = now - self->start;
+	self->time += detla;
+	self->vtime += calc_delta_fair(self, detla);
+	self->wtime = (now + timeout < now) ? UINT64_MAX : now + timeout;
+	spin_lock(&sched->lock);
+	self->status = TASK_STATUS_SUSPEND;
+	list_add_tail(&self->list, &sched->sleep);
+	next = scheduler_next_ready_task(sched);
+	if(next)
+		scheduler_dequeue_task(sched, next);
+	spin_unlock(&sched->lock);
+
+	if(next)
+	{
+		next->status = TASK_STATUS_RUNNING;
+		next->start = now;
+		scheduler_switch_task(sched, next);
+	}
+}
+
+void task_wakeup(struct task_t * task)
+{
+	if(task)
+		atomic_set(&task->wakeup, 1);
+}
+
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data)
 {
 	struct task_data_t * td;
@@ -416,6 +625,10 @@ static void idle_task(struct task_t * task, void * data)
 {
 	while(1)
 	{
+#if (CONFIG_MAX_SMP_CPUS > 1) && (CONFIG_SCHED_WORK_STEALING > 0)
+		if(task->sched->nready == 0)
+			scheduler_pull_task(task->sched, 1);
+#endif
 		task_yield();
 	}
 }
@@ -432,14 +645,20 @@ static void smpboot_entry_func(void)
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
+	sched->idle = task;
 	spin_unlock(&sched->lock);
 	task_resume(task);
 
+	spin_lock(&sched->lock);
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(next)
 	{
 		sched->running = next;
 		scheduler_dequeue_task(sched, next);
+	}
+	spin_unlock(&sched->lock);
+	if(next)
+	{
 		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
@@ -458,14 +677,20 @@ void scheduler_loop(void)
 	task->weight = 3;
 	task->inv_weight = 1431655765;
 	sched->weight += task->weight;
+	sched->idle = task;
 	spin_unlock(&sched->lock);
 	task_resume(task);
 
+	spin_lock(&sched->lock);
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(next)
 	{
 		sched->running = next;
 		scheduler_dequeue_task(sched, next);
+	}
+	spin_unlock(&sched->lock);
+	if(next)
+	{
 		next->status = TASK_STATUS_RUNNING;
 		next->start = ktime_to_ns(ktime_get());
 		scheduler_switch_task(sched, next);
@@ -477,6 +702,7 @@ void do_init_sched(void)
 	struct scheduler_t * sched;
 	int i;
 
+	__task_cache = kmem_cache_create("task", sizeof(struct task_t), 0);
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
 	{
 		sched = &__sched[i];
@@ -485,9 +711,15 @@ void do_init_sched(void)
 		spin_lock(&sched->lock);
 		sched->ready = RB_ROOT_CACHED;
 		init_list_head(&sched->suspend);
+		init_list_head(&sched->sleep);
 		sched->running = NULL;
+		sched->idle = NULL;
+		sched->zombie = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
+		sched->nready = 0;
+		sched->balance = 0;
+		sched->nmigrate = 0;
 		spin_unlock(&sched->lock);
 	}
 }
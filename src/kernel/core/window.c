@@ -65,6 +65,7 @@ static struct framebuffer_t fb_dummy = {
 	.create		= fb_dummy_create,
 	.destroy	= fb_dummy_destroy,
 	.present	= fb_dummy_present,
+	.acquire	= NULL,
 	.priv		= NULL,
 };
 
@@ -224,6 +225,7 @@ struct window_t * window_alloc(const char * fb, const char * input)
 	struct device_t * pos, * n;
 	char * r, * p = (char *)input;
 	int range[2];
+	int i;
 
 	if(!wm)
 		return NULL;
@@ -236,6 +238,8 @@ struct window_t * window_alloc(const char * fb, const char * input)
 	w->wm = wm;
 	w->s = framebuffer_create_surface(w->wm->fb);
 	w->rl = region_list_alloc(0);
+	for(i = 0; i < CONFIG_FRAMEBUFFER_MAX_BUFFERS; i++)
+		w->hrl[i] = region_list_alloc(0);
 	w->event = fifo_alloc(sizeof(struct event_t) * CONFIG_EVENT_FIFO_SIZE);
 	w->launcher = 0;
 	if(p)
@@ -280,6 +284,8 @@ struct window_t * window_alloc(const char * fb, const char * input)
 
 void window_free(struct window_t * w)
 {
+	int i;
+
 	if(!w || !w->wm)
 		return;
 
@@ -294,6 +300,8 @@ void window_free(struct window_t * w)
 	hmap_free(w->map, NULL);
 	framebuffer_destroy_surface(w->wm->fb, w->s);
 	region_list_free(w->rl);
+	for(i = 0; i < CONFIG_FRAMEBUFFER_MAX_BUFFERS; i++)
+		region_list_free(w->hrl[i]);
 	free(w);
 }
 
@@ -305,6 +313,7 @@ void window_to_front(struct window_t * w)
 		list_move(&w->list, &w->wm->window);
 		w->wm->refresh = 1;
 		spin_unlock(&w->wm->lock);
+		window_wakeup(w);
 	}
 }
 
@@ -316,6 +325,7 @@ void window_to_back(struct window_t * w)
 		list_move_tail(&w->list, &w->wm->window);
 		w->wm->refresh = 1;
 		spin_unlock(&w->wm->lock);
+		window_wakeup(list_first_entry(&w->wm->window, struct window_t, list));
 	}
 }
 
@@ -342,11 +352,12 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 	struct window_manager_t * wm = w->wm;
 	struct surface_t * s = w->s;
 	struct region_t * r;
+	struct region_list_t * hrl;
 	struct matrix_t m;
 	uint32_t * p, * q;
 	int x1, y1, x2, y2;
 	int l, x, y;
-	int n, i;
+	int n, i, age;
 
 	if(wm->refresh)
 	{
@@ -368,6 +379,40 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 			wm->cursor.dirty = 0;
 		}
 	}
+
+	/*
+	 * Rendering in place, the bound buffer misses the damage of the frames
+	 * presented since it was last shown, so carry that damage forward
+	 */
+	age = framebuffer_acquire_surface(wm->fb, s);
+	if(age >= 0)
+	{
+		hrl = w->hrl[CONFIG_FRAMEBUFFER_MAX_BUFFERS - 1];
+		for(i = CONFIG_FRAMEBUFFER_MAX_BUFFERS - 1; i > 0; i--)
+			w->hrl[i] = w->hrl[i - 1];
+		w->hrl[0] = hrl;
+		region_list_clone(hrl, w->rl);
+		if((age == 0) || (age >= CONFIG_FRAMEBUFFER_MAX_BUFFERS))
+		{
+			region_list_clear(w->rl);
+			region_list_add(w->rl, &(struct region_t){ 0, 0, framebuffer_get_width(wm->fb), framebuffer_get_height(wm->fb) });
+		}
+		else
+		{
+			for(i = 1; i <= age; i++)
+				region_list_merge(w->rl, w->hrl[i]);
+		}
+	}
+
+	/*
+	 * The draw callback walks the whole scene once per rect, so when damage
+	 * covers most of the screen a single full rect is cheaper
+	 */
+	if((w->rl->count > 1) && (region_list_area(w->rl) >= framebuffer_get_width(wm->fb) * framebuffer_get_height(wm->fb) / 4 * 3))
+	{
+		region_list_clear(w->rl);
+		region_list_add(w->rl, &(struct region_t){ 0, 0, framebuffer_get_width(wm->fb), framebuffer_get_height(wm->fb) });
+	}
 	if((n = w->rl->count) > 0)
 	{
 		l = s->stride >> 2;
@@ -418,9 +463,20 @@ void window_exit(struct window_t * w)
 		e.type = EVENT_TYPE_SYSTEM_EXIT;
 		e.timestamp = ktime_get();
 		fifo_put(w->event, (unsigned char *)&e, sizeof(struct event_t));
+		window_wakeup(w);
 	}
 }
 
+/*
+ * Park the calling window task until an event is queued for it, someone
+ * calls window_wakeup, or the timeout in nanoseconds runs out.
+ */
+void window_wait(struct window_t * w, uint64_t timeout)
+{
+	if(w && (fifo_len(w->event) == 0))
+		task_sleep(timeout);
+}
+
 int window_pump_event(struct window_t * w, struct event_t * e)
 {
 	if(w && (fifo_get(w->event, (unsigned char *)e, sizeof(struct event_t)) == sizeof(struct event_t)))
@@ -442,6 +498,7 @@ void push_event(struct event_t * e)
 			if(w && (!w->map || hmap_search(w->map, ((struct input_t *)e->device)->name)))
 			{
 				fifo_put(w->event, (unsigned char *)e, sizeof(struct event_t));
+				window_wakeup(w);
 				switch(e->type)
 				{
 				case EVENT_TYPE_KEY_DOWN:
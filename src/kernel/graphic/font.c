@@ -245,19 +245,140 @@ static FT_Error ftcface_requester(FTC_FaceID id, FT_Library lib, FT_Pointer data
 	return -1;
 }
 
+/*
+ * Glyphs and runs keep their own copy of the family name, the hash only picks
+ * the bucket
+ */
+static inline const char * font_family_name(const char * family)
+{
+	return family ? family : "roboto-regular";
+}
+
+static inline uint32_t font_family_key(const char * family)
+{
+	const char * p = font_family_name(family);
+	uint32_t v = 5381;
+
+	while(*p)
+		v = (v << 5) + v + *p++;
+	return v;
+}
+
+static inline uint32_t font_run_hash(uint32_t family, int size, int wrap, const char * utf8)
+{
+	uint32_t v = family ^ ((uint32_t)size * 0x9e3779b1) ^ ((uint32_t)wrap * 0x85ebca6b);
+
+	while(*utf8)
+		v = (v << 5) + v + (uint8_t)(*utf8++);
+	return v;
+}
+
+static void font_run_flush(struct font_context_t * ctx)
+{
+	struct font_run_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, &ctx->rlru, entry)
+	{
+		hlist_del(&pos->node);
+		list_del(&pos->entry);
+		font_run_free(pos);
+	}
+	ctx->nrun = 0;
+}
+
+/*
+ * Drop every cached glyph and rewind the atlas pages. Runs point at glyphs,
+ * so they go too, and the generation tells a run being built to give up.
+ */
+static void font_glyph_flush(struct font_context_t * ctx)
+{
+	struct font_glyph_t * pos;
+	struct hlist_node * n;
+	int i;
+
+	for(i = 0; i < CONFIG_FONT_GLYPH_HASH_SIZE; i++)
+	{
+		hlist_for_each_entry_safe(pos, n, &ctx->glyph[i], node)
+		{
+			hlist_del(&pos->node);
+			free(pos);
+		}
+	}
+	for(i = 0; i < CONFIG_FONT_ATLAS_PAGES; i++)
+	{
+		ctx->atlas[i].x = 0;
+		ctx->atlas[i].y = 0;
+		ctx->atlas[i].h = 0;
+	}
+	font_run_flush(ctx);
+	ctx->generation++;
+}
+
+/*
+ * Shelf packer, glyphs are placed left to right on rows as tall as the
+ * tallest glyph seen on that row.
+ */
+static uint8_t * font_atlas_alloc(struct font_context_t * ctx, int w, int h)
+{
+	struct font_atlas_t * a;
+	uint8_t * p;
+	int i;
+
+	if((w > CONFIG_FONT_ATLAS_SIZE) || (h > CONFIG_FONT_ATLAS_SIZE))
+		return NULL;
+	for(i = 0; i < CONFIG_FONT_ATLAS_PAGES; i++)
+	{
+		a = &ctx->atlas[i];
+		if(!a->pixels)
+		{
+			a->pixels = malloc(CONFIG_FONT_ATLAS_SIZE * CONFIG_FONT_ATLAS_SIZE);
+			if(!a->pixels)
+				return NULL;
+			a->x = 0;
+			a->y = 0;
+			a->h = 0;
+		}
+		if(a->x + w > CONFIG_FONT_ATLAS_SIZE)
+		{
+			a->x = 0;
+			a->y += a->h;
+			a->h = 0;
+		}
+		if(a->y + h <= CONFIG_FONT_ATLAS_SIZE)
+		{
+			p = a->pixels + a->y * CONFIG_FONT_ATLAS_SIZE + a->x;
+			a->x += w;
+			if(h > a->h)
+				a->h = h;
+			return p;
+		}
+	}
+	return NULL;
+}
+
 struct font_context_t * font_context_alloc(void)
 {
 	struct font_context_t * ctx;
+	int i;
 
 	ctx = malloc(sizeof(struct font_context_t));
 	if(!ctx)
 		return NULL;
 	FT_Init_FreeType((FT_Library *)&ctx->library);
-	FTC_Manager_New((FT_Library)ctx->library, 0, 0, 0, ftcface_requester, ctx, (FTC_Manager *)&ctx->manager);
+	FTC_Manager_New((FT_Library)ctx->library, CONFIG_FONT_CACHE_MAX_FACES, CONFIG_FONT_CACHE_MAX_SIZES, CONFIG_FONT_CACHE_MAX_BYTES, ftcface_requester, ctx, (FTC_Manager *)&ctx->manager);
 	FTC_CMapCache_New((FTC_Manager)ctx->manager, (FTC_CMapCache *)&ctx->cmap);
 	FTC_SBitCache_New((FTC_Manager)ctx->manager, (FTC_SBitCache *)&ctx->sbit);
 	FTC_ImageCache_New((FTC_Manager)ctx->manager, (FTC_ImageCache *)&ctx->image);
 	init_list_head(&ctx->list);
+	for(i = 0; i < CONFIG_FONT_GLYPH_HASH_SIZE; i++)
+		init_hlist_head(&ctx->glyph[i]);
+	for(i = 0; i < CONFIG_FONT_ATLAS_PAGES; i++)
+		ctx->atlas[i].pixels = NULL;
+	for(i = 0; i < CONFIG_FONT_RUN_CACHE_SIZE; i++)
+		init_hlist_head(&ctx->run[i]);
+	init_list_head(&ctx->rlru);
+	ctx->nrun = 0;
+	ctx->generation = 0;
 
 	font_add(ctx, NULL, "roboto-thin",			"/framework/assets/fonts/Roboto-Thin.ttf");
 	font_add(ctx, NULL, "roboto-Thin-italic",	"/framework/assets/fonts/Roboto-ThinItalic.ttf");
@@ -280,9 +401,16 @@ struct font_context_t * font_context_alloc(void)
 void font_context_free(struct font_context_t * ctx)
 {
 	struct font_t * pos, * n;
+	int i;
 
 	if(ctx)
 	{
+		font_glyph_flush(ctx);
+		for(i = 0; i < CONFIG_FONT_ATLAS_PAGES; i++)
+		{
+			if(ctx->atlas[i].pixels)
+				free(ctx->atlas[i].pixels);
+		}
 		list_for_each_entry_safe(pos, n, &ctx->list, list)
 		{
 			if(pos->family)
@@ -399,6 +527,129 @@ void * font_lookup_glyph(struct font_context_t * ctx, const char * family, int s
 	return NULL;
 }
 
+struct font_glyph_t * font_glyph_lookup(struct font_context_t * ctx, const char * family, int size, uint32_t code)
+{
+	struct font_glyph_t * g;
+	struct hlist_head * h;
+	FTC_SBit sbit;
+	const char * name = font_family_name(family);
+	uint32_t key = font_family_key(family);
+	uint8_t * p;
+	int len, i;
+
+	h = &ctx->glyph[(key ^ ((uint32_t)size * 0x9e3779b1) ^ (code * 0x85ebca6b)) % CONFIG_FONT_GLYPH_HASH_SIZE];
+	hlist_for_each_entry(g, h, node)
+	{
+		if((g->code == code) && (g->size == size) && (strcmp(g->family, name) == 0))
+			return g;
+	}
+	sbit = (FTC_SBit)font_lookup_bitmap(ctx, family, size, code);
+	if(!sbit)
+		return NULL;
+	len = strlen(name);
+	g = malloc(sizeof(struct font_glyph_t) + len + 1);
+	if(!g)
+		return NULL;
+	g->family = (char *)(g + 1);
+	memcpy(g->family, name, len + 1);
+	g->code = code;
+	g->size = size;
+	g->left = sbit->left;
+	g->top = sbit->top;
+	g->width = 0;
+	g->height = 0;
+	g->pitch = CONFIG_FONT_ATLAS_SIZE;
+	g->xadvance = sbit->xadvance;
+	g->yadvance = sbit->yadvance;
+	g->buffer = NULL;
+	if((sbit->width > 0) && (sbit->height > 0) && sbit->buffer)
+	{
+		if(!(p = font_atlas_alloc(ctx, sbit->width, sbit->height)))
+		{
+			font_glyph_flush(ctx);
+			p = font_atlas_alloc(ctx, sbit->width, sbit->height);
+		}
+		if(p)
+		{
+			for(i = 0; i < sbit->height; i++)
+				memcpy(p + i * CONFIG_FONT_ATLAS_SIZE, sbit->buffer + i * sbit->pitch, sbit->width);
+			g->width = sbit->width;
+			g->height = sbit->height;
+			g->buffer = p;
+		}
+	}
+	hlist_add_head(&g->node, h);
+	return g;
+}
+
+struct font_run_t * font_run_lookup(struct font_context_t * ctx, const char * family, int size, int wrap, const char * utf8)
+{
+	struct font_run_t * run;
+	const char * name = font_family_name(family);
+	uint32_t hash = font_run_hash(font_family_key(family), size, wrap, utf8);
+
+	hlist_for_each_entry(run, &ctx->run[hash % CONFIG_FONT_RUN_CACHE_SIZE], node)
+	{
+		if((run->hash == hash) && (run->size == size) && (run->wrap == wrap) && (strcmp(run->utf8, utf8) == 0) && (strcmp(run->family, name) == 0))
+		{
+			list_move(&run->entry, &ctx->rlru);
+			return run;
+		}
+	}
+	return NULL;
+}
+
+struct font_run_t * font_run_alloc(struct font_context_t * ctx, const char * family, int size, int wrap, const char * utf8)
+{
+	struct font_run_t * run;
+	const char * name = font_family_name(family);
+	int len = strlen(utf8);
+	int flen = strlen(name);
+
+	run = malloc(sizeof(struct font_run_t) + sizeof(struct font_run_glyph_t) * len + len + 1 + flen + 1);
+	if(!run)
+		return NULL;
+	run->glyphs = (struct font_run_glyph_t *)(run + 1);
+	run->utf8 = (char *)(run->glyphs + len);
+	memcpy(run->utf8, utf8, len + 1);
+	run->family = run->utf8 + len + 1;
+	memcpy(run->family, name, flen + 1);
+	run->size = size;
+	run->wrap = wrap;
+	run->hash = font_run_hash(font_family_key(family), size, wrap, utf8);
+	run->ox = 0;
+	run->oy = 0;
+	run->width = 0;
+	run->height = 0;
+	run->count = 0;
+	init_hlist_node(&run->node);
+	init_list_head(&run->entry);
+	return run;
+}
+
+void font_run_insert(struct font_context_t * ctx, struct font_run_t * run)
+{
+	struct font_run_t * last;
+
+	if(ctx->nrun >= CONFIG_FONT_RUN_CACHE_SIZE)
+	{
+		last = list_last_entry(&ctx->rlru, struct font_run_t, entry);
+		hlist_del(&last->node);
+		list_del(&last->entry);
+		font_run_free(last);
+		ctx->nrun--;
+	}
+	hlist_add_head(&run->node, &ctx->run[run->hash % CONFIG_FONT_RUN_CACHE_SIZE]);
+	list_add(&run->entry, &ctx->rlru);
+	ctx->nrun++;
+}
+
+void font_run_free(struct font_run_t * run)
+{
+	if(run)
+		free(run);
+}
+
 void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const char * family, const char * path)
 {
 	struct vfs_stat_t st;
@@ -429,6 +680,7 @@ void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const cha
 			f->family = strdup(family);
 			f->path = strdup(path);
 			list_add_tail(&f->list, &ctx->list);
+			font_glyph_flush(ctx);
 		}
 	}
 }
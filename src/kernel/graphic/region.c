@@ -26,12 +26,30 @@
  *
  */
 
+#include <xconfigs.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <string.h>
 #include <malloc.h>
 #include <graphic/region.h>
 
+/*
+ * A region list keeps its rects in y-x banded form, as pixman does. Rects are
+ * sorted by y and then by x, they never overlap, every rect of a band shares
+ * the same top and bottom, and vertically adjacent bands with identical
+ * x spans are coalesced.
+ */
+enum region_op_t {
+	REGION_OP_UNION		= 0,
+	REGION_OP_SUBTRACT	= 1,
+	REGION_OP_INTERSECT	= 2,
+};
+
+struct region_span_t {
+	int x1, x2;
+};
+
 struct region_list_t * region_list_alloc(unsigned int size)
 {
 	struct region_list_t * rl;
@@ -66,14 +84,368 @@ void region_list_free(struct region_list_t * rl)
 	}
 }
 
-static inline void region_list_resize(struct region_list_t * rl, unsigned int size)
+static inline int region_list_resize(struct region_list_t * rl, unsigned int size)
 {
+	struct region_t * r;
+
 	if(rl && (rl->size != size))
 	{
 		if(size < 16)
 			size = 16;
+		r = realloc(rl->region, size * sizeof(struct region_t));
+		if(!r)
+			return 0;
+		rl->region = r;
 		rl->size = size;
-		rl->region = realloc(rl->region, rl->size * sizeof(struct region_t));
+	}
+	return 1;
+}
+
+/*
+ * Replace the list with the bounding box of both rect sets, used when there
+ * is no memory for the exact union so that no damage is ever dropped
+ */
+static void region_list_bound(struct region_list_t * rl, struct region_t * a, int na, struct region_t * b, int nb)
+{
+	struct region_t u;
+	int i, c = 0;
+
+	for(i = 0; i < na; i++)
+	{
+		if(!region_isempty(&a[i]))
+		{
+			if(c++ == 0)
+				region_clone(&u, &a[i]);
+			else
+				region_union(&u, &u, &a[i]);
+		}
+	}
+	for(i = 0; i < nb; i++)
+	{
+		if(!region_isempty(&b[i]))
+		{
+			if(c++ == 0)
+				region_clone(&u, &b[i]);
+			else
+				region_union(&u, &u, &b[i]);
+		}
+	}
+	if(c > 0)
+		region_clone(&rl->region[0], &u);
+	rl->count = c > 0 ? 1 : 0;
+}
+
+static int region_int_cmp(const void * a, const void * b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static int region_span_cmp(const void * a, const void * b)
+{
+	return ((const struct region_span_t *)a)->x1 - ((const struct region_span_t *)b)->x1;
+}
+
+/*
+ * Collect the sorted, merged x spans of all rects covering the band [y1, y2)
+ */
+static int region_band_spans(struct region_t * r, int n, int y1, int y2, struct region_span_t * s)
+{
+	int i, j, c = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		if((r[i].w > 0) && (r[i].y <= y1) && (r[i].y + r[i].h >= y2))
+		{
+			s[c].x1 = r[i].x;
+			s[c].x2 = r[i].x + r[i].w;
+			c++;
+		}
+	}
+	if(c > 1)
+	{
+		qsort(s, c, sizeof(struct region_span_t), region_span_cmp);
+		for(i = 1, j = 0; i < c; i++)
+		{
+			if(s[i].x1 <= s[j].x2)
+			{
+				if(s[i].x2 > s[j].x2)
+					s[j].x2 = s[i].x2;
+			}
+			else
+				s[++j] = s[i];
+		}
+		c = j + 1;
+	}
+	return c;
+}
+
+static inline void region_span_emit(struct region_span_t * o, int * c, int x1, int x2)
+{
+	if(x1 >= x2)
+		return;
+	if((*c > 0) && (o[*c - 1].x2 >= x1))
+	{
+		if(x2 > o[*c - 1].x2)
+			o[*c - 1].x2 = x2;
+	}
+	else
+	{
+		o[*c].x1 = x1;
+		o[*c].x2 = x2;
+		(*c)++;
+	}
+}
+
+static int region_band_op(struct region_span_t * a, int na, struct region_span_t * b, int nb, struct region_span_t * o, enum region_op_t op)
+{
+	int i = 0, j = 0, c = 0;
+	int x1;
+
+	switch(op)
+	{
+	case REGION_OP_UNION:
+		while((i < na) || (j < nb))
+		{
+			if((j >= nb) || ((i < na) && (a[i].x1 <= b[j].x1)))
+			{
+				region_span_emit(o, &c, a[i].x1, a[i].x2);
+				i++;
+			}
+			else
+			{
+				region_span_emit(o, &c, b[j].x1, b[j].x2);
+				j++;
+			}
+		}
+		break;
+
+	case REGION_OP_SUBTRACT:
+		for(i = 0; i < na; i++)
+		{
+			x1 = a[i].x1;
+			while((j < nb) && (b[j].x2 <= x1))
+				j++;
+			while((j < nb) && (b[j].x1 < a[i].x2))
+			{
+				region_span_emit(o, &c, x1, b[j].x1);
+				if(b[j].x2 >= a[i].x2)
+				{
+					x1 = a[i].x2;
+					break;
+				}
+				x1 = b[j].x2;
+				j++;
+			}
+			region_span_emit(o, &c, x1, a[i].x2);
+		}
+		break;
+
+	case REGION_OP_INTERSECT:
+		while((i < na) && (j < nb))
+		{
+			region_span_emit(o, &c, max(a[i].x1, b[j].x1), min(a[i].x2, b[j].x2));
+			if(a[i].x2 < b[j].x2)
+				i++;
+			else
+				j++;
+		}
+		break;
+
+	default:
+		break;
+	}
+	return c;
+}
+
+/*
+ * Fill gaps inside a band when painting the gap is cheaper than the fixed
+ * cost of one more rect, measured in pixels
+ */
+static int region_band_bridge(struct region_span_t * s, int n, int h, int cost)
+{
+	int i, j;
+
+	if((n < 2) || (cost <= 0))
+		return n;
+	for(i = 1, j = 0; i < n; i++)
+	{
+		if((s[i].x1 - s[j].x2) * h <= cost)
+			s[j].x2 = s[i].x2;
+		else
+			s[++j] = s[i];
+	}
+	return j + 1;
+}
+
+/*
+ * Rebuild the list as the banded result of the op on both rect sets. Returns
+ * zero, with the list untouched, when there is no memory to start with. Once
+ * the result is built but can't be stored, its bounding box is kept instead.
+ */
+static int region_list_op(struct region_list_t * rl, struct region_t * a, int na, struct region_t * b, int nb, enum region_op_t op, int cost)
+{
+	struct region_span_t * sa, * sb, * so, * sp;
+	struct region_t * o, * t;
+	int * ys;
+	int ny, nsa, nsb, nso, nsp;
+	int count, osize, pstart;
+	int i, k, y1, y2;
+
+	ys = malloc((na + nb) * 2 * sizeof(int) + 1);
+	sa = malloc((na + nb) * 4 * sizeof(struct region_span_t) + 1);
+	osize = max(na + nb, 16) * 2;
+	o = malloc(osize * sizeof(struct region_t));
+	if(!ys || !sa || !o)
+	{
+		free(ys);
+		free(sa);
+		free(o);
+		return 0;
+	}
+	sb = sa + na;
+	so = sb + nb;
+	sp = so + na + nb;
+
+	for(i = 0, ny = 0; i < na; i++)
+	{
+		if((a[i].w > 0) && (a[i].h > 0))
+		{
+			ys[ny++] = a[i].y;
+			ys[ny++] = a[i].y + a[i].h;
+		}
+	}
+	for(i = 0; i < nb; i++)
+	{
+		if((b[i].w > 0) && (b[i].h > 0))
+		{
+			ys[ny++] = b[i].y;
+			ys[ny++] = b[i].y + b[i].h;
+		}
+	}
+	qsort(ys, ny, sizeof(int), region_int_cmp);
+
+	count = 0;
+	pstart = 0;
+	nsp = 0;
+	for(k = 1; k < ny; k++)
+	{
+		y1 = ys[k - 1];
+		y2 = ys[k];
+		if(y1 == y2)
+			continue;
+		nsa = region_band_spans(a, na, y1, y2, sa);
+		nsb = region_band_spans(b, nb, y1, y2, sb);
+		nso = region_band_op(sa, nsa, sb, nsb, so, op);
+		if(op == REGION_OP_UNION)
+			nso = region_band_bridge(so, nso, y2 - y1, cost);
+		if(nso <= 0)
+		{
+			nsp = 0;
+			continue;
+		}
+		if((nsp == nso) && (o[pstart].y + o[pstart].h == y1) && (memcmp(sp, so, nso * sizeof(struct region_span_t)) == 0))
+		{
+			for(i = pstart; i < count; i++)
+				o[i].h += y2 - y1;
+			continue;
+		}
+		if(count + nso > osize)
+		{
+			osize = (count + nso) * 2;
+			t = realloc(o, osize * sizeof(struct region_t));
+			if(!t)
+			{
+				free(ys);
+				free(sa);
+				free(o);
+				return 0;
+			}
+			o = t;
+		}
+		pstart = count;
+		for(i = 0; i < nso; i++, count++)
+		{
+			o[count].x = so[i].x1;
+			o[count].y = y1;
+			o[count].w = so[i].x2 - so[i].x1;
+			o[count].h = y2 - y1;
+		}
+		memcpy(sp, so, nso * sizeof(struct region_span_t));
+		nsp = nso;
+	}
+
+	if((rl->size < count) && !region_list_resize(rl, count))
+		region_list_bound(rl, o, count, NULL, 0);
+	else
+	{
+		if(count > 0)
+			memcpy(rl->region, o, count * sizeof(struct region_t));
+		rl->count = count;
+	}
+	free(ys);
+	free(sa);
+	free(o);
+	return 1;
+}
+
+/*
+ * Damage may grow but never shrink, so without memory for the exact union
+ * fall back to the bounding box of both rect sets
+ */
+static void region_list_union(struct region_list_t * rl, struct region_t * a, int na, struct region_t * b, int nb, int cost)
+{
+	if(!region_list_op(rl, a, na, b, nb, REGION_OP_UNION, cost))
+		region_list_bound(rl, a, na, b, nb);
+}
+
+static inline int region_area(struct region_t * r)
+{
+	return r->w * r->h;
+}
+
+/*
+ * Too many rects cost more to present than the pixels they save. Rects are
+ * kept in y-x order, so fold the neighbouring pair whose bounding box wastes
+ * the fewest pixels until the list is short enough, then rebuild the bands.
+ * Rebanding may split the folded boxes again, so after a few rounds the
+ * whole list collapses into its bounding box.
+ */
+static void region_list_simplify(struct region_list_t * rl)
+{
+	struct region_t * r;
+	struct region_t u;
+	int waste, best, bi;
+	int i, n, loop = 0;
+
+	while(rl->count > CONFIG_REGION_LIST_MAX_RECTS)
+	{
+		if(loop++ >= 4)
+		{
+			region_list_bound(rl, rl->region, rl->count, NULL, 0);
+			break;
+		}
+		r = rl->region;
+		n = rl->count;
+		while(n > CONFIG_REGION_LIST_MAX_RECTS)
+		{
+			best = INT_MAX;
+			bi = 0;
+			for(i = 0; i < n - 1; i++)
+			{
+				region_union(&u, &r[i], &r[i + 1]);
+				waste = region_area(&u) - region_area(&r[i]) - region_area(&r[i + 1]);
+				if(waste < best)
+				{
+					best = waste;
+					bi = i;
+				}
+			}
+			region_union(&r[bi], &r[bi], &r[bi + 1]);
+			memmove(&r[bi + 1], &r[bi + 2], (n - bi - 2) * sizeof(struct region_t));
+			n--;
+		}
+		rl->count = n;
+		region_list_union(rl, rl->region, rl->count, NULL, 0, CONFIG_REGION_MERGE_COST);
 	}
 }
 
@@ -87,57 +459,91 @@ void region_list_clone(struct region_list_t * rl, struct region_list_t * o)
 			rl->count = 0;
 		else
 		{
-			if(rl->size < o->size)
-				region_list_resize(rl, o->size);
-			if((count = o->count) > 0)
-				memcpy(rl->region, o->region, sizeof(struct region_t) * count);
-			rl->count = count;
+			if((rl->size < o->size) && !region_list_resize(rl, o->size))
+				region_list_bound(rl, o->region, o->count, NULL, 0);
+			else
+			{
+				if((count = o->count) > 0)
+					memcpy(rl->region, o->region, sizeof(struct region_t) * count);
+				rl->count = count;
+			}
 		}
 	}
 }
 
 void region_list_merge(struct region_list_t * rl, struct region_list_t * o)
 {
-	int count;
-	int i;
-
-	if(rl && o && ((count = o->count) > 0))
+	if(rl && o && (o->count > 0))
 	{
-		for(i = 0; i < count; i++)
-			region_list_add(rl, &o->region[i]);
+		if(rl->count == 0)
+			region_list_clone(rl, o);
+		else
+		{
+			region_list_union(rl, rl->region, rl->count, o->region, o->count, CONFIG_REGION_MERGE_COST);
+			region_list_simplify(rl);
+		}
 	}
 }
 
 void region_list_add(struct region_list_t * rl, struct region_t * r)
 {
-	struct region_t * p;
-	int index = -1;
 	int i;
 
-	if(!rl || !r)
+	if(!rl || !r || region_isempty(r))
 		return;
 
 	for(i = 0; i < rl->count; i++)
 	{
-		if(region_overlap(&rl->region[i], r))
-		{
-			index = i;
-			break;
-		}
+		if(region_contains(&rl->region[i], r))
+			return;
 	}
-
-	if(index >= 0)
+	if(rl->count == 0)
 	{
-		p = &rl->region[index];
-		region_union(p, p, r);
+		region_clone(&rl->region[0], r);
+		rl->count = 1;
 	}
 	else
 	{
-		if(rl->size <= rl->count)
-			region_list_resize(rl, rl->size << 1);
-		region_clone(&rl->region[rl->count], r);
-		rl->count++;
+		region_list_union(rl, rl->region, rl->count, r, 1, CONFIG_REGION_MERGE_COST);
+		region_list_simplify(rl);
+	}
+}
+
+/*
+ * Out of memory the list is left as is, still covering the exact result
+ */
+void region_list_subtract(struct region_list_t * rl, struct region_t * r)
+{
+	if(rl && r && !region_isempty(r) && (rl->count > 0))
+		region_list_op(rl, rl->region, rl->count, r, 1, REGION_OP_SUBTRACT, 0);
+}
+
+void region_list_intersect(struct region_list_t * rl, struct region_t * r)
+{
+	if(rl && r && (rl->count > 0))
+	{
+		if(region_isempty(r))
+			rl->count = 0;
+		else if(!region_list_op(rl, rl->region, rl->count, r, 1, REGION_OP_INTERSECT, 0))
+		{
+			region_list_bound(rl, rl->region, rl->count, NULL, 0);
+			if(!region_intersect(&rl->region[0], &rl->region[0], r) || region_isempty(&rl->region[0]))
+				rl->count = 0;
+		}
+	}
+}
+
+int region_list_area(struct region_list_t * rl)
+{
+	int area = 0;
+	int i;
+
+	if(rl)
+	{
+		for(i = 0; i < rl->count; i++)
+			area += region_area(&rl->region[i]);
 	}
+	return area;
 }
 
 void region_list_clear(struct region_list_t * rl)
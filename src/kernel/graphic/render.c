@@ -28,6 +28,7 @@
 
 #include <xboot.h>
 #include <graphic/surface.h>
+#include <graphic/span.h>
 
 void * render_default_create(struct surface_t * s)
 {
@@ -70,20 +71,140 @@ static inline void blend(uint32_t * d, uint32_t * s)
 	}
 }
 
+static inline void blend_span(uint32_t * d, uint32_t * s, int n)
+{
+	span_ops_get()->blend(d, s, n);
+}
+
+static inline uint32_t lerp_pixel(uint32_t a, uint32_t b, int f)
+{
+	uint32_t rb = (((a & 0x00ff00ff) * (256 - f) + (b & 0x00ff00ff) * f) >> 8) & 0x00ff00ff;
+	uint32_t ag = (((a >> 8) & 0x00ff00ff) * (256 - f) + ((b >> 8) & 0x00ff00ff) * f) & 0xff00ff00;
+	return ag | rb;
+}
+
+static inline uint32_t sample_bilinear(uint32_t * sp, int ss, int sw, int sh, int32_t u, int32_t v)
+{
+	int x0 = u >> 16, y0 = v >> 16;
+	int x1 = x0 + 1, y1 = y0 + 1;
+	int fx = (u >> 8) & 0xff;
+	int fy = (v >> 8) & 0xff;
+	uint32_t * r0, * r1;
+
+	x0 = clamp(x0, 0, sw - 1);
+	x1 = clamp(x1, 0, sw - 1);
+	y0 = clamp(y0, 0, sh - 1);
+	y1 = clamp(y1, 0, sh - 1);
+	r0 = sp + y0 * ss;
+	r1 = sp + y1 * ss;
+	return lerp_pixel(lerp_pixel(r0[x0], r0[x1], fx), lerp_pixel(r1[x0], r1[x1], fx), fy);
+}
+
+/*
+ * Catmull-Rom weights (a = -0.5) for 256 sub pixel phases, in 1/256 units
+ */
+static int16_t cubic_weight[256][4];
+static int cubic_weight_ready = 0;
+
+static void cubic_weight_init(void)
+{
+	float t, w0, w1, w2;
+	int i;
+
+	for(i = 0; i < 256; i++)
+	{
+		t = i / 256.0f;
+		w0 = ((-0.5f * t + 1.0f) * t - 0.5f) * t;
+		w1 = (1.5f * t - 2.5f) * t * t + 1.0f;
+		w2 = ((-1.5f * t + 2.0f) * t + 0.5f) * t;
+		cubic_weight[i][0] = (int16_t)roundf(w0 * 256.0f);
+		cubic_weight[i][1] = (int16_t)roundf(w1 * 256.0f);
+		cubic_weight[i][2] = (int16_t)roundf(w2 * 256.0f);
+		cubic_weight[i][3] = 256 - cubic_weight[i][0] - cubic_weight[i][1] - cubic_weight[i][2];
+	}
+	cubic_weight_ready = 1;
+}
+
+static inline uint32_t sample_bicubic(uint32_t * sp, int ss, int sw, int sh, int32_t u, int32_t v)
+{
+	int16_t * wx = cubic_weight[(u >> 8) & 0xff];
+	int16_t * wy = cubic_weight[(v >> 8) & 0xff];
+	int x = (u >> 16) - 1, y = (v >> 16) - 1;
+	int xs[4], a, r, g, b;
+	int ca = 0, cr = 0, cg = 0, cb = 0;
+	uint32_t * row, c;
+	int i, j;
+
+	for(i = 0; i < 4; i++)
+		xs[i] = clamp(x + i, 0, sw - 1);
+	for(j = 0; j < 4; j++)
+	{
+		row = sp + clamp(y + j, 0, sh - 1) * ss;
+		a = r = g = b = 0;
+		for(i = 0; i < 4; i++)
+		{
+			c = row[xs[i]];
+			a += wx[i] * (int)((c >> 24) & 0xff);
+			r += wx[i] * (int)((c >> 16) & 0xff);
+			g += wx[i] * (int)((c >> 8) & 0xff);
+			b += wx[i] * (int)((c >> 0) & 0xff);
+		}
+		ca += wy[j] * a;
+		cr += wy[j] * r;
+		cg += wy[j] * g;
+		cb += wy[j] * b;
+	}
+	a = clamp((ca + 32768) >> 16, 0, 255);
+	r = clamp((cr + 32768) >> 16, 0, a);
+	g = clamp((cg + 32768) >> 16, 0, a);
+	b = clamp((cb + 32768) >> 16, 0, a);
+	return (a << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+/*
+ * Range [*k0, *k1) of steps for which (f + k * df) stays inside [0, limit)
+ */
+static inline void blit_span_clip(int64_t f, int64_t df, int64_t limit, int * k0, int * k1)
+{
+	int64_t lo, hi;
+
+	if(df == 0)
+	{
+		if((f < 0) || (f >= limit))
+			*k1 = *k0;
+		return;
+	}
+	if(df > 0)
+	{
+		lo = (f >= 0) ? 0 : (-f + df - 1) / df;
+		hi = (f >= limit) ? 0 : (limit - f + df - 1) / df;
+	}
+	else
+	{
+		lo = (f < limit) ? 0 : (f - limit - df) / -df;
+		hi = (f < 0) ? 0 : f / -df + 1;
+	}
+	if(lo > *k0)
+		*k0 = (lo < *k1) ? (int)lo : *k1;
+	if(hi < *k1)
+		*k1 = (hi > *k0) ? (int)hi : *k0;
+}
+
 void render_default_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type)
 {
 	struct region_t r, region;
 	struct matrix_t t;
-	uint32_t * p;
+	uint32_t * p, v;
 	uint32_t * dp = surface_get_pixels(s);
 	uint32_t * sp = surface_get_pixels(src);
 	int ds = surface_get_stride(s) >> 2;
 	int ss = surface_get_stride(src) >> 2;
 	int sw = surface_get_width(src);
 	int sh = surface_get_height(src);
-	int x1, y1, x2, y2, stride;
-	int x, y, ox, oy;
-	double fx, fy, ofx, ofy;
+	int x1, y1, x2, y2;
+	int y, k, k0, k1, tx, ty;
+	int64_t fx, fy, dxx, dxy, dyx, dyy, u, w;
+	double ox, oy;
 
 	region_init(&r, 0, 0, surface_get_width(s), surface_get_height(s));
 	if(clip)
@@ -91,6 +212,24 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
+
+	/*
+	 * Identity and integer translation, a straight row blend without sampling
+	 */
+	if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0) && (m->tx == floor(m->tx)) && (m->ty == floor(m->ty)))
+	{
+		tx = (int)m->tx;
+		ty = (int)m->ty;
+		region_init(&region, tx, ty, sw, sh);
+		if(!region_intersect(&r, &r, &region))
+			return;
+		p = dp + r.y * ds + r.x;
+		sp += (r.y - ty) * ss + (r.x - tx);
+		for(y = 0; y < r.h; y++, p += ds, sp += ss)
+			blend_span(p, sp, r.w);
+		return;
+	}
+
 	matrix_transform_region(m, sw, sh, &region);
 	if(!region_intersect(&r, &r, &region))
 		return;
@@ -99,29 +238,62 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 	y1 = r.y;
 	x2 = r.x + r.w;
 	y2 = r.y + r.h;
-	stride = ds - r.w;
-	p = dp + y1 * ds + x1;
-	fx = x1;
-	fy = y1;
 	memcpy(&t, m, sizeof(struct matrix_t));
 	matrix_invert(&t);
-	matrix_transform_point(&t, &fx, &fy);
 
-	for(y = y1; y < y2; ++y, fx += t.c, fy += t.d)
-	{
-		ofx = fx;
-		ofy = fy;
-		for(x = x1; x < x2; ++x, ofx += t.a, ofy += t.b)
+	/*
+	 * Walk the inverse mapping in 16.16 fixed point, filtered modes sample at pixel centers
+	 */
+	ox = x1;
+	oy = y1;
+	if(type != RENDER_TYPE_FAST)
+	{
+		ox += 0.5;
+		oy += 0.5;
+	}
+	matrix_transform_point(&t, &ox, &oy);
+	fx = (int64_t)(ox * 65536.0);
+	fy = (int64_t)(oy * 65536.0);
+	dxx = (int64_t)(t.a * 65536.0);
+	dxy = (int64_t)(t.b * 65536.0);
+	dyx = (int64_t)(t.c * 65536.0);
+	dyy = (int64_t)(t.d * 65536.0);
+	if((type == RENDER_TYPE_BEST) && !cubic_weight_ready)
+		cubic_weight_init();
+
+	for(y = y1; y < y2; y++, fx += dyx, fy += dyy)
+	{
+		k0 = 0;
+		k1 = x2 - x1;
+		blit_span_clip(fx, dxx, (int64_t)sw << 16, &k0, &k1);
+		blit_span_clip(fy, dxy, (int64_t)sh << 16, &k0, &k1);
+		if(k0 >= k1)
+			continue;
+		p = dp + y * ds + x1 + k0;
+		u = fx + k0 * dxx;
+		w = fy + k0 * dxy;
+		switch(type)
 		{
-			ox = (int)ofx;
-			oy = (int)ofy;
-			if(ox >= 0 && ox < sw && oy >= 0 && oy < sh)
+		case RENDER_TYPE_GOOD:
+			for(k = k0; k < k1; k++, p++, u += dxx, w += dxy)
 			{
-				blend(p, sp + oy * ss + ox);
+				v = sample_bilinear(sp, ss, sw, sh, (int32_t)(u - 32768), (int32_t)(w - 32768));
+				blend(p, &v);
 			}
-			p++;
+			break;
+		case RENDER_TYPE_BEST:
+			for(k = k0; k < k1; k++, p++, u += dxx, w += dxy)
+			{
+				v = sample_bicubic(sp, ss, sw, sh, (int32_t)(u - 32768), (int32_t)(w - 32768));
+				blend(p, &v);
+			}
+			break;
+		case RENDER_TYPE_FAST:
+		default:
+			for(k = k0; k < k1; k++, p++, u += dxx, w += dxy)
+				blend(p, sp + (int)(w >> 16) * ss + (int)(u >> 16));
+			break;
 		}
-		p += stride;
 	}
 }
 
@@ -129,6 +301,7 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 {
 	struct region_t r, region;
 	struct matrix_t t;
+	struct span_ops_t * ops;
 	uint32_t * p, v;
 	int ds = surface_get_stride(s) >> 2;
 	int x1, y1, x2, y2, stride;
@@ -141,6 +314,23 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
+
+	/*
+	 * Identity and integer translation, every covered pixel is a plain store
+	 */
+	if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0) && (m->tx == floor(m->tx)) && (m->ty == floor(m->ty)))
+	{
+		region_init(&region, (int)m->tx, (int)m->ty, w, h);
+		if(!region_intersect(&r, &r, &region))
+			return;
+		ops = span_ops_get();
+		p = (uint32_t *)surface_get_pixels(s) + r.y * ds + r.x;
+		v = color_get_premult(c);
+		for(y = 0; y < r.h; y++, p += ds)
+			ops->fill(p, v, r.w);
+		return;
+	}
+
 	matrix_transform_region(m, w, h, &region);
 	if(!region_intersect(&r, &r, &region))
 		return;
@@ -1561,15 +1751,49 @@ static inline void blurcol(unsigned char * pixel, int width, int height, int x,
 		blurinner(p, &zr, &zg, &zb, &za, alpha);
 }
 
-static void expblur(unsigned char * pixel, int width, int height, int x, int y, int w, int h, int radius)
+struct expblur_t {
+	unsigned char * pixel;
+	int width, height;
+	int x, y, w, h;
+	int alpha;
+};
+
+static void expblur_rows(int start, int end, void * data)
 {
-	int alpha = (int)((1 << 16) * (1.0 - expf(-2.3 / (radius + 1.0))));
+	struct expblur_t * b = (struct expblur_t *)data;
 	int i;
 
-	for(i = 0; i < h; i++)
-		blurrow(pixel, width, height, x, y, w, i, alpha);
-	for(i = 0; i < w; i++)
-		blurcol(pixel, width, height, x, y, h, i, alpha);
+	for(i = start; i < end; i++)
+		blurrow(b->pixel, b->width, b->height, b->x, b->y, b->w, i, b->alpha);
+}
+
+static void expblur_cols(int start, int end, void * data)
+{
+	struct expblur_t * b = (struct expblur_t *)data;
+	int i;
+
+	for(i = start; i < end; i++)
+		blurcol(b->pixel, b->width, b->height, b->x, b->y, b->h, i, b->alpha);
+}
+
+/*
+ * Both passes are independent per row and per column, so each one is split
+ * into bands across cpus. Column bands are kept wide enough to share lines.
+ */
+static void expblur(unsigned char * pixel, int width, int height, int x, int y, int w, int h, int radius)
+{
+	struct expblur_t b;
+
+	b.pixel = pixel;
+	b.width = width;
+	b.height = height;
+	b.x = x;
+	b.y = y;
+	b.w = w;
+	b.h = h;
+	b.alpha = (int)((1 << 16) * (1.0 - expf(-2.3 / (radius + 1.0))));
+	parallel_for(h, 0, expblur_rows, &b);
+	parallel_for(w, 16, expblur_cols, &b);
 }
 
 void render_default_effect_glass(struct surface_t * s, struct region_t * clip, int x, int y, int w, int h, int radius)
@@ -1713,56 +1937,17 @@ void render_default_effect_checkerboard(struct surface_t * s, struct region_t *
 
 void render_default_filter_gray(struct surface_t * s)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-	unsigned char gray;
-
-	for(i = 0; i < len; i++, p += 4)
-	{
-		if(p[3] != 0)
-		{
-			gray = (p[2] * 19595L + p[1] * 38469L + p[0] * 7472L) >> 16;
-			p[0] = gray;
-			p[1] = gray;
-			p[2] = gray;
-		}
-	}
+	span_ops_get()->gray(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s));
 }
 
 void render_default_filter_sepia(struct surface_t * s)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-	int r, g, b;
-
-	for(i = 0; i < len; i++, p += 4)
-	{
-		if(p[3] != 0)
-		{
-			b = (p[2] * 17826L + p[1] * 34996L + p[0] * 8585L) >> 16;
-			g = (p[2] * 22872L + p[1] * 44958L + p[0] * 11010L) >> 16;
-			r = (p[2] * 25756L + p[1] * 50397L + p[0] * 12386L) >> 16;
-			p[0] = min(b, 255);
-			p[1] = min(g, 255);
-			p[2] = min(r, 255);
-		}
-	}
+	span_ops_get()->sepia(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s));
 }
 
 void render_default_filter_invert(struct surface_t * s)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-
-	for(i = 0; i < len; i++, p += 4)
-	{
-		if(p[3] != 0)
-		{
-			p[0] = p[3] - p[0];
-			p[1] = p[3] - p[1];
-			p[2] = p[3] - p[2];
-		}
-	}
+	span_ops_get()->invert(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s));
 }
 
 void render_default_filter_coloring(struct surface_t * s, struct color_t * c)
@@ -1790,27 +1975,20 @@ void render_default_filter_coloring(struct surface_t * s, struct color_t * c)
 	}
 }
 
-void render_default_filter_hue(struct surface_t * s, int angle)
+struct filter_hue_t {
+	unsigned char * pixels;
+	int m[9];
+};
+
+static void filter_hue_span(int start, int end, void * data)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-	float av = angle * M_PI / 180.0;
-	float cv = cosf(av);
-	float sv = sinf(av);
-	int r, g, b;
+	struct filter_hue_t * h = (struct filter_hue_t *)data;
+	unsigned char * p = h->pixels + (start << 2);
+	int * m = h->m;
+	int i, r, g, b;
 	int tr, tg, tb;
-	int m[9];
 
-	m[0] = (0.213 + cv * 0.787 - sv * 0.213) * 65536;
-	m[1] = (0.715 - cv * 0.715 - sv * 0.715) * 65536;
-	m[2] = (0.072 - cv * 0.072 + sv * 0.928) * 65536;
-	m[3] = (0.213 - cv * 0.213 + sv * 0.143) * 65536;
-	m[4] = (0.715 + cv * 0.285 + sv * 0.140) * 65536;
-	m[5] = (0.072 - cv * 0.072 - sv * 0.283) * 65536;
-	m[6] = (0.213 - cv * 0.213 - sv * 0.787) * 65536;
-	m[7] = (0.715 - cv * 0.715 + sv * 0.715) * 65536;
-	m[8] = (0.072 + cv * 0.928 + sv * 0.072) * 65536;
-	for(i = 0; i < len; i++, p += 4)
+	for(i = start; i < end; i++, p += 4)
 	{
 		if(p[3] != 0)
 		{
@@ -1842,15 +2020,41 @@ void render_default_filter_hue(struct surface_t * s, int angle)
 	}
 }
 
-void render_default_filter_saturate(struct surface_t * s, int saturate)
+void render_default_filter_hue(struct surface_t * s, int angle)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-	int v = clamp(saturate, -100, 100) * 128 / 100;
-	int r, g, b, vmin, vmax;
+	struct filter_hue_t h;
+	float av = angle * M_PI / 180.0;
+	float cv = cosf(av);
+	float sv = sinf(av);
+	int * m = h.m;
+
+	h.pixels = surface_get_pixels(s);
+	m[0] = (0.213 + cv * 0.787 - sv * 0.213) * 65536;
+	m[1] = (0.715 - cv * 0.715 - sv * 0.715) * 65536;
+	m[2] = (0.072 - cv * 0.072 + sv * 0.928) * 65536;
+	m[3] = (0.213 - cv * 0.213 + sv * 0.143) * 65536;
+	m[4] = (0.715 + cv * 0.285 + sv * 0.140) * 65536;
+	m[5] = (0.072 - cv * 0.072 - sv * 0.283) * 65536;
+	m[6] = (0.213 - cv * 0.213 - sv * 0.787) * 65536;
+	m[7] = (0.715 - cv * 0.715 + sv * 0.715) * 65536;
+	m[8] = (0.072 + cv * 0.928 + sv * 0.072) * 65536;
+	parallel_for(surface_get_width(s) * surface_get_height(s), 0, filter_hue_span, &h);
+}
+
+struct filter_saturate_t {
+	unsigned char * pixels;
+	int v;
+};
+
+static void filter_saturate_span(int start, int end, void * data)
+{
+	struct filter_saturate_t * t = (struct filter_saturate_t *)data;
+	unsigned char * p = t->pixels + (start << 2);
+	int v = t->v;
+	int i, r, g, b, vmin, vmax;
 	int alpha, delta, value, lv, sv;
 
-	for(i = 0; i < len; i++, p += 4)
+	for(i = start; i < end; i++, p += 4)
 	{
 		if(p[3] != 0)
 		{
@@ -1918,77 +2122,33 @@ void render_default_filter_saturate(struct surface_t * s, int saturate)
 	}
 }
 
+void render_default_filter_saturate(struct surface_t * s, int saturate)
+{
+	struct filter_saturate_t t;
+
+	t.pixels = surface_get_pixels(s);
+	t.v = clamp(saturate, -100, 100) * 128 / 100;
+	parallel_for(surface_get_width(s) * surface_get_height(s), 0, filter_saturate_span, &t);
+}
+
 void render_default_filter_brightness(struct surface_t * s, int brightness)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-	int t, v = clamp(brightness, -100, 100) * 255 / 100;
+	int v = clamp(brightness, -100, 100) * 255 / 100;
 
-	for(i = 0; i < len; i++, p += 4)
-	{
-		if(p[3] != 0)
-		{
-			if(p[3] == 255)
-			{
-				p[0] = clamp(p[0] + v, 0, 255);
-				p[1] = clamp(p[1] + v, 0, 255);
-				p[2] = clamp(p[2] + v, 0, 255);
-			}
-			else
-			{
-				t = idiv255(v * p[3]);
-				p[0] = clamp(p[0] + t, 0, 255);
-				p[1] = clamp(p[1] + t, 0, 255);
-				p[2] = clamp(p[2] + t, 0, 255);
-			}
-		}
-	}
+	if(v != 0)
+		span_ops_get()->brightness(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s), v);
 }
 
 void render_default_filter_contrast(struct surface_t * s, int contrast)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
 	int v = clamp(contrast, -100, 100) * 128 / 100;
-	int r, g, b;
-	int tr, tg, tb;
 
-	for(i = 0; i < len; i++, p += 4)
-	{
-		if(p[3] != 0)
-		{
-			if(p[3] == 255)
-			{
-				b = p[0];
-				g = p[1];
-				r = p[2];
-				tb = ((b << 7) + (b - 128) * v) >> 7;
-				tg = ((g << 7) + (g - 128) * v) >> 7;
-				tr = ((r << 7) + (r - 128) * v) >> 7;
-				p[0] = clamp(tb, 0, 255);
-				p[1] = clamp(tg, 0, 255);
-				p[2] = clamp(tr, 0, 255);
-			}
-			else
-			{
-				b = p[0] * 255 / p[3];
-				g = p[1] * 255 / p[3];
-				r = p[2] * 255 / p[3];
-				tb = ((b << 7) + (b - 128) * v) >> 7;
-				tg = ((g << 7) + (g - 128) * v) >> 7;
-				tr = ((r << 7) + (r - 128) * v) >> 7;
-				p[0] = clamp(idiv255(tb * p[3]), 0, 255);
-				p[1] = clamp(idiv255(tg * p[3]), 0, 255);
-				p[2] = clamp(idiv255(tr * p[3]), 0, 255);
-			}
-		}
-	}
+	if(v != 0)
+		span_ops_get()->contrast(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s), v);
 }
 
 void render_default_filter_opacity(struct surface_t * s, int alpha)
 {
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
 	int v = clamp(alpha, 0, 100) * 256 / 100;
 
 	switch(v)
@@ -1999,34 +2159,235 @@ void render_default_filter_opacity(struct surface_t * s, int alpha)
 	case 256:
 		break;
 	default:
-		for(i = 0; i < len; i++, p += 4)
+		span_ops_get()->opacity(surface_get_pixels(s), surface_get_width(s) * surface_get_height(s), v);
+		break;
+	}
+}
+
+struct filter_haldclut_t {
+	unsigned char * pixels;
+	int width;
+	int stride;
+	unsigned char * clut;
+	int level, level2, level_1, level_2;
+};
+
+static void filter_haldclut_nearest(int start, int end, void * data)
+{
+	struct filter_haldclut_t * hc = (struct filter_haldclut_t *)data;
+	int width = hc->width;
+	int stride = hc->stride;
+	unsigned char * p, * q = hc->pixels + start * stride;
+	unsigned char * cp, * cq = hc->clut;
+	int level = hc->level;
+	int level2 = hc->level2;
+	int level_1 = hc->level_1;
+	int level_2 = hc->level_2;
+	int ri, gi, bi;
+	int x, y;
+
+	for(y = start; y < end; y++, q += stride)
+	{
+		for(x = 0, p = q; x < width; x++, p += 4)
 		{
 			if(p[3] != 0)
 			{
-				p[0] = (p[0] * v) >> 8;
-				p[1] = (p[1] * v) >> 8;
-				p[2] = (p[2] * v) >> 8;
-				p[3] = (p[3] * v) >> 8;
+				if(p[3] == 255)
+				{
+					bi = idiv255(p[0] * level_1);
+					if(bi > level_2)
+						bi = level_2;
+					gi = idiv255(p[1] * level_1);
+					if(gi > level_2)
+						gi = level_2;
+					ri = idiv255(p[2] * level_1);
+					if(ri > level_2)
+						ri = level_2;
+					cp = cq + ((bi * level2 + gi * level + ri) << 2);
+					p[0] = cp[0];
+					p[1] = cp[1];
+					p[2] = cp[2];
+				}
+				else
+				{
+					bi = p[0] * level_1 / p[3];
+					if(bi > level_2)
+						bi = level_2;
+					gi = p[1] * level_1 / p[3];
+					if(gi > level_2)
+						gi = level_2;
+					ri = p[2] * level_1 / p[3];
+					if(ri > level_2)
+						ri = level_2;
+					cp = cq + ((bi * level2 + gi * level + ri) << 2);
+					p[0] = idiv255(cp[0] * p[3]);
+					p[1] = idiv255(cp[1] * p[3]);
+					p[2] = idiv255(cp[2] * p[3]);
+				}
 			}
 		}
-		break;
 	}
 }
 
-void render_default_filter_haldclut(struct surface_t * s, struct surface_t * clut, const char * type)
+static void filter_haldclut_trilinear(int start, int end, void * data)
 {
-	int width = surface_get_width(s);
-	int height = surface_get_height(s);
-	int stride = surface_get_stride(s);
-	unsigned char * p, * q = surface_get_pixels(s);
-	int cw = surface_get_width(clut);
-	int ch = surface_get_height(clut);
-	unsigned char * t, * cp, * cq = surface_get_pixels(clut);
+	struct filter_haldclut_t * hc = (struct filter_haldclut_t *)data;
+	int width = hc->width;
+	int stride = hc->stride;
+	unsigned char * p, * q = hc->pixels + start * stride;
+	unsigned char * t, * cp, * cq = hc->clut;
+	int level = hc->level;
+	int level2 = hc->level2;
+	int level_1 = hc->level_1;
+	int level_2 = hc->level_2;
 	double sum[9];
 	double dr, dg, db, xdr, xdg, xdb;
 	int ri, gi, bi;
 	int x, y, v;
-	int level, level2, level_1, level_2;
+
+	for(y = start; y < end; y++, q += stride)
+	{
+		for(x = 0, p = q; x < width; x++, p += 4)
+		{
+			if(p[3] != 0)
+			{
+				if(p[3] == 255)
+				{
+					bi = idiv255(p[0] * level_1);
+					if(bi > level_2)
+						bi = level_2;
+					gi = idiv255(p[1] * level_1);
+					if(gi > level_2)
+						gi = level_2;
+					ri = idiv255(p[2] * level_1);
+					if(ri > level_2)
+						ri = level_2;
+					db = (double)p[0] * level_1 / 255 - bi;
+					dg = (double)p[1] * level_1 / 255 - gi;
+					dr = (double)p[2] * level_1 / 255 - ri;
+					xdb = 1 - db;
+					xdg = 1 - dg;
+					xdr = 1 - dr;
+					cp = cq + ((bi * level2 + gi * level + ri) << 2);
+					t = cp;
+					sum[0] = (double)t[0] * xdr;
+					sum[1] = (double)t[1] * xdr;
+					sum[2] = (double)t[2] * xdr;
+					t += 4;
+					sum[0] += (double)t[0] * dr;
+					sum[1] += (double)t[1] * dr;
+					sum[2] += (double)t[2] * dr;
+					t = cp + (level << 2);
+					sum[3] = (double)t[0] * xdr;
+					sum[4] = (double)t[1] * xdr;
+					sum[5] = (double)t[2] * xdr;
+					t += 4;
+					sum[3] += (double)t[0] * dr;
+					sum[4] += (double)t[1] * dr;
+					sum[5] += (double)t[2] * dr;
+					sum[6] = sum[0] * xdg + sum[3] * dg;
+					sum[7] = sum[1] * xdg + sum[4] * dg;
+					sum[8] = sum[2] * xdg + sum[5] * dg;
+					t = cp + (level2 << 2);
+					sum[0] = (double)t[0] * xdr;
+					sum[1] = (double)t[1] * xdr;
+					sum[2] = (double)t[2] * xdr;
+					t += 4;
+					sum[0] += (double)t[0] * dr;
+					sum[1] += (double)t[1] * dr;
+					sum[2] += (double)t[2] * dr;
+					t = cp + ((level2 + level) << 2);
+					sum[3] = (double)t[0] * xdr;
+					sum[4] = (double)t[1] * xdr;
+					sum[5] = (double)t[2] * xdr;
+					t += 4;
+					sum[3] += (double)t[0] * dr;
+					sum[4] += (double)t[1] * dr;
+					sum[5] += (double)t[2] * dr;
+					sum[0] = sum[0] * xdg + sum[3] * dg;
+					sum[1] = sum[1] * xdg + sum[4] * dg;
+					sum[2] = sum[2] * xdg + sum[5] * dg;
+					v = sum[6] * xdb + sum[0] * db;
+					p[0] = clamp(v, 0, 255);
+					v = sum[7] * xdb + sum[1] * db;
+					p[1] = clamp(v, 0, 255);
+					v = sum[8] * xdb + sum[2] * db;
+					p[2] = clamp(v, 0, 255);
+				}
+				else
+				{
+					bi = p[0] * level_1 / p[3];
+					if(bi > level_2)
+						bi = level_2;
+					gi = p[1] * level_1 / p[3];
+					if(gi > level_2)
+						gi = level_2;
+					ri = p[2] * level_1 / p[3];
+					if(ri > level_2)
+						ri = level_2;
+					db = (double)p[0] * level_1 / p[3] - bi;
+					dg = (double)p[1] * level_1 / p[3] - gi;
+					dr = (double)p[2] * level_1 / p[3] - ri;
+					xdb = 1 - db;
+					xdg = 1 - dg;
+					xdr = 1 - dr;
+					cp = cq + ((bi * level2 + gi * level + ri) << 2);
+					t = cp;
+					sum[0] = (double)t[0] * xdr;
+					sum[1] = (double)t[1] * xdr;
+					sum[2] = (double)t[2] * xdr;
+					t += 4;
+					sum[0] += (double)t[0] * dr;
+					sum[1] += (double)t[1] * dr;
+					sum[2] += (double)t[2] * dr;
+					t = cp + (level << 2);
+					sum[3] = (double)t[0] * xdr;
+					sum[4] = (double)t[1] * xdr;
+					sum[5] = (double)t[2] * xdr;
+					t += 4;
+					sum[3] += (double)t[0] * dr;
+					sum[4] += (double)t[1] * dr;
+					sum[5] += (double)t[2] * dr;
+					sum[6] = sum[0] * xdg + sum[3] * dg;
+					sum[7] = sum[1] * xdg + sum[4] * dg;
+					sum[8] = sum[2] * xdg + sum[5] * dg;
+					t = cp + (level2 << 2);
+					sum[0] = (double)t[0] * xdr;
+					sum[1] = (double)t[1] * xdr;
+					sum[2] = (double)t[2] * xdr;
+					t += 4;
+					sum[0] += (double)t[0] * dr;
+					sum[1] += (double)t[1] * dr;
+					sum[2] += (double)t[2] * dr;
+					t = cp + ((level2 + level) << 2);
+					sum[3] = (double)t[0] * xdr;
+					sum[4] = (double)t[1] * xdr;
+					sum[5] = (double)t[2] * xdr;
+					t += 4;
+					sum[3] += (double)t[0] * dr;
+					sum[4] += (double)t[1] * dr;
+					sum[5] += (double)t[2] * dr;
+					sum[0] = sum[0] * xdg + sum[3] * dg;
+					sum[1] = sum[1] * xdg + sum[4] * dg;
+					sum[2] = sum[2] * xdg + sum[5] * dg;
+					v = (sum[6] * xdb + sum[0] * db) * p[3] / 255;
+					p[0] = clamp(v, 0, 255);
+					v = (sum[7] * xdb + sum[1] * db) * p[3] / 255;
+					p[1] = clamp(v, 0, 255);
+					v = (sum[8] * xdb + sum[2] * db) * p[3] / 255;
+					p[2] = clamp(v, 0, 255);
+				}
+			}
+		}
+	}
+}
+
+void render_default_filter_haldclut(struct surface_t * s, struct surface_t * clut, const char * type)
+{
+	struct filter_haldclut_t hc;
+	int cw = surface_get_width(clut);
+	int ch = surface_get_height(clut);
+	int level;
 
 	if(cw == ch)
 	{
@@ -2050,190 +2411,21 @@ void render_default_filter_haldclut(struct surface_t * s, struct surface_t * clu
 		default:
 			return;
 		}
-		level2 = level * level;
-		level_1 = level - 1;
-		level_2 = level - 2;
+		hc.pixels = surface_get_pixels(s);
+		hc.width = surface_get_width(s);
+		hc.stride = surface_get_stride(s);
+		hc.clut = surface_get_pixels(clut);
+		hc.level = level;
+		hc.level2 = level * level;
+		hc.level_1 = level - 1;
+		hc.level_2 = level - 2;
 		switch(shash(type))
 		{
 		case 0x09fa48d7: /* "nearest" */
-			for(y = 0; y < height; y++, q += stride)
-			{
-				for(x = 0, p = q; x < width; x++, p += 4)
-				{
-					if(p[3] != 0)
-					{
-						if(p[3] == 255)
-						{
-							bi = idiv255(p[0] * level_1);
-							if(bi > level_2)
-								bi = level_2;
-							gi = idiv255(p[1] * level_1);
-							if(gi > level_2)
-								gi = level_2;
-							ri = idiv255(p[2] * level_1);
-							if(ri > level_2)
-								ri = level_2;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							p[0] = cp[0];
-							p[1] = cp[1];
-							p[2] = cp[2];
-						}
-						else
-						{
-							bi = p[0] * level_1 / p[3];
-							if(bi > level_2)
-								bi = level_2;
-							gi = p[1] * level_1 / p[3];
-							if(gi > level_2)
-								gi = level_2;
-							ri = p[2] * level_1 / p[3];
-							if(ri > level_2)
-								ri = level_2;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							p[0] = idiv255(cp[0] * p[3]);
-							p[1] = idiv255(cp[1] * p[3]);
-							p[2] = idiv255(cp[2] * p[3]);
-						}
-					}
-				}
-			}
+			parallel_for(surface_get_height(s), 0, filter_haldclut_nearest, &hc);
 			break;
 		case 0x860ab38f: /* "trilinear" */
-			for(y = 0; y < height; y++, q += stride)
-			{
-				for(x = 0, p = q; x < width; x++, p += 4)
-				{
-					if(p[3] != 0)
-					{
-						if(p[3] == 255)
-						{
-							bi = idiv255(p[0] * level_1);
-							if(bi > level_2)
-								bi = level_2;
-							gi = idiv255(p[1] * level_1);
-							if(gi > level_2)
-								gi = level_2;
-							ri = idiv255(p[2] * level_1);
-							if(ri > level_2)
-								ri = level_2;
-							db = (double)p[0] * level_1 / 255 - bi;
-							dg = (double)p[1] * level_1 / 255 - gi;
-							dr = (double)p[2] * level_1 / 255 - ri;
-							xdb = 1 - db;
-							xdg = 1 - dg;
-							xdr = 1 - dr;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							t = cp;
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + (level << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[6] = sum[0] * xdg + sum[3] * dg;
-							sum[7] = sum[1] * xdg + sum[4] * dg;
-							sum[8] = sum[2] * xdg + sum[5] * dg;
-							t = cp + (level2 << 2);
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + ((level2 + level) << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[0] = sum[0] * xdg + sum[3] * dg;
-							sum[1] = sum[1] * xdg + sum[4] * dg;
-							sum[2] = sum[2] * xdg + sum[5] * dg;
-							v = sum[6] * xdb + sum[0] * db;
-							p[0] = clamp(v, 0, 255);
-							v = sum[7] * xdb + sum[1] * db;
-							p[1] = clamp(v, 0, 255);
-							v = sum[8] * xdb + sum[2] * db;
-							p[2] = clamp(v, 0, 255);
-						}
-						else
-						{
-							bi = p[0] * level_1 / p[3];
-							if(bi > level_2)
-								bi = level_2;
-							gi = p[1] * level_1 / p[3];
-							if(gi > level_2)
-								gi = level_2;
-							ri = p[2] * level_1 / p[3];
-							if(ri > level_2)
-								ri = level_2;
-							db = (double)p[0] * level_1 / p[3] - bi;
-							dg = (double)p[1] * level_1 / p[3] - gi;
-							dr = (double)p[2] * level_1 / p[3] - ri;
-							xdb = 1 - db;
-							xdg = 1 - dg;
-							xdr = 1 - dr;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							t = cp;
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + (level << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[6] = sum[0] * xdg + sum[3] * dg;
-							sum[7] = sum[1] * xdg + sum[4] * dg;
-							sum[8] = sum[2] * xdg + sum[5] * dg;
-							t = cp + (level2 << 2);
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + ((level2 + level) << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[0] = sum[0] * xdg + sum[3] * dg;
-							sum[1] = sum[1] * xdg + sum[4] * dg;
-							sum[2] = sum[2] * xdg + sum[5] * dg;
-							v = (sum[6] * xdb + sum[0] * db) * p[3] / 255;
-							p[0] = clamp(v, 0, 255);
-							v = (sum[7] * xdb + sum[1] * db) * p[3] / 255;
-							p[1] = clamp(v, 0, 255);
-							v = (sum[8] * xdb + sum[2] * db) * p[3] / 255;
-							p[2] = clamp(v, 0, 255);
-						}
-					}
-				}
-			}
+			parallel_for(surface_get_height(s), 0, filter_haldclut_trilinear, &hc);
 			break;
 		default:
 			break;
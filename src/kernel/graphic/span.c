@@ -0,0 +1,731 @@
+/*
+ * kernel/graphic/span.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <graphic/span.h>
+#if defined(__ARM_NEON) || (defined(__arm__) && (__ARM_ARCH >= 7) && defined(__ARM_PCS_VFP))
+#define SPAN_NEON
+#include <arm_neon.h>
+#elif defined(__X64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Scalar kernels, also used for the tails of the vector kernels
+ */
+static inline void span_blend_pixel(uint32_t * d, uint32_t * s)
+{
+	uint32_t dv, sv = *s;
+	uint32_t sa = (sv >> 24) & 0xff;
+	uint32_t ia, rb, ag;
+
+	if(sa == 255)
+	{
+		*d = sv;
+	}
+	else if(sa != 0)
+	{
+		dv = *d;
+		ia = 256 - sa;
+		rb = ((((dv & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff) + (sv & 0x00ff00ff);
+		ag = (((dv >> 8) & 0x00ff00ff) * ia) & 0xff00ff00;
+		ag = ag + (sv & 0xff00ff00);
+		*d = (ag & 0xff00ff00) | (rb & 0x00ff00ff);
+	}
+}
+
+static inline void span_gray_pixel(uint8_t * p)
+{
+	uint8_t gray;
+
+	if(p[3] != 0)
+	{
+		gray = (p[2] * 19595L + p[1] * 38469L + p[0] * 7472L) >> 16;
+		p[0] = gray;
+		p[1] = gray;
+		p[2] = gray;
+	}
+}
+
+static inline void span_sepia_pixel(uint8_t * p)
+{
+	int r, g, b;
+
+	if(p[3] != 0)
+	{
+		b = (p[2] * 17826L + p[1] * 34996L + p[0] * 8585L) >> 16;
+		g = (p[2] * 22872L + p[1] * 44958L + p[0] * 11010L) >> 16;
+		r = (p[2] * 25756L + p[1] * 50397L + p[0] * 12386L) >> 16;
+		p[0] = min(b, 255);
+		p[1] = min(g, 255);
+		p[2] = min(r, 255);
+	}
+}
+
+static inline void span_invert_pixel(uint8_t * p)
+{
+	if(p[3] != 0)
+	{
+		p[0] = p[3] - p[0];
+		p[1] = p[3] - p[1];
+		p[2] = p[3] - p[2];
+	}
+}
+
+static inline void span_opacity_pixel(uint8_t * p, int v)
+{
+	if(p[3] != 0)
+	{
+		p[0] = (p[0] * v) >> 8;
+		p[1] = (p[1] * v) >> 8;
+		p[2] = (p[2] * v) >> 8;
+		p[3] = (p[3] * v) >> 8;
+	}
+}
+
+static inline void span_brightness_pixel(uint8_t * p, int v)
+{
+	int t;
+
+	if(p[3] != 0)
+	{
+		t = (p[3] == 255) ? v : idiv255(v * p[3]);
+		p[0] = clamp(p[0] + t, 0, 255);
+		p[1] = clamp(p[1] + t, 0, 255);
+		p[2] = clamp(p[2] + t, 0, 255);
+	}
+}
+
+static inline void span_contrast_pixel(uint8_t * p, int v)
+{
+	int r, g, b;
+	int tr, tg, tb;
+
+	if(p[3] != 0)
+	{
+		if(p[3] == 255)
+		{
+			b = p[0];
+			g = p[1];
+			r = p[2];
+			tb = ((b << 7) + (b - 128) * v) >> 7;
+			tg = ((g << 7) + (g - 128) * v) >> 7;
+			tr = ((r << 7) + (r - 128) * v) >> 7;
+			p[0] = clamp(tb, 0, 255);
+			p[1] = clamp(tg, 0, 255);
+			p[2] = clamp(tr, 0, 255);
+		}
+		else
+		{
+			b = p[0] * 255 / p[3];
+			g = p[1] * 255 / p[3];
+			r = p[2] * 255 / p[3];
+			tb = ((b << 7) + (b - 128) * v) >> 7;
+			tg = ((g << 7) + (g - 128) * v) >> 7;
+			tr = ((r << 7) + (r - 128) * v) >> 7;
+			p[0] = clamp(idiv255(tb * p[3]), 0, 255);
+			p[1] = clamp(idiv255(tg * p[3]), 0, 255);
+			p[2] = clamp(idiv255(tr * p[3]), 0, 255);
+		}
+	}
+}
+
+static void span_c_blend(uint32_t * d, uint32_t * s, int n)
+{
+	while(n-- > 0)
+		span_blend_pixel(d++, s++);
+}
+
+static void span_c_fill(uint32_t * d, uint32_t c, int n)
+{
+	while(n-- > 0)
+		*d++ = c;
+}
+
+static void span_c_gray(uint32_t * p, int n)
+{
+	while(n-- > 0)
+		span_gray_pixel((uint8_t *)p++);
+}
+
+static void span_c_sepia(uint32_t * p, int n)
+{
+	while(n-- > 0)
+		span_sepia_pixel((uint8_t *)p++);
+}
+
+static void span_c_invert(uint32_t * p, int n)
+{
+	while(n-- > 0)
+		span_invert_pixel((uint8_t *)p++);
+}
+
+static void span_c_opacity(uint32_t * p, int n, int v)
+{
+	while(n-- > 0)
+		span_opacity_pixel((uint8_t *)p++, v);
+}
+
+static void span_c_brightness(uint32_t * p, int n, int v)
+{
+	while(n-- > 0)
+		span_brightness_pixel((uint8_t *)p++, v);
+}
+
+static void span_c_contrast(uint32_t * p, int n, int v)
+{
+	while(n-- > 0)
+		span_contrast_pixel((uint8_t *)p++, v);
+}
+
+static struct span_ops_t __attribute__((unused)) span_c = {
+	.name		= "c",
+	.blend		= span_c_blend,
+	.fill		= span_c_fill,
+	.gray		= span_c_gray,
+	.sepia		= span_c_sepia,
+	.invert		= span_c_invert,
+	.opacity	= span_c_opacity,
+	.brightness	= span_c_brightness,
+	.contrast	= span_c_contrast,
+};
+
+#if defined(SPAN_NEON)
+/*
+ * NEON kernels, eight pixels per step with the channels deinterleaved. Most
+ * armv7 boards are built for a vfp only fpu, so the kernels are compiled for
+ * neon here and only selected when the cpu reports it at runtime.
+ */
+#if !defined(__ARM_NEON)
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#endif
+static inline uint8x8_t neon_scale(uint8x8_t x, uint16x8_t f)
+{
+	return vshrn_n_u16(vmulq_u16(vmovl_u8(x), f), 8);
+}
+
+static inline uint8x8x4_t neon_keep_transparent(uint8x8x4_t o, uint8x8x4_t v)
+{
+	uint8x8_t z = vceq_u8(o.val[3], vdup_n_u8(0));
+
+	v.val[0] = vbsl_u8(z, o.val[0], v.val[0]);
+	v.val[1] = vbsl_u8(z, o.val[1], v.val[1]);
+	v.val[2] = vbsl_u8(z, o.val[2], v.val[2]);
+	v.val[3] = vbsl_u8(z, o.val[3], v.val[3]);
+	return v;
+}
+
+static inline int neon_all_opaque(uint8x8_t a)
+{
+	return (vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(a)), 0) == 0) ? 1 : 0;
+}
+
+static void span_neon_blend(uint32_t * d, uint32_t * s, int n)
+{
+	uint8x8x4_t vs, vd, vr;
+	uint16x8_t ia;
+	uint8x8_t z;
+
+	for(; n >= 8; n -= 8, d += 8, s += 8)
+	{
+		vs = vld4_u8((uint8_t *)s);
+		vd = vld4_u8((uint8_t *)d);
+		ia = vsubq_u16(vdupq_n_u16(256), vmovl_u8(vs.val[3]));
+		z = vceq_u8(vs.val[3], vdup_n_u8(0));
+		vr.val[0] = vbsl_u8(z, vd.val[0], vadd_u8(vs.val[0], neon_scale(vd.val[0], ia)));
+		vr.val[1] = vbsl_u8(z, vd.val[1], vadd_u8(vs.val[1], neon_scale(vd.val[1], ia)));
+		vr.val[2] = vbsl_u8(z, vd.val[2], vadd_u8(vs.val[2], neon_scale(vd.val[2], ia)));
+		vr.val[3] = vbsl_u8(z, vd.val[3], vadd_u8(vs.val[3], neon_scale(vd.val[3], ia)));
+		vst4_u8((uint8_t *)d, vr);
+	}
+	span_c_blend(d, s, n);
+}
+
+static void span_neon_fill(uint32_t * d, uint32_t c, int n)
+{
+	uint32x4_t vc = vdupq_n_u32(c);
+
+	for(; n >= 4; n -= 4, d += 4)
+		vst1q_u32(d, vc);
+	span_c_fill(d, c, n);
+}
+
+static inline uint8x8_t neon_dot3(uint8x8x4_t v, uint16_t cb, uint16_t cg, uint16_t cr)
+{
+	uint16x8_t b = vmovl_u8(v.val[0]);
+	uint16x8_t g = vmovl_u8(v.val[1]);
+	uint16x8_t r = vmovl_u8(v.val[2]);
+	uint32x4_t lo, hi;
+
+	lo = vmull_u16(vget_low_u16(r), vdup_n_u16(cr));
+	lo = vmlal_u16(lo, vget_low_u16(g), vdup_n_u16(cg));
+	lo = vmlal_u16(lo, vget_low_u16(b), vdup_n_u16(cb));
+	hi = vmull_u16(vget_high_u16(r), vdup_n_u16(cr));
+	hi = vmlal_u16(hi, vget_high_u16(g), vdup_n_u16(cg));
+	hi = vmlal_u16(hi, vget_high_u16(b), vdup_n_u16(cb));
+	return vqmovn_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+}
+
+static void span_neon_gray(uint32_t * p, int n)
+{
+	uint8x8x4_t o, v;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		o = vld4_u8((uint8_t *)p);
+		v = o;
+		v.val[0] = neon_dot3(o, 7472, 38469, 19595);
+		v.val[1] = v.val[0];
+		v.val[2] = v.val[0];
+		vst4_u8((uint8_t *)p, neon_keep_transparent(o, v));
+	}
+	span_c_gray(p, n);
+}
+
+static void span_neon_sepia(uint32_t * p, int n)
+{
+	uint8x8x4_t o, v;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		o = vld4_u8((uint8_t *)p);
+		v = o;
+		v.val[0] = neon_dot3(o, 8585, 34996, 17826);
+		v.val[1] = neon_dot3(o, 11010, 44958, 22872);
+		v.val[2] = neon_dot3(o, 12386, 50397, 25756);
+		vst4_u8((uint8_t *)p, neon_keep_transparent(o, v));
+	}
+	span_c_sepia(p, n);
+}
+
+static void span_neon_invert(uint32_t * p, int n)
+{
+	uint8x8x4_t o, v;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		o = vld4_u8((uint8_t *)p);
+		v = o;
+		v.val[0] = vsub_u8(o.val[3], o.val[0]);
+		v.val[1] = vsub_u8(o.val[3], o.val[1]);
+		v.val[2] = vsub_u8(o.val[3], o.val[2]);
+		vst4_u8((uint8_t *)p, neon_keep_transparent(o, v));
+	}
+	span_c_invert(p, n);
+}
+
+static void span_neon_opacity(uint32_t * p, int n, int v)
+{
+	uint16x8_t f = vdupq_n_u16(v);
+	uint8x8x4_t o, x;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		o = vld4_u8((uint8_t *)p);
+		x.val[0] = neon_scale(o.val[0], f);
+		x.val[1] = neon_scale(o.val[1], f);
+		x.val[2] = neon_scale(o.val[2], f);
+		x.val[3] = neon_scale(o.val[3], f);
+		vst4_u8((uint8_t *)p, neon_keep_transparent(o, x));
+	}
+	span_c_opacity(p, n, v);
+}
+
+static void span_neon_brightness(uint32_t * p, int n, int v)
+{
+	uint8x8_t t = vdup_n_u8((v < 0) ? -v : v);
+	uint8x8x4_t x;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		x = vld4_u8((uint8_t *)p);
+		if(!neon_all_opaque(x.val[3]))
+		{
+			span_c_brightness(p, 8, v);
+			continue;
+		}
+		if(v < 0)
+		{
+			x.val[0] = vqsub_u8(x.val[0], t);
+			x.val[1] = vqsub_u8(x.val[1], t);
+			x.val[2] = vqsub_u8(x.val[2], t);
+		}
+		else
+		{
+			x.val[0] = vqadd_u8(x.val[0], t);
+			x.val[1] = vqadd_u8(x.val[1], t);
+			x.val[2] = vqadd_u8(x.val[2], t);
+		}
+		vst4_u8((uint8_t *)p, x);
+	}
+	span_c_brightness(p, n, v);
+}
+
+static inline uint8x8_t neon_contrast(uint8x8_t x, int16x8_t v)
+{
+	int16x8_t t = vreinterpretq_s16_u16(vmovl_u8(x));
+	int16x8_t d = vshrq_n_s16(vmulq_s16(vsubq_s16(t, vdupq_n_s16(128)), v), 7);
+	return vqmovun_s16(vaddq_s16(t, d));
+}
+
+static void span_neon_contrast(uint32_t * p, int n, int v)
+{
+	int16x8_t f = vdupq_n_s16(v);
+	uint8x8x4_t x;
+
+	for(; n >= 8; n -= 8, p += 8)
+	{
+		x = vld4_u8((uint8_t *)p);
+		if(!neon_all_opaque(x.val[3]))
+		{
+			span_c_contrast(p, 8, v);
+			continue;
+		}
+		x.val[0] = neon_contrast(x.val[0], f);
+		x.val[1] = neon_contrast(x.val[1], f);
+		x.val[2] = neon_contrast(x.val[2], f);
+		vst4_u8((uint8_t *)p, x);
+	}
+	span_c_contrast(p, n, v);
+}
+#if !defined(__ARM_NEON)
+#pragma GCC pop_options
+#endif
+
+static struct span_ops_t span_neon = {
+	.name		= "neon",
+	.blend		= span_neon_blend,
+	.fill		= span_neon_fill,
+	.gray		= span_neon_gray,
+	.sepia		= span_neon_sepia,
+	.invert		= span_neon_invert,
+	.opacity	= span_neon_opacity,
+	.brightness	= span_neon_brightness,
+	.contrast	= span_neon_contrast,
+};
+
+static int span_neon_probe(void)
+{
+#if defined(__aarch64__)
+	uint64_t pfr0;
+
+	__asm__ __volatile__("mrs %0, id_aa64pfr0_el1" : "=r" (pfr0));
+	return (((pfr0 >> 20) & 0xf) != 0xf) ? 1 : 0;
+#else
+	uint32_t cpacr, mvfr1;
+
+	__asm__ __volatile__("mrc p15, 0, %0, c1, c0, 2" : "=r" (cpacr));
+	if(cpacr & (1U << 31))
+		return 0;
+	__asm__ __volatile__("vmrs %0, mvfr1" : "=r" (mvfr1));
+	return (((mvfr1 >> 12) & 0xf) != 0) ? 1 : 0;
+#endif
+}
+#endif
+
+#if defined(__X64__)
+/*
+ * SSE2 kernels, four pixels per step with the channels widened to 16 bits
+ */
+static inline __m128i sse2_alpha(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline __m128i sse2_keep_transparent(__m128i a, __m128i o, __m128i v)
+{
+	__m128i z = _mm_cmpeq_epi32(_mm_srli_epi32(a, 24), _mm_setzero_si128());
+	return _mm_or_si128(_mm_and_si128(z, o), _mm_andnot_si128(z, v));
+}
+
+static inline __m128i sse2_blend_half(__m128i s, __m128i d)
+{
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(256), sse2_alpha(s));
+	__m128i r = _mm_add_epi16(s, _mm_srli_epi16(_mm_mullo_epi16(d, ia), 8));
+	return _mm_and_si128(r, _mm_set1_epi16(0xff));
+}
+
+static void span_sse2_blend(uint32_t * d, uint32_t * s, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i vs, vd, a;
+
+	for(; n >= 4; n -= 4, d += 4, s += 4)
+	{
+		vs = _mm_loadu_si128((__m128i *)s);
+		a = _mm_srli_epi32(vs, 24);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xffff)
+			continue;
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_set1_epi32(0xff))) == 0xffff)
+		{
+			_mm_storeu_si128((__m128i *)d, vs);
+			continue;
+		}
+		vd = _mm_loadu_si128((__m128i *)d);
+		a = _mm_packus_epi16(sse2_blend_half(_mm_unpacklo_epi8(vs, zero), _mm_unpacklo_epi8(vd, zero)), sse2_blend_half(_mm_unpackhi_epi8(vs, zero), _mm_unpackhi_epi8(vd, zero)));
+		_mm_storeu_si128((__m128i *)d, sse2_keep_transparent(vs, vd, a));
+	}
+	span_c_blend(d, s, n);
+}
+
+static void span_sse2_fill(uint32_t * d, uint32_t c, int n)
+{
+	__m128i vc = _mm_set1_epi32(c);
+
+	for(; n >= 4; n -= 4, d += 4)
+		_mm_storeu_si128((__m128i *)d, vc);
+	span_c_fill(d, c, n);
+}
+
+/*
+ * Weighted sum of b, g and r in 16.16 for two pixels widened to 16 bits. The
+ * green weight may exceed a signed 16 bits multiplier, so it is applied as
+ * (cg - 65536) and the missing g << 16 is added back after the shift.
+ */
+static inline __m128i sse2_dot3(__m128i x, int cb, int cg, int cr)
+{
+	__m128i c = _mm_set_epi16(0, cr, (cg > 32767) ? cg - 65536 : cg, cb, 0, cr, (cg > 32767) ? cg - 65536 : cg, cb);
+	__m128i m = _mm_madd_epi16(x, c);
+	m = _mm_add_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+	m = _mm_srai_epi32(m, 16);
+	if(cg > 32767)
+		m = _mm_add_epi32(m, _mm_and_si128(_mm_srli_epi64(x, 16), _mm_set_epi32(0, 0xff, 0, 0xff)));
+	return _mm_and_si128(m, _mm_set_epi32(0, -1, 0, -1));
+}
+
+static inline __m128i sse2_gray_half(__m128i x)
+{
+	__m128i g = sse2_dot3(x, 7472, 38469, 19595);
+	g = _mm_or_si128(_mm_or_si128(g, _mm_slli_epi32(g, 16)), _mm_slli_epi64(g, 32));
+	return _mm_or_si128(g, _mm_and_si128(x, _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0)));
+}
+
+static void span_sse2_gray(uint32_t * p, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i x, t;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		t = _mm_packus_epi16(sse2_gray_half(_mm_unpacklo_epi8(x, zero)), sse2_gray_half(_mm_unpackhi_epi8(x, zero)));
+		_mm_storeu_si128((__m128i *)p, sse2_keep_transparent(x, x, t));
+	}
+	span_c_gray(p, n);
+}
+
+static inline __m128i sse2_sepia_half(__m128i x)
+{
+	__m128i b = sse2_dot3(x, 8585, 34996, 17826);
+	__m128i g = sse2_dot3(x, 11010, 44958, 22872);
+	__m128i r = sse2_dot3(x, 12386, 50397, 25756);
+	__m128i a = _mm_and_si128(_mm_srli_epi64(x, 48), _mm_set_epi32(0, 0xff, 0, 0xff));
+	__m128i t = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi64(g, 16)), _mm_or_si128(_mm_slli_epi64(r, 32), _mm_slli_epi64(a, 48)));
+	return _mm_min_epi16(t, _mm_set1_epi16(255));
+}
+
+static void span_sse2_sepia(uint32_t * p, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i x, t;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		t = _mm_packus_epi16(sse2_sepia_half(_mm_unpacklo_epi8(x, zero)), sse2_sepia_half(_mm_unpackhi_epi8(x, zero)));
+		_mm_storeu_si128((__m128i *)p, sse2_keep_transparent(x, x, t));
+	}
+	span_c_sepia(p, n);
+}
+
+static void span_sse2_invert(uint32_t * p, int n)
+{
+	__m128i amask = _mm_set1_epi32(0xff000000);
+	__m128i x, a;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		a = _mm_and_si128(x, amask);
+		a = _mm_or_si128(a, _mm_srli_epi32(a, 8));
+		a = _mm_or_si128(a, _mm_srli_epi32(a, 16));
+		a = _mm_or_si128(_mm_andnot_si128(amask, _mm_sub_epi8(a, x)), _mm_and_si128(x, amask));
+		_mm_storeu_si128((__m128i *)p, sse2_keep_transparent(x, x, a));
+	}
+	span_c_invert(p, n);
+}
+
+static void span_sse2_opacity(uint32_t * p, int n, int v)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i f = _mm_set1_epi16(v);
+	__m128i x, lo, hi;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), f), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), f), 8);
+		_mm_storeu_si128((__m128i *)p, sse2_keep_transparent(x, x, _mm_packus_epi16(lo, hi)));
+	}
+	span_c_opacity(p, n, v);
+}
+
+static inline int sse2_all_opaque(__m128i x)
+{
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(x, _mm_set1_epi32(0x00ffffff)), _mm_set1_epi32(-1))) == 0xffff) ? 1 : 0;
+}
+
+static void span_sse2_brightness(uint32_t * p, int n, int v)
+{
+	__m128i t = _mm_set1_epi32(((v < 0) ? -v : v) * 0x010101);
+	__m128i x;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		if(!sse2_all_opaque(x))
+		{
+			span_c_brightness(p, 4, v);
+			continue;
+		}
+		x = (v < 0) ? _mm_subs_epu8(x, t) : _mm_adds_epu8(x, t);
+		_mm_storeu_si128((__m128i *)p, x);
+	}
+	span_c_brightness(p, n, v);
+}
+
+static inline __m128i sse2_contrast_half(__m128i x, __m128i f)
+{
+	__m128i d = _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(x, _mm_set1_epi16(128)), f), 7);
+	__m128i r = _mm_add_epi16(x, d);
+	return _mm_or_si128(_mm_and_si128(r, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)), _mm_and_si128(x, _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0)));
+}
+
+static void span_sse2_contrast(uint32_t * p, int n, int v)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i f = _mm_set1_epi16(v);
+	__m128i x;
+
+	for(; n >= 4; n -= 4, p += 4)
+	{
+		x = _mm_loadu_si128((__m128i *)p);
+		if(!sse2_all_opaque(x))
+		{
+			span_c_contrast(p, 4, v);
+			continue;
+		}
+		x = _mm_packus_epi16(sse2_contrast_half(_mm_unpacklo_epi8(x, zero), f), sse2_contrast_half(_mm_unpackhi_epi8(x, zero), f));
+		_mm_storeu_si128((__m128i *)p, x);
+	}
+	span_c_contrast(p, n, v);
+}
+
+static struct span_ops_t span_sse2 = {
+	.name		= "sse2",
+	.blend		= span_sse2_blend,
+	.fill		= span_sse2_fill,
+	.gray		= span_sse2_gray,
+	.sepia		= span_sse2_sepia,
+	.invert		= span_sse2_invert,
+	.opacity	= span_sse2_opacity,
+	.brightness	= span_sse2_brightness,
+	.contrast	= span_sse2_contrast,
+};
+
+/*
+ * AVX2 kernels for the two hottest spans, selected at runtime
+ */
+__attribute__((target("avx2"))) static inline __m256i avx2_blend_half(__m256i s, __m256i d)
+{
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(256), a);
+	__m256i r = _mm256_add_epi16(s, _mm256_srli_epi16(_mm256_mullo_epi16(d, ia), 8));
+	return _mm256_and_si256(r, _mm256_set1_epi16(0xff));
+}
+
+__attribute__((target("avx2"))) static void span_avx2_blend(uint32_t * d, uint32_t * s, int n)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i vs, vd, vr, z;
+
+	for(; n >= 8; n -= 8, d += 8, s += 8)
+	{
+		vs = _mm256_loadu_si256((__m256i *)s);
+		if(_mm256_testz_si256(vs, _mm256_set1_epi32(0xff000000)))
+			continue;
+		vd = _mm256_loadu_si256((__m256i *)d);
+		vr = _mm256_packus_epi16(avx2_blend_half(_mm256_unpacklo_epi8(vs, zero), _mm256_unpacklo_epi8(vd, zero)), avx2_blend_half(_mm256_unpackhi_epi8(vs, zero), _mm256_unpackhi_epi8(vd, zero)));
+		z = _mm256_cmpeq_epi32(_mm256_srli_epi32(vs, 24), zero);
+		_mm256_storeu_si256((__m256i *)d, _mm256_blendv_epi8(vr, vd, z));
+	}
+	span_sse2_blend(d, s, n);
+}
+
+__attribute__((target("avx2"))) static void span_avx2_fill(uint32_t * d, uint32_t c, int n)
+{
+	__m256i vc = _mm256_set1_epi32(c);
+
+	for(; n >= 8; n -= 8, d += 8)
+		_mm256_storeu_si256((__m256i *)d, vc);
+	span_c_fill(d, c, n);
+}
+
+static struct span_ops_t span_avx2 = {
+	.name		= "avx2",
+	.blend		= span_avx2_blend,
+	.fill		= span_avx2_fill,
+	.gray		= span_sse2_gray,
+	.sepia		= span_sse2_sepia,
+	.invert		= span_sse2_invert,
+	.opacity	= span_sse2_opacity,
+	.brightness	= span_sse2_brightness,
+	.contrast	= span_sse2_contrast,
+};
+#endif
+
+static struct span_ops_t * __span_ops = NULL;
+
+struct span_ops_t * span_ops_get(void)
+{
+	if(unlikely(!__span_ops))
+	{
+#if defined(SPAN_NEON)
+		__span_ops = span_neon_probe() ? &span_neon : &span_c;
+#elif defined(__X64__)
+		__builtin_cpu_init();
+		__span_ops = __builtin_cpu_supports("avx2") ? &span_avx2 : &span_sse2;
+#else
+		__span_ops = &span_c;
+#endif
+	}
+	return __span_ops;
+}
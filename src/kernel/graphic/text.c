@@ -38,8 +38,134 @@
 #include <freetype/freetype.h>
 #include <freetype/ftcache.h>
 
+/*
+ * Lay out a string once with atlas glyphs and keep the result in the font
+ * context, measure and draw then replay the run instead of walking the font
+ * lookup for every codepoint. Returns NULL when the run can not be cached,
+ * callers fall back to the direct path.
+ */
+static struct font_run_t * text_run(struct text_t * txt)
+{
+	struct font_context_t * ctx = txt->fctx;
+	struct font_run_t * run;
+	struct font_glyph_t * g;
+	unsigned int generation;
+	const char * p;
+	uint32_t code;
+	int col = 0, row = 0;
+	int tw = 0, th = 0, lh = 0, ty = 0;
+	int x = 0, y = 0, w = 0, h = 0;
+
+	if(!ctx || !txt->utf8 || (txt->size > 96))
+		return NULL;
+	if((run = font_run_lookup(ctx, txt->family, txt->size, txt->wrap, txt->utf8)))
+		return run;
+	if(!(run = font_run_alloc(ctx, txt->family, txt->size, txt->wrap, txt->utf8)))
+		return NULL;
+	generation = ctx->generation;
+
+	p = txt->utf8;
+	while(*p)
+	{
+		p = utf8_to_code(p, &code);
+		switch(code)
+		{
+		case '\r':
+			tw = 0;
+			ty = 0;
+			if(tw > w)
+				w = tw;
+			if(th > h)
+				h = th;
+			col = 0;
+			break;
+
+		case '\n':
+			tw = 0;
+			th += txt->size;
+			ty = 0;
+			lh = 0;
+			if(tw > w)
+				w = tw;
+			if(th > h)
+				h = th;
+			col = 0;
+			row++;
+			break;
+
+		case '\t':
+			tw += txt->size << 1;
+			ty = 0;
+			if(tw > w)
+				w = tw;
+			if(th > h)
+				h = th;
+			col++;
+			break;
+
+		default:
+			g = font_glyph_lookup(ctx, txt->family, txt->size, code);
+			if(g)
+			{
+				if((txt->wrap > 0) && (tw + g->xadvance > txt->wrap))
+				{
+					tw = 0;
+					th += txt->size;
+					ty = 0;
+					lh = 0;
+					if(tw > w)
+						w = tw;
+					if(th > h)
+						h = th;
+					col = 0;
+					row++;
+				}
+				if(g->buffer)
+				{
+					run->glyphs[run->count].g = g;
+					run->glyphs[run->count].x = tw;
+					run->glyphs[run->count].y = th + ty - g->top;
+					run->count++;
+				}
+				tw += g->xadvance;
+				ty += g->yadvance;
+				if(g->yadvance + g->height > lh)
+					lh = g->yadvance + g->height;
+				if(tw > w)
+					w = tw;
+				if(th > h)
+					h = th;
+				if(col == 0)
+				{
+					if(g->left > x)
+						x = g->left;
+				}
+				if(row == 0)
+				{
+					if(g->top > y)
+						y = g->top;
+				}
+			}
+			col++;
+			break;
+		}
+	}
+	if(ctx->generation != generation)
+	{
+		font_run_free(run);
+		return NULL;
+	}
+	run->ox = x;
+	run->oy = y;
+	run->width = w;
+	run->height = h + lh;
+	font_run_insert(ctx, run);
+	return run;
+}
+
 static void text_metrics(struct text_t * txt)
 {
+	struct font_run_t * run;
 	FTC_SBit sbit;
 	FT_BitmapGlyph bitmap;
 	FT_Glyph glyph, gly;
@@ -49,6 +175,14 @@ static void text_metrics(struct text_t * txt)
 	int tw = 0, th = 0, lh = 0;
 	int x = 0, y = 0, w = 0, h = 0;
 
+	if((run = text_run(txt)))
+	{
+		txt->metrics.ox = run->ox;
+		txt->metrics.oy = run->oy;
+		txt->metrics.width = run->width;
+		txt->metrics.height = run->height;
+		return;
+	}
 	if(txt->size <= 96)
 	{
 		p = txt->utf8;
@@ -348,6 +482,64 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 	}
 }
 
+static inline void draw_font_atlas(struct surface_t * s, struct region_t * area, struct color_t * c, uint32_t color, int x, int y, struct font_glyph_t * g)
+{
+	struct region_t r;
+	uint32_t * dp, dv;
+	uint8_t * sp, gray;
+	uint8_t da, dr, dg, db;
+	uint8_t sr, sg, sb, sa;
+	uint8_t ta, tr, tg, tb;
+	int dskip, sskip;
+	int i, j, t;
+
+	region_init(&r, x, y, g->width, g->height);
+	if(!region_intersect(&r, &r, area))
+		return;
+
+	dskip = s->width - r.w;
+	sskip = g->pitch - r.w;
+	dp = (uint32_t *)s->pixels + r.y * s->width + r.x;
+	sp = g->buffer + (r.y - y) * g->pitch + (r.x - x);
+
+	for(j = 0; j < r.h; j++)
+	{
+		for(i = 0; i < r.w; i++)
+		{
+			gray = *sp;
+			if(gray != 0)
+			{
+				if((gray == 255) && (c->a == 255))
+				{
+					*dp = color;
+				}
+				else
+				{
+					sr = idiv255(c->r * gray);
+					sg = idiv255(c->g * gray);
+					sb = idiv255(c->b * gray);
+					sa = idiv255(c->a * gray);
+					dv = *dp;
+					da = (dv >> 24) & 0xff;
+					dr = (dv >> 16) & 0xff;
+					dg = (dv >> 8) & 0xff;
+					db = (dv >> 0) & 0xff;
+					t = sa + (sa >> 8);
+					ta = (((sa + da) << 8) - da * t) >> 8;
+					tr = (((sr + dr) << 8) - dr * t) >> 8;
+					tg = (((sg + dg) << 8) - dg * t) >> 8;
+					tb = (((sb + db) << 8) - db * t) >> 8;
+					*dp = (ta << 24) | (tr << 16) | (tg << 8) | (tb << 0);
+				}
+			}
+			sp++;
+			dp++;
+		}
+		dp += dskip;
+		sp += sskip;
+	}
+}
+
 static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip, struct color_t * c, int x, int y, FT_Bitmap * bitmap)
 {
 	struct region_t region, r;
@@ -424,6 +616,8 @@ static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip,
 
 void render_default_text(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct text_t * txt)
 {
+	struct font_run_t * run;
+	struct region_t area;
 	FTC_SBit sbit;
 	FT_BitmapGlyph bitmap;
 	FT_Glyph glyph, gly;
@@ -431,9 +625,25 @@ void render_default_text(struct surface_t * s, struct region_t * clip, struct ma
 	FT_Vector pen;
 	const char * p;
 	uint32_t code;
+	uint32_t color;
 	int tx, ty, tw;
+	int i;
 
-	if((txt->size <= 96) && (m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0))
+	if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0) && (run = text_run(txt)))
+	{
+		region_init(&area, 0, 0, s->width, s->height);
+		if(clip)
+		{
+			if(!region_intersect(&area, &area, clip))
+				return;
+		}
+		color = color_get_premult(txt->c);
+		tx = (int)(m->tx + run->ox);
+		ty = (int)(m->ty + run->oy);
+		for(i = 0; i < run->count; i++)
+			draw_font_atlas(s, &area, txt->c, color, tx + run->glyphs[i].x, ty + run->glyphs[i].y, run->glyphs[i].g);
+	}
+	else if((txt->size <= 96) && (m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0))
 	{
 		tx = txt->metrics.ox;
 		ty = txt->metrics.oy;
@@ -54,6 +54,10 @@ struct sound_t * sound_alloc(int sample)
 	snd->postion = 0;
 	snd->lvol = 4096;
 	snd->rvol = 4096;
+	snd->clvol = 4096;
+	snd->crvol = 4096;
+	snd->active = 0;
+	snd->stream = NULL;
 	snd->gain = 1.0f;
 	snd->pan = 0.0f;
 	snd->loop = 1;
@@ -62,35 +66,23 @@ struct sound_t * sound_alloc(int sample)
 	return snd;
 }
 
+static void sound_stream_release(struct sound_t * snd);
+
 void sound_free(struct sound_t * snd)
 {
 	if(snd)
 	{
+		if(snd->stream)
+		{
+			sound_stream_release(snd);
+			return;
+		}
 		if(snd->source)
 			free(snd->source);
 		free(snd);
 	}
 }
 
-static void sound_resample(int16_t * out, int osr, int osample, int16_t * in, int isr, int isample, int channel)
-{
-	if(out && in)
-	{
-		float fixed = (1.0 / (1LL << 32));
-		uint64_t frac = (1LL << 32);
-		uint64_t step = ((uint64_t)((float)isr / (float)osr * frac + 0.5));
-		uint64_t offset = 0;
-		for(int i = 0; i < osample; i += 1)
-		{
-			for(int c = 0; c < channel; c++)
-				*out++ = (int16_t)(in[c] + (in[c + channel] - in[c]) * ((float)(offset >> 32) + ((offset & (frac - 1)) * fixed)));
-			offset += step;
-			in += (offset >> 32) * channel;
-			offset &= (frac - 1);
-		}
-	}
-}
-
 struct wav_header_t {
 	uint8_t riff[4];
 	uint32_t riffsz;
@@ -107,205 +99,581 @@ struct wav_header_t {
 	uint32_t datasz;
 };
 
-static inline struct sound_t * sound_alloc_from_xfs_wav(struct xfs_context_t * ctx, const char * filename)
+static int sound_wav_header(struct wav_header_t * h)
 {
-	struct wav_header_t header;
-	struct xfs_file_t * file;
+	h->riffsz = be32_to_cpu(h->riffsz);
+	h->fmtsz = be32_to_cpu(h->fmtsz);
+	h->fmttag = be16_to_cpu(h->fmttag);
+	h->channel = be16_to_cpu(h->channel);
+	h->samplerate = be32_to_cpu(h->samplerate);
+	h->byterate = be32_to_cpu(h->byterate);
+	h->align = be16_to_cpu(h->align);
+	h->bps = be16_to_cpu(h->bps);
+	h->datasz = be32_to_cpu(h->datasz);
+
+	if( (memcmp(h->riff, "RIFF", 4) != 0) ||
+		(memcmp(h->wave, "WAVE", 4) != 0) ||
+		(memcmp(h->fmt,  "fmt ", 4) != 0) ||
+		(memcmp(h->data, "data", 4) != 0) ||
+		(h->fmttag != 1) || (h->datasz < h->align) )
+		return 0;
+	if(((h->channel != 1) && (h->channel != 2)) || ((h->bps != 8) && (h->bps != 16)) || (h->align != h->channel * (h->bps >> 3)))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Streaming sounds keep a small ring of 48khz stereo frames in place of the
+ * whole PCM. A background task reads the file on demand, decodes and
+ * resamples into the ring, the mixer only consumes it, so neither side
+ * takes a lock.
+ */
+#define STB_VORBIS_NO_STDIO
+#include <stb_vorbis.c.h>
+
+struct sound_stream_t {
+	struct list_head list;
 	struct sound_t * snd;
-	uint32_t tmp[512];
-	uint32_t * inbuf;
-	int isample, osample;
 
-	if(!(file = xfs_open_read(ctx, filename)))
-		return NULL;
+	struct xfs_context_t * xfs;
+	struct xfs_file_t * file;
+
+	int (*decode)(struct sound_stream_t * s);
+	int (*rewind)(struct sound_stream_t * s);
+	void (*close)(struct sound_stream_t * s);
 
-	if(xfs_read(file, &header, sizeof(struct wav_header_t)) != sizeof(struct wav_header_t))
+	struct {
+		int64_t start;
+		int64_t datasz;
+		int64_t remain;
+		int channel;
+		int bps;
+		int align;
+	} wav;
+
+	struct {
+		stb_vorbis * v;
+		uint8_t * buf;
+		int len;
+		int cap;
+	} ogg;
+
+	int rate;
+	int16_t * pcm;
+	int cpcm;
+	uint32_t * out;
+	int nout;
+	int pout;
+	int cout;
+	uint64_t step;
+	uint64_t offset;
+	int16_t last[2];
+	int primed;
+
+	unsigned int in;
+	unsigned int rd;
+	unsigned int size;
+	int played;
+	int playing;
+	int eof;
+	int dead;
+};
+
+static struct {
+	struct list_head list;
+	spinlock_t lock;
+	struct task_t * task;
+} __sound_stream = {
+	.list = { &__sound_stream.list, &__sound_stream.list },
+	.lock = SPIN_LOCK_INIT(),
+	.task = NULL,
+};
+
+static int64_t sound_stream_input(struct sound_stream_t * s, void * buf, int64_t len)
+{
+	return xfs_read(s->file, buf, len);
+}
+
+static void sound_stream_seek(struct sound_stream_t * s, int64_t offset)
+{
+	xfs_seek(s->file, offset);
+}
+
+static int sound_stream_pcm(struct sound_stream_t * s, int frames)
+{
+	int16_t * pcm;
+
+	if(frames > s->cpcm)
 	{
-		xfs_close(file);
-		return NULL;
+		pcm = realloc(s->pcm, frames << 2);
+		if(!pcm)
+			return 0;
+		s->pcm = pcm;
+		s->cpcm = frames;
 	}
+	return 1;
+}
 
-	header.riffsz = be32_to_cpu(header.riffsz);
-	header.fmtsz = be32_to_cpu(header.fmtsz);
-	header.fmttag = be16_to_cpu(header.fmttag);
-	header.channel = be16_to_cpu(header.channel);
-	header.samplerate = be32_to_cpu(header.samplerate);
-	header.byterate = be32_to_cpu(header.byterate);
-	header.align = be16_to_cpu(header.align);
-	header.bps = be16_to_cpu(header.bps);
-	header.datasz = be32_to_cpu(header.datasz);
-
-	if( (memcmp(header.riff, "RIFF", 4) != 0) ||
-		(memcmp(header.wave, "WAVE", 4) != 0) ||
-		(memcmp(header.fmt,  "fmt ", 4) != 0) ||
-		(memcmp(header.data, "data", 4) != 0) ||
-		(header.fmttag != 1) || (header.datasz < header.align) )
+/*
+ * Incremental linear resampler, the last input frame of a chunk is carried
+ * over so interpolation runs across chunk boundaries
+ */
+static void sound_stream_resample(struct sound_stream_t * s, int16_t * in, int n)
+{
+	uint32_t * out;
+	int16_t * a, * b;
+	int64_t frac;
+	int idx, max;
+
+	if(n <= 0)
+		return;
+	max = (int)(((uint64_t)n << 32) / s->step) + 2;
+	if(s->nout + max > s->cout)
 	{
-		xfs_close(file);
-		return NULL;
+		out = realloc(s->out, (s->nout + max) << 2);
+		if(!out)
+			return;
+		s->out = out;
+		s->cout = s->nout + max;
 	}
-	if(((header.channel != 1) && (header.channel != 2)) || ((header.bps != 8) && (header.bps != 16)))
+	if(!s->primed)
 	{
-		xfs_close(file);
-		return NULL;
+		s->last[0] = in[0];
+		s->last[1] = in[1];
+		s->offset = 1ULL << 32;
+		s->primed = 1;
 	}
-
-	isample = header.datasz / header.align;
-	osample = isample * 48000.0 / header.samplerate;
-	osample -= osample % 2;
-	inbuf = malloc(isample << 2);
-	if(!inbuf)
+	while((s->offset >> 32) < (uint64_t)n)
 	{
-		xfs_close(file);
-		return NULL;
+		idx = (int)(s->offset >> 32) - 1;
+		a = (idx < 0) ? s->last : &in[idx << 1];
+		b = &in[(idx + 1) << 1];
+		frac = (s->offset & 0xffffffff) >> 16;
+		s->out[s->nout++] = ((uint16_t)(a[1] + (((b[1] - a[1]) * frac) >> 16)) << 16) | (uint16_t)(a[0] + (((b[0] - a[0]) * frac) >> 16));
+		s->offset += s->step;
 	}
-	snd = sound_alloc(osample);
-	if(!snd)
+	s->offset -= (uint64_t)n << 32;
+	s->last[0] = in[(n - 1) << 1];
+	s->last[1] = in[((n - 1) << 1) + 1];
+}
+
+/*
+ * When priming, stop at the end of the data without deciding whether to
+ * loop, the loop count may still change until playback starts
+ */
+static void sound_stream_fill(struct sound_stream_t * s, int prime)
+{
+	uint32_t * ring = s->snd->source;
+	unsigned int space, in;
+	int n;
+
+	while(!s->eof)
 	{
-		free(inbuf);
-		xfs_close(file);
-		return NULL;
+		if(s->pout < s->nout)
+		{
+			in = s->in;
+			space = s->size - (in - s->rd);
+			n = min((unsigned int)(s->nout - s->pout), space);
+			if(n <= 0)
+				return;
+			while(n-- > 0)
+				ring[in++ & (s->size - 1)] = s->out[s->pout++];
+			smp_wmb();
+			s->in = in;
+			continue;
+		}
+		s->nout = 0;
+		s->pout = 0;
+		if((n = s->decode(s)) > 0)
+		{
+			sound_stream_resample(s, s->pcm, n);
+			continue;
+		}
+		if((n == 0) && prime)
+			return;
+		s->played++;
+		if((n < 0) || ((s->snd->loop >= 0) && (s->played >= s->snd->loop)) || (s->rewind(s) < 0))
+		{
+			smp_wmb();
+			s->eof = 1;
+		}
 	}
-	if(header.channel == 1)
+}
+
+static void sound_stream_free(struct sound_stream_t * s)
+{
+	if(s->close)
+		s->close(s);
+	if(s->file)
+		xfs_close(s->file);
+	if(s->xfs)
+		xfs_free(s->xfs);
+	if(s->pcm)
+		free(s->pcm);
+	if(s->out)
+		free(s->out);
+	if(s->snd->source)
+		free(s->snd->source);
+	free(s->snd);
+	free(s);
+}
+
+static void sound_stream_task(struct task_t * task, void * data)
+{
+	struct sound_stream_t * pos, * n;
+	struct list_head list;
+	irq_flags_t flags;
+
+	while(1)
 	{
-		if(header.bps == 8)
+		init_list_head(&list);
+		spin_lock_irqsave(&__sound_stream.lock, flags);
+		list_splice_init(&__sound_stream.list, &list);
+		spin_unlock_irqrestore(&__sound_stream.lock, flags);
+		list_for_each_entry_safe(pos, n, &list, list)
 		{
-			int16_t * p = (int16_t *)inbuf;
-			int8_t * q = (int8_t *)tmp;
-			int16_t v;
-			int64_t n, i;
-			while((n = xfs_read(file, tmp, sizeof(tmp))) > 0)
+			if(pos->dead)
 			{
-				for(i = 0; i < n; i++)
-				{
-					v = q[i] << 8;
-					*p++ = v;
-					*p++ = v;
-				}
+				list_del(&pos->list);
+				sound_stream_free(pos);
 			}
-		}
-		else if(header.bps == 16)
-		{
-			int16_t * p = (int16_t *)inbuf;
-			int16_t * q = (int16_t *)tmp;
-			int16_t v;
-			int64_t n, i;
-			while((n = xfs_read(file, tmp, sizeof(tmp))) > 0)
+			else if(pos->playing)
 			{
-				for(i = 0; i < (n >> 1); i++)
-				{
-					v = q[i];
-					*p++ = v;
-					*p++ = v;
-				}
+				sound_stream_fill(pos, 0);
 			}
 		}
+		spin_lock_irqsave(&__sound_stream.lock, flags);
+		list_splice(&list, &__sound_stream.list);
+		spin_unlock_irqrestore(&__sound_stream.lock, flags);
+		task_sleep(UINT64_MAX);
+	}
+}
+
+static struct sound_t * sound_stream_start(struct sound_stream_t * s, int sample)
+{
+	struct sound_t * snd;
+	irq_flags_t flags;
+
+	snd = sound_alloc(CONFIG_SOUND_STREAM_FRAMES);
+	if(!snd)
+		return NULL;
+	snd->sample = sample;
+	snd->stream = s;
+	s->snd = snd;
+	s->size = CONFIG_SOUND_STREAM_FRAMES;
+	s->step = (((uint64_t)s->rate << 32) + 24000) / 48000;
+	sound_stream_fill(s, 1);
+
+	spin_lock_irqsave(&__sound_stream.lock, flags);
+	list_add_tail(&s->list, &__sound_stream.list);
+	if(!__sound_stream.task)
+	{
+		__sound_stream.task = task_create(NULL, "sound", sound_stream_task, NULL, 0, 0);
+		spin_unlock_irqrestore(&__sound_stream.lock, flags);
+		task_resume(__sound_stream.task);
+	}
+	else
+	{
+		spin_unlock_irqrestore(&__sound_stream.lock, flags);
+	}
+	return snd;
+}
+
+/*
+ * The completion callback may run from the mixer, leave the actual teardown
+ * to the stream task
+ */
+static void sound_stream_release(struct sound_t * snd)
+{
+	struct sound_stream_t * s = snd->stream;
+
+	s->dead = 1;
+	task_wakeup(__sound_stream.task);
+}
+
+int sound_stream_peek(struct sound_t * snd, uint32_t ** buf)
+{
+	struct sound_stream_t * s = snd->stream;
+	unsigned int in = s->in, rd = s->rd;
+	unsigned int n = in - rd, idx;
+
+	smp_rmb();
+	s->playing = 1;
+	if((n == 0) && !s->eof)
+		task_wakeup(__sound_stream.task);
+	idx = rd & (s->size - 1);
+	if(n > s->size - idx)
+		n = s->size - idx;
+	*buf = &snd->source[idx];
+	return (int)n;
+}
+
+void sound_stream_advance(struct sound_t * snd, int n)
+{
+	struct sound_stream_t * s = snd->stream;
+
+	s->rd += n;
+	snd->postion += n;
+	if((s->in - s->rd) < (s->size >> 1))
+		task_wakeup(__sound_stream.task);
+}
+
+int sound_stream_eof(struct sound_t * snd)
+{
+	struct sound_stream_t * s = snd->stream;
+	int eof = s->eof;
+
+	smp_rmb();
+	return eof && (s->in == s->rd);
+}
+
+static int sound_stream_wav_decode(struct sound_stream_t * s)
+{
+	uint8_t tmp[4096];
+	int16_t * p;
+	int64_t len;
+	int n, i;
+
+	len = min(s->wav.remain, (int64_t)(sizeof(tmp) / s->wav.align) * s->wav.align);
+	if(len <= 0)
+		return 0;
+	if((len = sound_stream_input(s, tmp, len)) <= 0)
+		return 0;
+	s->wav.remain -= len;
+	n = len / s->wav.align;
+	if(!sound_stream_pcm(s, n))
+		return -1;
+	p = s->pcm;
+	if(s->wav.channel == 1)
+	{
+		if(s->wav.bps == 8)
+		{
+			for(i = 0; i < n; i++, p += 2)
+				p[0] = p[1] = (tmp[i] - 0x80) << 8;
+		}
+		else
+		{
+			for(i = 0; i < n; i++, p += 2)
+				p[0] = p[1] = ((int16_t *)tmp)[i];
+		}
 	}
-	else if(header.channel == 2)
+	else
 	{
-		if(header.bps == 8)
+		if(s->wav.bps == 8)
 		{
-			int16_t * p = (int16_t *)inbuf;
-			int8_t * q = (int8_t *)tmp;
-			int64_t n, i;
-			while((n = xfs_read(file, tmp, sizeof(tmp))) > 0)
-			{
-				for(i = 0; i < n; i += 2)
-				{
-					*p++ = q[i] << 8;
-					*p++ = q[i + 1] << 8;
-				}
-			}
+			for(i = 0; i < (n << 1); i++)
+				p[i] = (tmp[i] - 0x80) << 8;
 		}
-		else if(header.bps == 16)
+		else
 		{
-			xfs_read(file, inbuf, header.datasz);
+			memcpy(p, tmp, n << 2);
 		}
 	}
-	sound_resample((int16_t *)snd->source, 48000, osample, (int16_t *)inbuf, header.samplerate, isample, 2);
-	free(inbuf);
-	xfs_close(file);
+	return n;
+}
 
-	return snd;
+static int sound_stream_wav_rewind(struct sound_stream_t * s)
+{
+	sound_stream_seek(s, s->wav.start);
+	s->wav.remain = s->wav.datasz;
+	return 0;
 }
 
-#define STB_VORBIS_NO_STDIO
-#include <stb_vorbis.c.h>
-static inline struct sound_t * sound_alloc_from_xfs_ogg(struct xfs_context_t * ctx, const char * filename)
+static int sound_stream_ogg_more(struct sound_stream_t * s)
 {
-	struct xfs_file_t * file;
-	struct sound_t * snd;
-	uint32_t * inbuf;
-	int isample, osample;
-	uint8_t * mem;
-	int64_t mlen;
-	int channel;
-	int rate;
-	short * ogg;
+	uint8_t * buf;
+	int64_t n;
 
-	if(!(file = xfs_open_read(ctx, filename)))
-		return NULL;
-	if((mlen = xfs_length(file)) <= 0)
+	if(s->ogg.len >= s->ogg.cap)
 	{
-		xfs_close(file);
-		return NULL;
+		if(s->ogg.cap >= SZ_256K)
+			return 0;
+		buf = realloc(s->ogg.buf, s->ogg.cap << 1);
+		if(!buf)
+			return 0;
+		s->ogg.buf = buf;
+		s->ogg.cap <<= 1;
 	}
-	if(!(mem = malloc(mlen)))
+	n = sound_stream_input(s, s->ogg.buf + s->ogg.len, s->ogg.cap - s->ogg.len);
+	if(n <= 0)
+		return 0;
+	s->ogg.len += n;
+	return 1;
+}
+
+static void sound_stream_ogg_consume(struct sound_stream_t * s, int used)
+{
+	s->ogg.len -= used;
+	if(s->ogg.len > 0)
+		memmove(s->ogg.buf, s->ogg.buf + used, s->ogg.len);
+}
+
+static int sound_stream_ogg_open(struct sound_stream_t * s)
+{
+	stb_vorbis_info info;
+	int used, error;
+
+	s->ogg.len = 0;
+	while(sound_stream_ogg_more(s))
 	{
-		xfs_close(file);
-		return NULL;
+		s->ogg.v = stb_vorbis_open_pushdata(s->ogg.buf, s->ogg.len, &used, &error, NULL);
+		if(s->ogg.v)
+		{
+			sound_stream_ogg_consume(s, used);
+			info = stb_vorbis_get_info(s->ogg.v);
+			s->rate = info.sample_rate;
+			return 0;
+		}
+		if(error != VORBIS_need_more_data)
+			break;
 	}
-	if(xfs_read(file, mem, mlen) != mlen)
+	return -1;
+}
+
+static int sound_stream_ogg_decode(struct sound_stream_t * s)
+{
+	float ** output;
+	int16_t * p;
+	float * l, * r;
+	int used, channel, samples;
+	int i;
+
+	while(1)
 	{
-		xfs_close(file);
-		return NULL;
+		used = stb_vorbis_decode_frame_pushdata(s->ogg.v, s->ogg.buf, s->ogg.len, &channel, &output, &samples);
+		if((used == 0) && (samples == 0))
+		{
+			if(!sound_stream_ogg_more(s))
+				return 0;
+			continue;
+		}
+		sound_stream_ogg_consume(s, used);
+		if(samples > 0)
+			break;
 	}
-	xfs_close(file);
+	if(!sound_stream_pcm(s, samples))
+		return -1;
+	l = output[0];
+	r = (channel > 1) ? output[1] : output[0];
+	for(i = 0, p = s->pcm; i < samples; i++, p += 2)
+	{
+		p[0] = clamp((int)(l[i] * 32767.0f), -32768, 32767);
+		p[1] = clamp((int)(r[i] * 32767.0f), -32768, 32767);
+	}
+	return samples;
+}
 
-	isample = stb_vorbis_decode_memory(mem, mlen, &channel, &rate, &ogg);
-	if(isample <= 0)
+static int sound_stream_ogg_rewind(struct sound_stream_t * s)
+{
+	if(s->ogg.v)
 	{
-		free(mem);
-		return NULL;
+		stb_vorbis_close(s->ogg.v);
+		s->ogg.v = NULL;
 	}
-	osample = isample * 48000.0 / rate;
-	osample -= osample % 2;
-	inbuf = malloc(isample << 2);
-	if(!inbuf)
+	sound_stream_seek(s, 0);
+	return sound_stream_ogg_open(s);
+}
+
+static void sound_stream_ogg_close(struct sound_stream_t * s)
+{
+	if(s->ogg.v)
+		stb_vorbis_close(s->ogg.v);
+	if(s->ogg.buf)
+		free(s->ogg.buf);
+}
+
+/*
+ * A stream reads its file long after the caller has dropped its xfs context,
+ * so the file is opened again through a private context on the same mount
+ */
+static struct sound_stream_t * sound_stream_alloc(struct xfs_context_t * ctx, const char * filename)
+{
+	struct sound_stream_t * s;
+	struct xfs_file_t * file;
+
+	if(!(file = xfs_open_read(ctx, filename)))
+		return NULL;
+	s = malloc(sizeof(struct sound_stream_t));
+	if(!s)
 	{
-		free(mem);
-		free(ogg);
+		xfs_close(file);
 		return NULL;
 	}
-	snd = sound_alloc(osample);
-	if(!snd)
+	memset(s, 0, sizeof(struct sound_stream_t));
+	init_list_head(&s->list);
+	s->xfs = xfs_alloc(file->path->path, 0);
+	xfs_close(file);
+	if(!s->xfs || !(s->file = xfs_open_read(s->xfs, filename)))
 	{
-		free(mem);
-		free(ogg);
-		free(inbuf);
+		if(s->xfs)
+			xfs_free(s->xfs);
+		free(s);
 		return NULL;
 	}
-	if(channel == 1)
+	return s;
+}
+
+static void sound_stream_abort(struct sound_stream_t * s)
+{
+	if(s->close)
+		s->close(s);
+	if(s->pcm)
+		free(s->pcm);
+	if(s->out)
+		free(s->out);
+	xfs_close(s->file);
+	xfs_free(s->xfs);
+	free(s);
+}
+
+static inline struct sound_t * sound_alloc_from_xfs_wav(struct xfs_context_t * ctx, const char * filename)
+{
+	struct wav_header_t header;
+	struct sound_stream_t * s;
+	struct sound_t * snd;
+
+	if(!(s = sound_stream_alloc(ctx, filename)))
+		return NULL;
+	if((xfs_read(s->file, &header, sizeof(struct wav_header_t)) != sizeof(struct wav_header_t)) || !sound_wav_header(&header))
 	{
-		int16_t * p = (int16_t *)inbuf;
-		int16_t * q = (int16_t *)ogg;
-		int16_t v;
-		for(int i = 0; i < isample; i++)
-		{
-			v = q[i];
-			*p++ = v;
-			*p++ = v;
-		}
+		sound_stream_abort(s);
+		return NULL;
 	}
-	else if(channel == 2)
+	s->decode = sound_stream_wav_decode;
+	s->rewind = sound_stream_wav_rewind;
+	s->wav.start = sizeof(struct wav_header_t);
+	s->wav.datasz = header.datasz;
+	s->wav.remain = header.datasz;
+	s->wav.channel = header.channel;
+	s->wav.bps = header.bps;
+	s->wav.align = header.align;
+	s->rate = header.samplerate;
+	if((s->rate <= 0) || !(snd = sound_stream_start(s, (int)((int64_t)(header.datasz / header.align) * 48000 / header.samplerate))))
 	{
-		memcpy(inbuf, ogg, isample << 2);
+		sound_stream_abort(s);
+		return NULL;
 	}
-	sound_resample((int16_t *)snd->source, 48000, osample, (int16_t *)inbuf, rate, isample, 2);
-	free(mem);
-	free(ogg);
-	free(inbuf);
+	return snd;
+}
+
+static inline struct sound_t * sound_alloc_from_xfs_ogg(struct xfs_context_t * ctx, const char * filename)
+{
+	struct sound_stream_t * s;
+	struct sound_t * snd;
 
+	if(!(s = sound_stream_alloc(ctx, filename)))
+		return NULL;
+	s->decode = sound_stream_ogg_decode;
+	s->rewind = sound_stream_ogg_rewind;
+	s->close = sound_stream_ogg_close;
+	s->ogg.cap = SZ_4K;
+	s->ogg.buf = malloc(s->ogg.cap);
+	if(!s->ogg.buf || (sound_stream_ogg_open(s) < 0) || (s->rate <= 0) || !(snd = sound_stream_start(s, 0)))
+	{
+		sound_stream_abort(s);
+		return NULL;
+	}
 	return snd;
 }
 
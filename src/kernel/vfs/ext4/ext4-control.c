@@ -415,7 +415,8 @@ int ext4fs_control_sync(struct ext4fs_control_t * ctrl)
 	}
 
 	/* Flush cached data in device request queue */
-	block_sync(ctrl->bdev);
+	if(block_sync(ctrl->bdev) < 0)
+		return -1;
 
 	return 0;
 }
@@ -626,7 +626,8 @@ int fatfs_control_sync(struct fatfs_control_t * ctrl)
 	mutex_unlock(&ctrl->fat_cache_lock);
 
 	/* Flush cached data in device request queue */
-	block_sync(ctrl->bdev);
+	if(block_sync(ctrl->bdev) < 0)
+		return -1;
 
 	return 0;
 }
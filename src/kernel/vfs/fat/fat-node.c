@@ -212,32 +212,139 @@ static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t
 	return 0;
 }
 
-static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * cl_pos, u32_t * cl_num)
+static void fatfs_node_runs_invalidate(struct fatfs_node_t * node)
 {
-	struct fatfs_control_t *ctrl = node->ctrl;
+	node->runs_first = node->first_cluster;
+	node->runs_count = 0;
+	node->runs_end = FALSE;
+}
+
+static int fatfs_node_runs_append(struct fatfs_node_t * node, u32_t clust)
+{
+	struct fatfs_run_t * run;
+	u32_t size;
 
-	node->cur_pos = ctrl->bytes_per_cluster * udiv32(node->cur_pos, ctrl->bytes_per_cluster);
+	if(node->runs_count > 0)
+	{
+		run = &node->runs[node->runs_count - 1];
+		if(run->clust + run->count == clust)
+		{
+			run->count++;
+			return 0;
+		}
+	}
 
-	/* Jump to current pos if pos >= cur_cluster*/
-	if(pos >= node->cur_pos)
+	if(node->runs_count >= node->runs_size)
 	{
-		*cl_pos = udiv32(pos - node->cur_pos, ctrl->bytes_per_cluster);
-		*cl_num = node->cur_cluster;
+		size = node->runs_size ? node->runs_size << 1 : 4;
+		run = realloc(node->runs, size * sizeof(struct fatfs_run_t));
+		if(!run)
+			return -1;
+		node->runs = run;
+		node->runs_size = size;
 	}
+
+	run = &node->runs[node->runs_count];
+	if(node->runs_count > 0)
+		run->index = run[-1].index + run[-1].count;
 	else
+		run->index = 0;
+	run->clust = clust;
+	run->count = 1;
+	node->runs_count++;
+	return 0;
+}
+
+/*
+ * Map file cluster index to disk cluster, extending the runs along the
+ * chain only as far as needed. The count returns how many clusters follow
+ * contiguously on disk, including the mapped one.
+ */
+static int fatfs_node_map_cluster(struct fatfs_node_t * node, u32_t index, u32_t * clust, u32_t * count)
+{
+	struct fatfs_control_t * ctrl = node->ctrl;
+	struct fatfs_run_t * run;
+	u32_t l, r, m, cl;
+
+	if(node->runs_first != node->first_cluster)
+		fatfs_node_runs_invalidate(node);
+
+	if(node->runs_count == 0)
 	{
-		*cl_pos = udiv32(pos, ctrl->bytes_per_cluster);
-		*cl_num = node->first_cluster;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
+		if(!fatfs_control_valid_cluster(ctrl, node->first_cluster))
+			return -1;
+		if(fatfs_node_runs_append(node, node->first_cluster))
+			return -1;
 	}
+
+	run = &node->runs[node->runs_count - 1];
+	while(index >= run->index + run->count)
+	{
+		if(node->runs_end)
+			return -1;
+		if(fatfs_node_next_cluster(node, run->clust + run->count - 1, &cl))
+		{
+			node->runs_end = TRUE;
+			return -1;
+		}
+		if(fatfs_node_runs_append(node, cl))
+			return -1;
+		run = &node->runs[node->runs_count - 1];
+	}
+
+	l = 0;
+	r = node->runs_count - 1;
+	while(l < r)
+	{
+		m = (l + r + 1) >> 1;
+		if(node->runs[m].index <= index)
+			l = m;
+		else
+			r = m - 1;
+	}
+	run = &node->runs[l];
+	*clust = run->clust + (index - run->index);
+	if(count)
+		*count = run->count - (index - run->index);
+	return 0;
+}
+
+/*
+ * Like map, but append free clusters when the index is past the end of chain
+ */
+static int fatfs_node_grow_cluster(struct fatfs_node_t * node, u32_t index, u32_t * clust)
+{
+	struct fatfs_run_t * run;
+	u32_t i, cl;
+
+	if(!fatfs_node_map_cluster(node, index, clust, NULL))
+		return 0;
+	if(!node->runs_end || (node->runs_count == 0))
+		return -1;
+
+	run = &node->runs[node->runs_count - 1];
+	i = run->index + run->count - 1;
+	cl = run->clust + run->count - 1;
+	while(i < index)
+	{
+		if(fatfs_node_auto_alloc_next_cluster(node, cl, &cl))
+			return -1;
+		if(fatfs_node_runs_append(node, cl))
+		{
+			node->runs_end = FALSE;
+			return -1;
+		}
+		i++;
+	}
+	*clust = cl;
+	return 0;
 }
 
 u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	u64_t roff, rlen;
-	u32_t r, rstartcl;
-	u32_t cl_off, cl_num, cl_len;
+	u32_t r, n;
+	u32_t cl_off, cl_num, cl_cnt, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -254,25 +361,37 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		return block_read(ctrl->bdev, (u8_t *) buf, roff, rlen);
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &rstartcl, &cl_num);
-
-	if(fatfs_node_nth_cluster(node, cl_num, rstartcl, &cl_num))
-		return 0;
-
 	r = 0;
-	cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
-	do
+	while(r < len)
 	{
 		/* Current cluster info */
-		cl_len = ctrl->bytes_per_cluster - cl_off;
-		cl_len = (len - r < cl_len) ? len - r : cl_len;
-
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + r;
+		cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
+		if(fatfs_node_map_cluster(node, udiv32(pos + r, ctrl->bytes_per_cluster), &cl_num, &cl_cnt))
+			break;
 
-		/* Read from cached cluster */
-		rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+		if((cl_off == 0) && (len - r >= ctrl->bytes_per_cluster))
+		{
+			/* Read whole clusters contiguous on disk directly */
+			n = udiv32(len - r, ctrl->bytes_per_cluster);
+			if(n > cl_cnt)
+				n = cl_cnt;
+			if(node->cached_dirty && (node->cached_clust >= cl_num) && (node->cached_clust < cl_num + n))
+			{
+				if(fatfs_node_sync_cached_cluster(node))
+					break;
+			}
+			cl_len = n * ctrl->bytes_per_cluster;
+			roff = (u64_t) ctrl->first_data_sector * ctrl->bytes_per_sector;
+			roff += (u64_t) (cl_num - 2) * ctrl->bytes_per_cluster;
+			rlen = block_read(ctrl->bdev, buf, roff, cl_len);
+		}
+		else
+		{
+			/* Read from cached cluster */
+			cl_len = ctrl->bytes_per_cluster - cl_off;
+			cl_len = (len - r < cl_len) ? len - r : cl_len;
+			rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+		}
 
 		if(rlen != cl_len)
 		{
@@ -282,8 +401,7 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		/* Update iteration */
 		r += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(r < len && !fatfs_node_next_cluster(node, cl_num, &cl_num));
+	}
 
 	return r;
 }
@@ -292,7 +410,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 {
 	int rc;
 	u64_t woff, wlen;
-	u32_t w = 0, wstartcl;
+	u32_t w = 0;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -316,35 +434,21 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 			return 0;
 
 		node->first_cluster = cl_num;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
 
 		/* Mark node directory entry as dirty */
 		node->parent_dent_dirty = TRUE;
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &wstartcl, &cl_num);
-
-	/* Make room for new data by appending free clusters */
-	for(int i = 0; i < wstartcl; i++)
-	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
-		if(rc)
-			return 0;
-	}
-
 	w = 0;
-	cl_off = umod32(pos + w, ctrl->bytes_per_cluster);
-	do
+	while(w < len)
 	{
-		/* Current cluster info */
+		/* Current cluster info, appending free clusters to make room */
+		cl_off = umod32(pos + w, ctrl->bytes_per_cluster);
+		if(fatfs_node_grow_cluster(node, udiv32(pos + w, ctrl->bytes_per_cluster), &cl_num))
+			break;
 		cl_len = ctrl->bytes_per_cluster - cl_off;
 		cl_len = (len - w < cl_len) ? len - w : cl_len;
 
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + w;
-
 		/* Write next cluster */
 		wlen = fatfs_node_write_cluster(node, cl_num, buf, cl_off, cl_len);
 
@@ -356,8 +460,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 		/* Update iteration */
 		w += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(w < len && !fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num));
+	}
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
@@ -368,7 +471,7 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
-	u32_t cl_pos, cl_num, t_pos;
+	u32_t cl_pos, cl_num, cl_last;
 	struct fatfs_control_t * ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -377,15 +480,26 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 		return 0;
 	}
 
-	/* Determine last cluster after truncation */
-	t_pos = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
-	fatfs_node_fast_jump_cluster(node, t_pos + ctrl->bytes_per_cluster - 1, &cl_pos, &cl_num);
-
-	rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
+	/* Determine first cluster to remove and the new last cluster */
+	cl_pos = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
+	rc = fatfs_node_map_cluster(node, cl_pos, &cl_num, NULL);
 	if(rc)
-		return rc;
+	{
+		/* Nothing to remove if chain ends before that cluster */
+		if(!node->runs_end)
+			return rc;
+		node->parent_dent_dirty = TRUE;
+		return 0;
+	}
+	if(cl_pos > 0)
+	{
+		rc = fatfs_node_map_cluster(node, cl_pos - 1, &cl_last, NULL);
+		if(rc)
+			return rc;
+	}
 
 	/* Remove all clusters after last cluster */
+	fatfs_node_runs_invalidate(node);
 	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
 	if(rc)
 		return rc;
@@ -399,21 +513,13 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 	}
 	else
 	{
-		/* if go here, t_pos >= node->first_cluster */
-		t_pos -= ctrl->bytes_per_cluster;
-		fatfs_node_fast_jump_cluster(node, t_pos, &cl_pos, &cl_num);
-		rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
-		if(rc)
-			return rc;
-		rc = fatfs_control_set_last_cluster(ctrl, cl_num);
+		rc = fatfs_control_set_last_cluster(ctrl, cl_last);
 		if(rc)
 			return rc;
 	}
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
-	node->cur_cluster = node->first_cluster;
-	node->cur_pos = 0;
 	return 0;
 }
 
@@ -441,8 +547,12 @@ int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 	memset(&node->parent_dent, 0, sizeof(struct fat_dirent_t));
 	node->parent_dent_dirty = FALSE;
 	node->first_cluster = 0;
-	node->cur_cluster = 0;
-	node->cur_pos = 0;
+
+	node->runs = NULL;
+	node->runs_first = 0;
+	node->runs_count = 0;
+	node->runs_size = 0;
+	node->runs_end = FALSE;
 
 	node->cached_clust = 0;
 	node->cached_data = NULL;
@@ -462,6 +572,14 @@ int fatfs_node_exit(struct fatfs_node_t * node)
 		node->cached_dirty = FALSE;
 	}
 
+	if(node->runs)
+	{
+		free(node->runs);
+		node->runs = NULL;
+		node->runs_count = 0;
+		node->runs_size = 0;
+	}
+
 	return 0;
 }
 
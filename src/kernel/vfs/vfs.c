@@ -105,6 +105,7 @@ static struct vfs_file_t fd_file[VFS_MAX_FD];
 static struct mutex_t fd_file_lock;
 struct list_head node_list[VFS_NODE_HASH_SIZE];
 static struct mutex_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct kmem_cache_t * node_cache;
 
 static int count_match(const char * path, char * mount_root)
 {
@@ -222,7 +223,7 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	u32_t hash = vfs_node_hash(m, path);
 	int err;
 
-	if(!(n = calloc(1, sizeof(struct vfs_node_t))))
+	if(!(n = kmem_cache_zalloc(node_cache)))
 		return NULL;
 
 	init_list_head(&n->v_link);
@@ -231,7 +232,7 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	atomic_set(&n->v_refcnt, 1);
 	if(strlcpy(n->v_path, path, sizeof(n->v_path)) >= sizeof(n->v_path))
 	{
-		free(n);
+		kmem_cache_free(node_cache, n);
 		return NULL;
 	}
 
@@ -240,7 +241,7 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	mutex_unlock(&m->m_lock);
 	if(err)
 	{
-		free(n);
+		kmem_cache_free(node_cache, n);
 		return NULL;
 	}
 
@@ -298,7 +299,7 @@ static void vfs_node_put(struct vfs_node_t * n)
 	mutex_unlock(&n->v_mount->m_lock);
 
 	atomic_sub(&n->v_mount->m_refcnt, 1);
-	free(n);
+	kmem_cache_free(node_cache, n);
 }
 
 static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
@@ -544,7 +545,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 			mutex_lock(&n->v_mount->m_lock);
 			n->v_mount->m_fs->vput(n->v_mount, n);
 			mutex_unlock(&n->v_mount->m_lock);
-			free(n);
+			kmem_cache_free(node_cache, n);
 		}
 		mutex_unlock(&node_list_lock[i]);
 	}
@@ -703,8 +704,8 @@ int vfs_unmount(const char * path)
 	vfs_node_release(m->m_root);
 	if(m->m_covered)
 		vfs_node_release(m->m_covered);
-	if(m->m_dev)
-		block_sync(m->m_dev);
+	if(m->m_dev && (block_sync(m->m_dev) < 0))
+		err = -1;
 	free(m);
 
 	return err;
@@ -713,17 +714,20 @@ int vfs_unmount(const char * path)
 int vfs_sync(void)
 {
 	struct vfs_mount_t * m;
+	int err = 0;
 
 	mutex_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		mutex_lock(&m->m_lock);
 		m->m_fs->msync(m);
+		if(m->m_dev && (block_sync(m->m_dev) < 0))
+			err = -1;
 		mutex_unlock(&m->m_lock);
 	}
 	mutex_unlock(&mnt_list_lock);
 
-	return 0;
+	return err;
 }
 
 struct vfs_mount_t * vfs_mount_get(int index)
@@ -1624,6 +1628,7 @@ void do_init_vfs(void)
 
 	init_list_head(&mnt_list);
 	mutex_init(&mnt_list_lock);
+	node_cache = kmem_cache_create("vfs_node", sizeof(struct vfs_node_t), 0);
 
 	for(i = 0; i < VFS_MAX_FD; i++)
 	{
@@ -531,3 +531,27 @@ void surface_apply_vision(struct surface_t * s, struct vision_t * v)
 		}
 	}
 }
+
+void vision_apply_video_frame(struct vision_t * v, struct video_frame_t * frame)
+{
+	struct surface_t * s;
+
+	if(v && frame)
+	{
+		switch(v->type)
+		{
+		case VISION_TYPE_GRAY:
+			video_frame_to_gray(frame, v->datas, v->width, v->height);
+			break;
+		default:
+			s = surface_alloc(v->width, v->height, NULL);
+			if(s)
+			{
+				video_frame_to_argb_scaled(frame, surface_get_pixels(s), v->width, v->height);
+				vision_apply_surface(v, s);
+				surface_free(s);
+			}
+			break;
+		}
+	}
+}
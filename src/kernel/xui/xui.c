@@ -267,12 +267,97 @@ static int xui_cmd_next(struct xui_context_t * ctx, union xui_cmd_t ** cmd)
 	return 0;
 }
 
+/*
+ * Every drawing command is binned once per frame, with the clip it is
+ * replayed under, into the tiles it touches. The per-tile lists are
+ * stored back to back in tlist, indexed by tstart.
+ */
+static void xui_bin_add(struct xui_context_t * ctx, union xui_cmd_t * cmd, struct region_t * clip, struct region_t * r)
+{
+	struct xui_bin_t * bins;
+	unsigned int * tmask;
+	int x1, y1, x2, y2;
+	int x, y, m;
+
+	if(ctx->nbin >= ctx->mbin)
+	{
+		m = ctx->mbin ? ctx->mbin << 1 : 256;
+		bins = realloc(ctx->bins, m * sizeof(struct xui_bin_t));
+		tmask = realloc(ctx->tmask, ((m + 31) >> 5) * sizeof(unsigned int));
+		if(bins)
+			ctx->bins = bins;
+		if(tmask)
+			ctx->tmask = tmask;
+		if(!bins || !tmask)
+			return;
+		ctx->mbin = m;
+	}
+	ctx->bins[ctx->nbin].cmd = cmd;
+	region_clone(&ctx->bins[ctx->nbin].clip, clip);
+	ctx->nbin++;
+
+	x1 = r->x >> ctx->cpshift;
+	y1 = r->y >> ctx->cpshift;
+	x2 = (r->x + r->w - 1) >> ctx->cpshift;
+	y2 = (r->y + r->h - 1) >> ctx->cpshift;
+	for(y = y1; y <= y2; y++)
+	{
+		for(x = x1; x <= x2; x++)
+			ctx->tstart[x + y * ctx->cwidth + 1]++;
+	}
+	ctx->ntlist += (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+static void xui_bin_build(struct xui_context_t * ctx)
+{
+	struct xui_bin_t * bin;
+	struct region_t r;
+	unsigned int * tlist;
+	int x1, y1, x2, y2;
+	int x, y, i, n;
+
+	n = ctx->cwidth * ctx->cheight;
+	if(ctx->ntlist > ctx->mtlist)
+	{
+		tlist = realloc(ctx->tlist, ctx->ntlist * sizeof(unsigned int));
+		if(!tlist)
+		{
+			ctx->nbin = 0;
+			memset(ctx->tstart, 0, (n + 1) * sizeof(unsigned int));
+			return;
+		}
+		ctx->tlist = tlist;
+		ctx->mtlist = ctx->ntlist;
+	}
+	for(i = 0; i < n; i++)
+		ctx->tstart[i + 1] += ctx->tstart[i];
+	for(i = 0; i < ctx->nbin; i++)
+	{
+		bin = &ctx->bins[i];
+		if(!region_intersect(&r, &ctx->screen, &bin->cmd->base.r) || !region_intersect(&r, &r, &bin->clip))
+			continue;
+		x1 = r.x >> ctx->cpshift;
+		y1 = r.y >> ctx->cpshift;
+		x2 = (r.x + r.w - 1) >> ctx->cpshift;
+		y2 = (r.y + r.h - 1) >> ctx->cpshift;
+		for(y = y1; y <= y2; y++)
+		{
+			for(x = x1; x <= x2; x++)
+				ctx->tlist[ctx->tstart[x + y * ctx->cwidth]++] = i;
+		}
+	}
+	for(i = n; i > 0; i--)
+		ctx->tstart[i] = ctx->tstart[i - 1];
+	ctx->tstart[0] = 0;
+}
+
 void xui_end(struct xui_context_t * ctx)
 {
 	union xui_cmd_t * cmd = NULL;
 	struct region_t r;
 	unsigned int * ncell = ctx->cells[ctx->cindex];
 	unsigned int * ocell = ctx->cells[(ctx->cindex = (ctx->cindex + 1) & 0x1)];
+	struct region_t cr;
 	unsigned int h;
 	int x1, y1, x2, y2;
 	int x, y;
@@ -346,8 +431,16 @@ void xui_end(struct xui_context_t * ctx)
 		if(i == n - 1)
 			c->tail->jump.addr = ctx->cmd_list.items + ctx->cmd_list.idx;
 	}
+	region_clone(&cr, &ctx->screen);
+	ctx->nbin = 0;
+	ctx->ntlist = 0;
+	memset(ctx->tstart, 0, (ctx->cwidth * ctx->cheight + 1) * sizeof(unsigned int));
 	while(xui_cmd_next(ctx, &cmd))
 	{
+		if(cmd->base.type == XUI_CMD_TYPE_CLIP)
+			region_clone(&cr, &cmd->clip.r);
+		else if(region_intersect(&r, &ctx->screen, &cmd->base.r) && region_intersect(&r, &r, &cr))
+			xui_bin_add(ctx, cmd, &cr, &r);
 		if(region_intersect(&r, &ctx->screen, &cmd->base.r))
 		{
 			h = 5381;
@@ -365,19 +458,26 @@ void xui_end(struct xui_context_t * ctx)
 			}
 		}
 	}
+	xui_bin_build(ctx);
 	region_list_clear(ctx->w->rl);
 	for(y = 0; y < ctx->cheight; y++)
 	{
-		for(x = 0; x < ctx->cwidth; x++)
+		for(x = 0; x < ctx->cwidth; x = x2)
 		{
 			i = x + y * ctx->cwidth;
-			if(ncell[i] != ocell[i])
+			for(x2 = x; (x2 < ctx->cwidth) && (ncell[i] != ocell[i]); x2++, i++)
+				ocell[i] = 5381;
+			if(x2 > x)
 			{
-				region_init(&r, x << ctx->cpshift, y << ctx->cpshift, 1 << ctx->cpshift, 1 << ctx->cpshift);
+				region_init(&r, x << ctx->cpshift, y << ctx->cpshift, (x2 - x) << ctx->cpshift, 1 << ctx->cpshift);
 				if(region_intersect(&r, &r, &ctx->screen))
 					region_list_add(ctx->w->rl, &r);
 			}
-			ocell[i] = 5381;
+			else
+			{
+				ocell[i] = 5381;
+				x2++;
+			}
 		}
 	}
 }
@@ -1077,7 +1177,7 @@ void xui_control_update(struct xui_context_t * ctx, unsigned int id, struct regi
 		}
 	}
 }
-
+
 void xui_layout_width(struct xui_context_t * ctx, int width)
 {
 	xui_get_layout(ctx)->size_width = width;
@@ -1195,16 +1295,23 @@ struct xui_context_t * xui_context_alloc(const char * fb, const char * input, vo
 	len = ctx->cwidth * ctx->cheight * sizeof(unsigned int);
 	ctx->cells[0] = malloc(len);
 	ctx->cells[1] = malloc(len);
-	if(!ctx->cells[0] || !ctx->cells[1])
+	ctx->tstart = malloc(len + sizeof(unsigned int));
+	if(!ctx->cells[0] || !ctx->cells[1] || !ctx->tstart)
 	{
 		if(ctx->cells[0])
 			free(ctx->cells[0]);
 		if(ctx->cells[1])
 			free(ctx->cells[1]);
+		if(ctx->tstart)
+			free(ctx->tstart);
+		window_free(ctx->w);
+		font_context_free(ctx->f);
 		free(ctx);
+		return NULL;
 	}
 	memset(ctx->cells[0], 0xff, len);
 	memset(ctx->cells[1], 0xff, len);
+	memset(ctx->tstart, 0, len + sizeof(unsigned int));
 	ctx->cindex = 0;
 	ctx->running = 1;
 	region_clone(&ctx->clip, &ctx->screen);
@@ -1233,6 +1340,14 @@ void xui_context_free(struct xui_context_t * ctx)
 			free(ctx->cells[0]);
 		if(ctx->cells[1])
 			free(ctx->cells[1]);
+		if(ctx->tstart)
+			free(ctx->tstart);
+		if(ctx->tlist)
+			free(ctx->tlist);
+		if(ctx->tmask)
+			free(ctx->tmask);
+		if(ctx->bins)
+			free(ctx->bins);
 		free(ctx);
 	}
 }
@@ -1646,89 +1761,140 @@ void xui_add_font(struct xui_context_t * ctx,  const char * family, const char *
 		font_add(ctx->f, NULL, family, path);
 }
 
+static void xui_draw_cmd(struct xui_context_t * ctx, struct surface_t * s, struct region_t * clip, union xui_cmd_t * cmd)
+{
+	struct matrix_t m;
+	struct icon_t ico;
+	int size;
+
+	switch(cmd->base.type)
+	{
+	case XUI_CMD_TYPE_LINE:
+		surface_shape_line(s, clip, &cmd->line.p0, &cmd->line.p1, cmd->line.thickness, &cmd->line.c);
+		break;
+	case XUI_CMD_TYPE_POLYLINE:
+		surface_shape_polyline(s, clip, cmd->polyline.p, cmd->polyline.n, cmd->polyline.thickness, &cmd->polyline.c);
+		break;
+	case XUI_CMD_TYPE_CURVE:
+		surface_shape_curve(s, clip, cmd->curve.p, cmd->curve.n, cmd->curve.thickness, &cmd->curve.c);
+		break;
+	case XUI_CMD_TYPE_TRIANGLE:
+		surface_shape_triangle(s, clip, &cmd->triangle.p0, &cmd->triangle.p1, &cmd->triangle.p2, cmd->triangle.thickness, &cmd->triangle.c);
+		break;
+	case XUI_CMD_TYPE_RECTANGLE:
+		surface_shape_rectangle(s, clip, cmd->rectangle.x, cmd->rectangle.y, cmd->rectangle.w, cmd->rectangle.h, cmd->rectangle.radius, cmd->rectangle.thickness, &cmd->rectangle.c);
+		break;
+	case XUI_CMD_TYPE_POLYGON:
+		surface_shape_polygon(s, clip, cmd->polygon.p, cmd->polygon.n, cmd->polygon.thickness, &cmd->polygon.c);
+		break;
+	case XUI_CMD_TYPE_CIRCLE:
+		surface_shape_circle(s, clip, cmd->circle.x, cmd->circle.y, cmd->circle.radius, cmd->circle.thickness, &cmd->circle.c);
+		break;
+	case XUI_CMD_TYPE_ELLIPSE:
+		surface_shape_ellipse(s, clip, cmd->ellipse.x, cmd->ellipse.y, cmd->ellipse.w, cmd->ellipse.h, cmd->ellipse.thickness, &cmd->ellipse.c);
+		break;
+	case XUI_CMD_TYPE_ARC:
+		surface_shape_arc(s, clip, cmd->arc.x, cmd->arc.y, cmd->arc.radius, cmd->arc.a1, cmd->arc.a2, cmd->arc.thickness, &cmd->arc.c);
+		break;
+	case XUI_CMD_TYPE_SURFACE:
+		surface_blit(s, clip, &cmd->surface.m, cmd->surface.s, RENDER_TYPE_GOOD);
+		break;
+	case XUI_CMD_TYPE_ICON:
+		size = min(cmd->icon.w, cmd->icon.h);
+		icon_init(&ico, cmd->icon.code, &cmd->icon.c, ctx->f, cmd->icon.family, size);
+		matrix_init_translate(&m, cmd->icon.x + (cmd->icon.w - size) / 2, cmd->icon.y + (cmd->icon.h - size) / 2);
+		surface_icon(s, clip, &m, &ico);
+		break;
+	case XUI_CMD_TYPE_TEXT:
+		matrix_init_translate(&m, cmd->text.x, cmd->text.y);
+		surface_text(s, clip, &m, &cmd->text.txt);
+		break;
+	case XUI_CMD_TYPE_GLASS:
+		surface_effect_glass(s, clip, cmd->glass.x, cmd->glass.y, cmd->glass.w, cmd->glass.h, cmd->glass.radius);
+		break;
+	case XUI_CMD_TYPE_GRADIENT:
+		surface_effect_gradient(s, clip, cmd->gradient.x, cmd->gradient.y, cmd->gradient.w, cmd->gradient.h, &cmd->gradient.lt, &cmd->gradient.rt, &cmd->gradient.rb, &cmd->gradient.lb);
+		break;
+	case XUI_CMD_TYPE_CHECKERBOARD:
+		surface_effect_checkerboard(s, clip, cmd->checkerboard.x, cmd->checkerboard.y, cmd->checkerboard.w, cmd->checkerboard.h);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Replay, in list order, only the commands binned into the tiles that a
+ * damage rectangle covers, each one clipped against that rectangle.
+ */
 static void xui_draw(struct window_t * w, void * o)
 {
 	struct xui_context_t * ctx = (struct xui_context_t *)o;
 	struct surface_t * s = ctx->w->s;
 	struct region_t * r, * clip = &ctx->clip;
-	union xui_cmd_t * cmd;
-	struct matrix_t m;
-	struct icon_t ico;
-	int count, size;
-	int i;
+	struct xui_bin_t * bin;
+	unsigned int * tmask = ctx->tmask;
+	unsigned int bits;
+	int x1, y1, x2, y2;
+	int x, y, t, k;
+	int count, words;
+	int i, j;
 
-	if((count = w->rl->count) > 0)
+	if(((count = w->rl->count) > 0) && (ctx->nbin > 0))
 	{
+		words = (ctx->nbin + 31) >> 5;
 		for(i = 0; i < count; i++)
 		{
 			r = &w->rl->region[i];
-			region_clone(clip, r);
-			cmd = NULL;
-			while(xui_cmd_next(ctx, &cmd))
+			if(!region_intersect(clip, r, &ctx->screen))
+				continue;
+			x1 = clip->x >> ctx->cpshift;
+			y1 = clip->y >> ctx->cpshift;
+			x2 = (clip->x + clip->w - 1) >> ctx->cpshift;
+			y2 = (clip->y + clip->h - 1) >> ctx->cpshift;
+			memset(tmask, 0, words * sizeof(unsigned int));
+			for(y = y1; y <= y2; y++)
 			{
-				switch(cmd->base.type)
+				for(x = x1; x <= x2; x++)
 				{
-				case XUI_CMD_TYPE_CLIP:
-					if(!region_intersect(clip, r, &cmd->clip.r))
-						region_init(clip, 0, 0, 0, 0);
-					break;
-				case XUI_CMD_TYPE_LINE:
-					surface_shape_line(s, clip, &cmd->line.p0, &cmd->line.p1, cmd->line.thickness, &cmd->line.c);
-					break;
-				case XUI_CMD_TYPE_POLYLINE:
-					surface_shape_polyline(s, clip, cmd->polyline.p, cmd->polyline.n, cmd->polyline.thickness, &cmd->polyline.c);
-					break;
-				case XUI_CMD_TYPE_CURVE:
-					surface_shape_curve(s, clip, cmd->curve.p, cmd->curve.n, cmd->curve.thickness, &cmd->curve.c);
-					break;
-				case XUI_CMD_TYPE_TRIANGLE:
-					surface_shape_triangle(s, clip, &cmd->triangle.p0, &cmd->triangle.p1, &cmd->triangle.p2, cmd->triangle.thickness, &cmd->triangle.c);
-					break;
-				case XUI_CMD_TYPE_RECTANGLE:
-					surface_shape_rectangle(s, clip, cmd->rectangle.x, cmd->rectangle.y, cmd->rectangle.w, cmd->rectangle.h, cmd->rectangle.radius, cmd->rectangle.thickness, &cmd->rectangle.c);
-					break;
-				case XUI_CMD_TYPE_POLYGON:
-					surface_shape_polygon(s, clip, cmd->polygon.p, cmd->polygon.n, cmd->polygon.thickness, &cmd->polygon.c);
-					break;
-				case XUI_CMD_TYPE_CIRCLE:
-					surface_shape_circle(s, clip, cmd->circle.x, cmd->circle.y, cmd->circle.radius, cmd->circle.thickness, &cmd->circle.c);
-					break;
-				case XUI_CMD_TYPE_ELLIPSE:
-					surface_shape_ellipse(s, clip, cmd->ellipse.x, cmd->ellipse.y, cmd->ellipse.w, cmd->ellipse.h, cmd->ellipse.thickness, &cmd->ellipse.c);
-					break;
-				case XUI_CMD_TYPE_ARC:
-					surface_shape_arc(s, clip, cmd->arc.x, cmd->arc.y, cmd->arc.radius, cmd->arc.a1, cmd->arc.a2, cmd->arc.thickness, &cmd->arc.c);
-					break;
-				case XUI_CMD_TYPE_SURFACE:
-					surface_blit(s, clip, &cmd->surface.m, cmd->surface.s, RENDER_TYPE_GOOD);
-					break;
-				case XUI_CMD_TYPE_ICON:
-					size = min(cmd->icon.w, cmd->icon.h);
-					icon_init(&ico, cmd->icon.code, &cmd->icon.c, ctx->f, cmd->icon.family, size);
-					matrix_init_translate(&m, cmd->icon.x + (cmd->icon.w - size) / 2, cmd->icon.y + (cmd->icon.h - size) / 2);
-					surface_icon(s, clip, &m, &ico);
-					break;
-				case XUI_CMD_TYPE_TEXT:
-					matrix_init_translate(&m, cmd->text.x, cmd->text.y);
-					surface_text(s, clip, &m, &cmd->text.txt);
-					break;
-				case XUI_CMD_TYPE_GLASS:
-					surface_effect_glass(s, clip, cmd->glass.x, cmd->glass.y, cmd->glass.w, cmd->glass.h, cmd->glass.radius);
-					break;
-				case XUI_CMD_TYPE_GRADIENT:
-					surface_effect_gradient(s, clip, cmd->gradient.x, cmd->gradient.y, cmd->gradient.w, cmd->gradient.h, &cmd->gradient.lt, &cmd->gradient.rt, &cmd->gradient.rb, &cmd->gradient.lb);
-					break;
-				case XUI_CMD_TYPE_CHECKERBOARD:
-					surface_effect_checkerboard(s, clip, cmd->checkerboard.x, cmd->checkerboard.y, cmd->checkerboard.w, cmd->checkerboard.h);
-					break;
-				default:
-					break;
+					t = x + y * ctx->cwidth;
+					for(k = ctx->tstart[t]; k < ctx->tstart[t + 1]; k++)
+						tmask[ctx->tlist[k] >> 5] |= 1U << (ctx->tlist[k] & 0x1f);
+				}
+			}
+			for(j = 0; j < words; j++)
+			{
+				for(bits = tmask[j]; bits; bits &= bits - 1)
+				{
+					bin = &ctx->bins[(j << 5) + ffs(bits) - 1];
+					if(region_intersect(clip, r, &bin->clip))
+						xui_draw_cmd(ctx, s, clip, bin->cmd);
 				}
 			}
 		}
 	}
 }
 
+/*
+ * Hold the task until the next frame slot, input arriving meanwhile is
+ * picked up by the next frame. An idle ui never gets here, it parks in
+ * window_wait instead.
+ */
+static void xui_pace(struct xui_context_t * ctx)
+{
+	ktime_t deadline = ktime_add_ns(ctx->stamp, 1000000000LL / XUI_FRAME_RATE);
+	ktime_t now = ktime_get();
+
+	if(!ktime_before(now, deadline))
+	{
+		task_yield();
+		return;
+	}
+	do {
+		task_sleep(ktime_to_ns(ktime_sub(deadline, now)));
+	} while(ktime_before(now = ktime_get(), deadline));
+}
+
 void xui_loop(struct xui_context_t * ctx, void (*func)(struct xui_context_t *))
 {
 	struct event_t e;
@@ -1962,8 +2128,14 @@ void xui_loop(struct xui_context_t * ctx, void (*func)(struct xui_context_t *))
 		}
 		if(func)
 			func(ctx);
-		if(window_is_active(ctx->w))
+		if(window_is_active(ctx->w) && window_is_dirty(ctx->w))
+		{
 			window_present(ctx->w, ctx, xui_draw);
-		task_yield();
+			xui_pace(ctx);
+		}
+		else
+		{
+			window_wait(ctx->w, XUI_IDLE_TIMEOUT * 1000000ULL);
+		}
 	}
 }
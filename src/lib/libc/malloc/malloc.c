@@ -5,6 +5,7 @@
 #include <xconfigs.h>
 #include <assert.h>
 #include <spinlock.h>
+#include <smp.h>
 #include <string.h>
 #include <stdio.h>
 #include <malloc.h>
@@ -820,12 +821,100 @@ void mm_info(void * mm, size_t * mused, size_t * mfree)
 static void * __heap_pool = NULL;
 static spinlock_t __heap_lock = SPIN_LOCK_INIT();
 
+#if (CONFIG_MALLOC_MAGAZINE_SIZE > 0)
+/*
+ * Per cpu magazines in front of the heap. Small blocks of exactly one size
+ * class are kept on the cpu that freed them and handed out again without
+ * taking the heap lock, the heap is only touched in batches of half a
+ * magazine. Tasks never preempt each other on a cpu, so no lock is needed.
+ */
+#define MAGAZINE_CLASS_MAX		(256)
+#define MAGAZINE_CLASS_COUNT	(MAGAZINE_CLASS_MAX >> ALIGN_SIZE_LOG2)
+#define MAGAZINE_BATCH			(CONFIG_MALLOC_MAGAZINE_SIZE / 2)
+
+struct magazine_t {
+	int count;
+	void * objs[CONFIG_MALLOC_MAGAZINE_SIZE];
+};
+
+struct magazine_cpu_t {
+	struct magazine_t mag[MAGAZINE_CLASS_COUNT];
+	size_t cached;
+	u64_t hit;
+	u64_t miss;
+	u64_t flush;
+};
+
+static struct magazine_cpu_t __heap_magazine[CONFIG_MAX_SMP_CPUS];
+
+static inline int magazine_class(size_t size)
+{
+	if((size >= block_size_min) && (size <= MAGAZINE_CLASS_MAX) && !(size & (ALIGN_SIZE - 1)))
+		return (size >> ALIGN_SIZE_LOG2) - 1;
+	return -1;
+}
+
+static void * magazine_alloc(struct magazine_cpu_t * mc, int idx, size_t size)
+{
+	struct magazine_t * m = &mc->mag[idx];
+	void * p;
+
+	if(m->count > 0)
+	{
+		mc->hit++;
+	}
+	else
+	{
+		spin_lock(&__heap_lock);
+		while(m->count < MAGAZINE_BATCH)
+		{
+			if(!(p = tlsf_malloc(__heap_pool, size)))
+				break;
+			m->objs[m->count++] = p;
+		}
+		spin_unlock(&__heap_lock);
+		mc->miss++;
+		if(m->count <= 0)
+			return NULL;
+		mc->cached += m->count * size;
+	}
+	mc->cached -= size;
+	return m->objs[--m->count];
+}
+
+static void magazine_free(struct magazine_cpu_t * mc, int idx, size_t size, void * ptr)
+{
+	struct magazine_t * m = &mc->mag[idx];
+	int i;
+
+	if(m->count >= CONFIG_MALLOC_MAGAZINE_SIZE)
+	{
+		spin_lock(&__heap_lock);
+		for(i = 0; i < MAGAZINE_BATCH; i++)
+			tlsf_free(__heap_pool, m->objs[i]);
+		spin_unlock(&__heap_lock);
+		m->count -= MAGAZINE_BATCH;
+		memmove(&m->objs[0], &m->objs[MAGAZINE_BATCH], m->count * sizeof(void *));
+		mc->cached -= MAGAZINE_BATCH * size;
+		mc->flush++;
+	}
+	m->objs[m->count++] = ptr;
+	mc->cached += size;
+}
+#endif
+
 static void * __malloc(size_t size)
 {
 	void * m;
 
 	if(__heap_pool)
 	{
+#if (CONFIG_MALLOC_MAGAZINE_SIZE > 0)
+		size_t adjust = adjust_request_size(size, ALIGN_SIZE);
+		int idx = magazine_class(adjust);
+		if(idx >= 0)
+			return magazine_alloc(&__heap_magazine[smp_processor_id()], idx, adjust);
+#endif
 		spin_lock(&__heap_lock);
 		m = tlsf_malloc(__heap_pool, size);
 		spin_unlock(&__heap_lock);
@@ -879,6 +968,18 @@ static void __free(void * ptr)
 {
 	if(__heap_pool)
 	{
+#if (CONFIG_MALLOC_MAGAZINE_SIZE > 0)
+		if(ptr)
+		{
+			size_t bsize = block_get_size(block_from_ptr(ptr));
+			int idx = magazine_class(bsize);
+			if(idx >= 0)
+			{
+				magazine_free(&__heap_magazine[smp_processor_id()], idx, bsize, ptr);
+				return;
+			}
+		}
+#endif
 		spin_lock(&__heap_lock);
 		tlsf_free(__heap_pool, ptr);
 		spin_unlock(&__heap_lock);
@@ -891,7 +992,17 @@ static void __meminfo(size_t * mused, size_t * mfree)
 	if(__heap_pool)
 	{
 		if(mused && mfree)
+		{
 			tlsf_info(mm_get(__heap_pool), mused, mfree);
+#if (CONFIG_MALLOC_MAGAZINE_SIZE > 0)
+			int i;
+			for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+			{
+				*mused -= __heap_magazine[i].cached;
+				*mfree += __heap_magazine[i].cached;
+			}
+#endif
+		}
 	}
 }
 extern __typeof(__meminfo) meminfo __attribute__((weak, alias("__meminfo")));
@@ -912,6 +1023,14 @@ static ssize_t memory_read_meminfo(struct kobj_t * kobj, void * buf, size_t size
 	meminfo(&mused, &mfree);
 	len += sprintf((char *)(p + len), " memory used: %ld\r\n", mused);
 	len += sprintf((char *)(p + len), " memory free: %ld\r\n", mfree);
+#if (CONFIG_MALLOC_MAGAZINE_SIZE > 0)
+	int i;
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		len += sprintf((char *)(p + len), " cpu%d cached: %ld\r\n", i, __heap_magazine[i].cached);
+		len += sprintf((char *)(p + len), " cpu%d hit: %lld, miss: %lld, flush: %lld\r\n", i, __heap_magazine[i].hit, __heap_magazine[i].miss, __heap_magazine[i].flush);
+	}
+#endif
 	return len;
 }
 
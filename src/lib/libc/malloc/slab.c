@@ -0,0 +1,269 @@
+/*
+ * lib/libc/malloc/slab.c
+ */
+
+#include <xconfigs.h>
+#include <types.h>
+#include <stddef.h>
+#include <sizes.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <log2.h>
+#include <list.h>
+#include <spinlock.h>
+#include <malloc.h>
+#include <slab.h>
+#include <xboot/kobj.h>
+#include <xboot/initcall.h>
+#include <xboot/module.h>
+
+/*
+ * Each slab is one naturally aligned chunk taken from the cache's memory
+ * manager, or the system heap, with a small header at its start, so the
+ * owning slab of an object is found by masking the object address. Free
+ * objects are chained through their first word.
+ */
+struct kmem_slab_t {
+	struct list_head list;
+	struct kmem_cache_t * cache;
+	void * freelist;
+	unsigned int inuse;
+};
+
+static LIST_HEAD(__kmem_cache_list);
+static spinlock_t __kmem_cache_lock = SPIN_LOCK_INIT();
+
+static void kmem_slab_free(struct kmem_cache_t * c, struct kmem_slab_t * s)
+{
+	if(c->mm)
+		mm_free(c->mm, s);
+	else
+		free(s);
+}
+
+static struct kmem_slab_t * kmem_slab_grow(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s;
+	unsigned char * obj;
+	unsigned int i;
+
+	if(c->mm)
+		s = mm_memalign(c->mm, c->pgsize, c->pgsize);
+	else
+		s = memalign(c->pgsize, c->pgsize);
+	if(!s)
+		return NULL;
+	s->cache = c;
+	s->inuse = 0;
+	s->freelist = NULL;
+	obj = (unsigned char *)s + ((sizeof(struct kmem_slab_t) + c->align - 1) & ~(c->align - 1));
+	for(i = 0; i < c->nobjs; i++, obj += c->size)
+	{
+		*((void **)obj) = s->freelist;
+		s->freelist = obj;
+	}
+	init_list_head(&s->list);
+	c->nslabs++;
+	return s;
+}
+
+struct kmem_cache_t * kmem_cache_create_mm(void * mm, const char * name, size_t size, size_t align)
+{
+	struct kmem_cache_t * c;
+	size_t offset;
+
+	if(align < sizeof(void *))
+		align = sizeof(void *);
+	if(align & (align - 1))
+		align = roundup_pow_of_two(align);
+	if(size < sizeof(void *))
+		size = sizeof(void *);
+	size = (size + align - 1) & ~(align - 1);
+
+	c = malloc(sizeof(struct kmem_cache_t));
+	if(!c)
+		return NULL;
+
+	offset = (sizeof(struct kmem_slab_t) + align - 1) & ~(align - 1);
+	c->pgsize = SZ_4K;
+	while(c->pgsize < offset + size * 8)
+		c->pgsize <<= 1;
+	c->mm = mm;
+	c->name = strdup(name ? name : "");
+	c->size = size;
+	c->align = align;
+	c->nobjs = (c->pgsize - offset) / size;
+	c->nslabs = 0;
+	c->nempty = 0;
+	c->active = 0;
+	init_list_head(&c->full);
+	init_list_head(&c->partial);
+	init_list_head(&c->empty);
+	spin_lock_init(&c->lock);
+
+	spin_lock(&__kmem_cache_lock);
+	list_add_tail(&c->list, &__kmem_cache_list);
+	spin_unlock(&__kmem_cache_lock);
+
+	return c;
+}
+EXPORT_SYMBOL(kmem_cache_create_mm);
+
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align)
+{
+	return kmem_cache_create_mm(NULL, name, size, align);
+}
+EXPORT_SYMBOL(kmem_cache_create);
+
+void kmem_cache_destroy(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * pos, * n;
+
+	if(c)
+	{
+		spin_lock(&__kmem_cache_lock);
+		list_del(&c->list);
+		spin_unlock(&__kmem_cache_lock);
+
+		list_for_each_entry_safe(pos, n, &c->full, list)
+			kmem_slab_free(c, pos);
+		list_for_each_entry_safe(pos, n, &c->partial, list)
+			kmem_slab_free(c, pos);
+		list_for_each_entry_safe(pos, n, &c->empty, list)
+			kmem_slab_free(c, pos);
+		free(c->name);
+		free(c);
+	}
+}
+EXPORT_SYMBOL(kmem_cache_destroy);
+
+void * kmem_cache_alloc(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s;
+	void * obj;
+
+	if(!c)
+		return NULL;
+
+	spin_lock(&c->lock);
+	if(!list_empty(&c->partial))
+	{
+		s = list_first_entry(&c->partial, struct kmem_slab_t, list);
+	}
+	else if(!list_empty(&c->empty))
+	{
+		s = list_first_entry(&c->empty, struct kmem_slab_t, list);
+		list_move(&s->list, &c->partial);
+		c->nempty--;
+	}
+	else
+	{
+		s = kmem_slab_grow(c);
+		if(!s)
+		{
+			spin_unlock(&c->lock);
+			return NULL;
+		}
+		list_add(&s->list, &c->partial);
+	}
+	obj = s->freelist;
+	s->freelist = *((void **)obj);
+	if(++s->inuse >= c->nobjs)
+		list_move(&s->list, &c->full);
+	c->active++;
+	spin_unlock(&c->lock);
+
+	return obj;
+}
+EXPORT_SYMBOL(kmem_cache_alloc);
+
+void * kmem_cache_zalloc(struct kmem_cache_t * c)
+{
+	void * obj = kmem_cache_alloc(c);
+
+	if(obj)
+		memset(obj, 0, c->size);
+	return obj;
+}
+EXPORT_SYMBOL(kmem_cache_zalloc);
+
+void kmem_cache_free(struct kmem_cache_t * c, void * obj)
+{
+	struct kmem_slab_t * s;
+
+	if(!c || !obj)
+		return;
+
+	s = (struct kmem_slab_t *)((unsigned long)obj & ~(c->pgsize - 1));
+	assert(s->cache == c);
+	spin_lock(&c->lock);
+	*((void **)obj) = s->freelist;
+	s->freelist = obj;
+	if(s->inuse-- >= c->nobjs)
+		list_move(&s->list, &c->partial);
+	c->active--;
+	if(s->inuse == 0)
+	{
+		/*
+		 * Keep one empty slab around to absorb alloc / free ping-pong
+		 */
+		if(c->nempty > 0)
+		{
+			list_del(&s->list);
+			c->nslabs--;
+			spin_unlock(&c->lock);
+			kmem_slab_free(c, s);
+			return;
+		}
+		list_move(&s->list, &c->empty);
+		c->nempty++;
+	}
+	spin_unlock(&c->lock);
+}
+EXPORT_SYMBOL(kmem_cache_free);
+
+void kmem_cache_shrink(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * pos, * n;
+	struct list_head head;
+
+	if(c)
+	{
+		init_list_head(&head);
+		spin_lock(&c->lock);
+		list_splice_init(&c->empty, &head);
+		c->nslabs -= c->nempty;
+		c->nempty = 0;
+		spin_unlock(&c->lock);
+
+		list_for_each_entry_safe(pos, n, &head, list)
+			kmem_slab_free(c, pos);
+	}
+}
+EXPORT_SYMBOL(kmem_cache_shrink);
+
+static ssize_t memory_read_slabinfo(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct kmem_cache_t * pos;
+	char * p = buf;
+	int len = 0;
+
+	len += sprintf((char *)(p + len), " %-16s %8s %8s %8s %8s\r\n", "name", "objsize", "active", "total", "slabs");
+	spin_lock(&__kmem_cache_lock);
+	list_for_each_entry(pos, &__kmem_cache_list, list)
+	{
+		if(len + 64 + strlen(pos->name) > size)
+			break;
+		len += sprintf((char *)(p + len), " %-16s %8ld %8d %8d %8d\r\n", pos->name, pos->size, pos->active, pos->nslabs * pos->nobjs, pos->nslabs);
+	}
+	spin_unlock(&__kmem_cache_lock);
+	return len;
+}
+
+static __init void slabinfo_init(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	kobj_add_regular(kobj_search_directory_with_create(kclass, "memory"), "slabinfo", memory_read_slabinfo, NULL, NULL);
+}
+pure_initcall(slabinfo_init);
@@ -7,21 +7,41 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+#define ONES	((word_t)-1 / 0xff)
+#define HIGHS	(ONES << 7)
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 /*
  * Finds the first occurrence of a byte in a buffer
  */
 void * memchr(const void * s, int c, size_t n)
 {
 	const unsigned char *p = s;
+	const word_t * w;
+	word_t k;
 
+	for (; n && ((unsigned long)p & WMASK); p++, n--)
+	{
+		if ((unsigned char)c == *p)
+			return (void *)p;
+	}
+	if (n >= WSIZE)
+	{
+		k = ONES * (unsigned char)c;
+		for (w = (const word_t *)p; (n >= WSIZE) && !HASZERO(*w ^ k); w++)
+			n -= WSIZE;
+		p = (const unsigned char *)w;
+	}
 	while (n-- != 0)
 	{
-        if ((unsigned char)c == *p++)
-        {
+		if ((unsigned char)c == *p++)
 			return (void *)(p - 1);
-		}
 	}
 
 	return NULL;
 }
+
 EXPORT_SYMBOL(memchr);
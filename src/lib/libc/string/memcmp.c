@@ -6,12 +6,31 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+
 static int __memcmp(const void * s1, const void * s2, size_t n)
 {
-	const unsigned char *su1, *su2;
+	const unsigned char *su1 = s1, *su2 = s2;
+	const word_t *sw1, *sw2;
 	int res = 0;
 
-	for (su1 = s1, su2 = s2; 0 < n; ++su1, ++su2, n--)
+	/*
+	 * Skip over equal words when both buffers share the same alignment,
+	 * the differing word is then resolved byte by byte.
+	 */
+	if ((n >= WSIZE * 2) && ((((unsigned long)su1 ^ (unsigned long)su2) & WMASK) == 0))
+	{
+		for (; (unsigned long)su1 & WMASK; ++su1, ++su2, n--)
+			if ((res = *su1 - *su2) != 0)
+				return res;
+		for (sw1 = (const word_t *)su1, sw2 = (const word_t *)su2; (n >= WSIZE) && (*sw1 == *sw2); sw1++, sw2++)
+			n -= WSIZE;
+		su1 = (const unsigned char *)sw1;
+		su2 = (const unsigned char *)sw2;
+	}
+	for (; 0 < n; ++su1, ++su2, n--)
 		if ((res = *su1 - *su2) != 0)
 			break;
 	return res;
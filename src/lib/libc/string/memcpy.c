@@ -3,16 +3,77 @@
  */
 
 #include <types.h>
+#include <endian.h>
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+
 static void * __memcpy(void * dest, const void * src, size_t len)
 {
-	char * tmp = dest;
-	const char * s = src;
+	unsigned char * d = dest;
+	const unsigned char * s = src;
+	word_t * dw;
+	const word_t * sw;
+	word_t a, b;
+	size_t n;
+	int shift;
 
+	if (len >= WSIZE * 2)
+	{
+		/*
+		 * Align the destination, then copy whole words. A source with a
+		 * different alignment is read by aligned words and merged by shifts,
+		 * so no unaligned access is ever made.
+		 */
+		while ((unsigned long)d & WMASK)
+		{
+			*d++ = *s++;
+			len--;
+		}
+		dw = (word_t *)d;
+		n = len / WSIZE;
+		if (((unsigned long)s & WMASK) == 0)
+		{
+			sw = (const word_t *)s;
+			for (; n >= 4; n -= 4, dw += 4, sw += 4)
+			{
+				a = sw[0];
+				b = sw[1];
+				dw[0] = a;
+				dw[1] = b;
+				a = sw[2];
+				b = sw[3];
+				dw[2] = a;
+				dw[3] = b;
+			}
+			while (n--)
+				*dw++ = *sw++;
+		}
+		else
+		{
+			shift = ((unsigned long)s & WMASK) << 3;
+			sw = (const word_t *)((unsigned long)s & ~WMASK);
+			a = *sw++;
+			while (n--)
+			{
+				b = *sw++;
+#if (BYTE_ORDER == BIG_ENDIAN)
+				*dw++ = (a << shift) | (b >> (WSIZE * 8 - shift));
+#else
+				*dw++ = (a >> shift) | (b << (WSIZE * 8 - shift));
+#endif
+				a = b;
+			}
+		}
+		s += (unsigned char *)dw - d;
+		d = (unsigned char *)dw;
+		len &= WMASK;
+	}
 	while (len--)
-		*tmp++ = *s++;
+		*d++ = *s++;
 	return dest;
 }
 
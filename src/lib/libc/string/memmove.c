@@ -6,15 +6,38 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+
 static void * __memmove(void * dest, const void * src, size_t n)
 {
-	char * tmp;
-	const char * s;
+	unsigned char * tmp;
+	const unsigned char * s;
+	word_t * dw;
+	const word_t * sw;
+
+	if ((dest == src) || (n == 0))
+		return dest;
+	if (((unsigned char *)dest + n <= (const unsigned char *)src) || ((const unsigned char *)src + n <= (unsigned char *)dest))
+		return memcpy(dest, src, n);
 
-	if (dest <= src)
+	if (dest < src)
 	{
 		tmp = dest;
 		s = src;
+		if ((((unsigned long)tmp ^ (unsigned long)s) & WMASK) == 0)
+		{
+			while (n && ((unsigned long)tmp & WMASK))
+			{
+				*tmp++ = *s++;
+				n--;
+			}
+			for (dw = (word_t *)tmp, sw = (const word_t *)s; n >= WSIZE; n -= WSIZE)
+				*dw++ = *sw++;
+			tmp = (unsigned char *)dw;
+			s = (const unsigned char *)sw;
+		}
 		while (n--)
 			*tmp++ = *s++;
 	}
@@ -24,6 +47,18 @@ static void * __memmove(void * dest, const void * src, size_t n)
 		tmp += n;
 		s = src;
 		s += n;
+		if ((((unsigned long)tmp ^ (unsigned long)s) & WMASK) == 0)
+		{
+			while (n && ((unsigned long)tmp & WMASK))
+			{
+				*--tmp = *--s;
+				n--;
+			}
+			for (dw = (word_t *)tmp, sw = (const word_t *)s; n >= WSIZE; n -= WSIZE)
+				*--dw = *--sw;
+			tmp = (unsigned char *)dw;
+			s = (const unsigned char *)sw;
+		}
 		while (n--)
 			*--tmp = *--s;
 	}
@@ -6,10 +6,40 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+
 static void * __memset(void * s, int c, size_t n)
 {
-	char * xs = s;
+	unsigned char * xs = s;
+	word_t * xw;
+	word_t w;
 
+	if (n >= WSIZE * 2)
+	{
+		while ((unsigned long)xs & WMASK)
+		{
+			*xs++ = c;
+			n--;
+		}
+		w = (unsigned char)c;
+		w |= w << 8;
+		w |= w << 16;
+		if (WSIZE > 4)
+			w |= (w << 16) << 16;
+		xw = (word_t *)xs;
+		for (; n >= WSIZE * 4; n -= WSIZE * 4, xw += 4)
+		{
+			xw[0] = w;
+			xw[1] = w;
+			xw[2] = w;
+			xw[3] = w;
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*xw++ = w;
+		xs = (unsigned char *)xw;
+	}
 	while (n--)
 		*xs++ = c;
 
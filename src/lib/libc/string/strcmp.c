@@ -6,10 +6,29 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+#define ONES	((word_t)-1 / 0xff)
+#define HIGHS	(ONES << 7)
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 static int __strcmp(const char * s1, const char * s2)
 {
+	const word_t *w1, *w2;
 	int res;
 
+	if ((((unsigned long)s1 ^ (unsigned long)s2) & WMASK) == 0)
+	{
+		for (; (unsigned long)s1 & WMASK; s1++, s2++)
+		{
+			if ((res = *s1 - *s2) != 0 || !*s1)
+				return res;
+		}
+		for (w1 = (const word_t *)s1, w2 = (const word_t *)s2; (*w1 == *w2) && !HASZERO(*w1); w1++, w2++);
+		s1 = (const char *)w1;
+		s2 = (const char *)w2;
+	}
 	while (1)
 	{
 		if ((res = *s1 - *s2++) != 0 || !*s1++)
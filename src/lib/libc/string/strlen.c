@@ -6,14 +6,27 @@
 #include <string.h>
 #include <xboot/module.h>
 
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+#define WSIZE	(sizeof(word_t))
+#define WMASK	(WSIZE - 1)
+#define ONES	((word_t)-1 / 0xff)
+#define HIGHS	(ONES << 7)
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 /*
  * Calculate the length of a string
  */
 size_t strlen(const char * s)
 {
 	const char * sc;
+	const word_t * w;
 
-	for (sc = s; *sc != '\0'; ++sc);
+	for (sc = s; (unsigned long)sc & WMASK; ++sc)
+		if (*sc == '\0')
+			return sc - s;
+	for (w = (const word_t *)sc; !HASZERO(*w); w++);
+	for (sc = (const char *)w; *sc != '\0'; ++sc);
 	return sc - s;
 }
+
 EXPORT_SYMBOL(strlen);
@@ -11,7 +11,17 @@
 #include <list.h>
 #include <lsort.h>
 #include <malloc.h>
+#include <slab.h>
 #include <hmap.h>
+#include <xboot/initcall.h>
+
+static struct kmem_cache_t * __hmap_entry_cache = NULL;
+
+static __init void hmap_entry_cache_init(void)
+{
+	__hmap_entry_cache = kmem_cache_create("hmap_entry", sizeof(struct hmap_entry_t), 0);
+}
+pure_initcall(hmap_entry_cache_init);
 
 struct hmap_t * hmap_alloc(unsigned int size)
 {
@@ -70,7 +80,7 @@ void hmap_clear(struct hmap_t * m, void (*cb)(struct hmap_entry_t *))
 			if(cb)
 				cb(pos);
 			free(pos->key);
-			free(pos);
+			kmem_cache_free(__hmap_entry_cache, pos);
 		}
 	}
 }
@@ -136,7 +146,7 @@ void hmap_add(struct hmap_t * m, const char * key, void * value)
 	if(m->n > (m->size >> 1))
 		hmap_resize(m, m->size << 1);
 
-	pos = malloc(sizeof(struct hmap_entry_t));
+	pos = kmem_cache_alloc(__hmap_entry_cache);
 	if(!pos)
 		return;
 
@@ -173,7 +183,7 @@ void hmap_remove(struct hmap_t * m, const char * key)
 			m->n--;
 			spin_unlock_irqrestore(&m->lock, flags);
 			free(pos->key);
-			free(pos);
+			kmem_cache_free(__hmap_entry_cache, pos);
 			return;
 		}
 	}
@@ -16,6 +16,7 @@ struct wbt_preview_pdata_t
 static void * preview_setup(struct wboxtest_t * wbt)
 {
 	struct wbt_preview_pdata_t * pdat;
+	struct camera_buffer_t * b;
 	const char * name = NULL;
 
 	pdat = malloc(sizeof(struct wbt_preview_pdata_t));
@@ -37,25 +38,27 @@ static void * preview_setup(struct wboxtest_t * wbt)
 		return NULL;
 	}
 
-	if(!camera_start(pdat->c, VIDEO_FORMAT_MJPG, 320, 240))
+	if(!camera_stream_start(pdat->c, VIDEO_FORMAT_MJPG, 320, 240, 3))
 	{
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	if(!camera_capture(pdat->c, &pdat->frame, 3000))
+	if(!(b = camera_dequeue(pdat->c, 3000)))
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
+	memcpy(&pdat->frame, &b->frame, sizeof(struct video_frame_t));
+	camera_enqueue(pdat->c, b);
 
 	pdat->s = surface_alloc(pdat->frame.width, pdat->frame.height, NULL);
 	if(!pdat->s)
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
@@ -70,7 +73,7 @@ static void preview_clean(struct wboxtest_t * wbt, void * data)
 
 	if(pdat)
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
@@ -81,10 +84,14 @@ static void draw_preview(struct window_t * w, void * o)
 {
 	struct wbt_preview_pdata_t * pdat = (struct wbt_preview_pdata_t *)o;
 	struct surface_t * s = pdat->w->s;
+	struct camera_buffer_t * b;
 	struct matrix_t m;
 
-	if(camera_capture(pdat->c, &pdat->frame, 0))
-		video_frame_to_argb(&pdat->frame, pdat->s->pixels);
+	if((b = camera_dequeue(pdat->c, 0)))
+	{
+		video_frame_to_argb(&b->frame, pdat->s->pixels);
+		camera_enqueue(pdat->c, b);
+	}
 	matrix_init_identity(&m);
 	matrix_init_translate(&m, (surface_get_width(s) - surface_get_width(pdat->s)) / 2, (surface_get_height(s) - surface_get_height(pdat->s)) / 2);
 	surface_blit(s, NULL, &m, pdat->s, RENDER_TYPE_GOOD);
@@ -102,7 +109,8 @@ static void preview_run(struct wboxtest_t * wbt, void * data)
 		{
 			ktime_t timeout = ktime_add_ms(ktime_get(), 16);
 			window_present(pdat->w, pdat, draw_preview);
-			while(ktime_before(ktime_get(), timeout));
+			if(ktime_before(ktime_get(), timeout))
+				task_sleep(ktime_to_ns(ktime_sub(timeout, ktime_get())));
 		}
 	}
 }
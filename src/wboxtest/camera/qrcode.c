@@ -18,6 +18,7 @@ struct wbt_qrcode_pdata_t
 static void * qrcode_setup(struct wboxtest_t * wbt)
 {
 	struct wbt_qrcode_pdata_t * pdat;
+	struct camera_buffer_t * b;
 	const char * name = NULL;
 
 	pdat = malloc(sizeof(struct wbt_qrcode_pdata_t));
@@ -39,25 +40,27 @@ static void * qrcode_setup(struct wboxtest_t * wbt)
 		return NULL;
 	}
 
-	if(!camera_start(pdat->c, VIDEO_FORMAT_MJPG, 640, 480))
+	if(!camera_stream_start(pdat->c, VIDEO_FORMAT_MJPG, 640, 480, 3))
 	{
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	if(!camera_capture(pdat->c, &pdat->frame, 3000))
+	if(!(b = camera_dequeue(pdat->c, 3000)))
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
+	memcpy(&pdat->frame, &b->frame, sizeof(struct video_frame_t));
+	camera_enqueue(pdat->c, b);
 
 	pdat->s = surface_alloc(pdat->frame.width, pdat->frame.height, NULL);
 	if(!pdat->s)
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
@@ -66,7 +69,7 @@ static void * qrcode_setup(struct wboxtest_t * wbt)
 	pdat->qr = quirc_new();
 	if(!pdat->qr)
 	{
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
@@ -76,7 +79,7 @@ static void * qrcode_setup(struct wboxtest_t * wbt)
 	if(quirc_resize(pdat->qr, pdat->frame.width, pdat->frame.height) < 0)
 	{
 		quirc_destroy(pdat->qr);
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
@@ -93,36 +96,29 @@ static void qrcode_clean(struct wboxtest_t * wbt, void * data)
 	if(pdat)
 	{
 		quirc_destroy(pdat->qr);
-		camera_stop(pdat->c);
+		camera_stream_stop(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
 	}
 }
 
-static inline void surface_to_gray(struct surface_t * s, uint8_t * gray)
-{
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-
-	for(i = 0; i < len; i++, p += 4)
-		*(gray++) = (p[2] * 19595L + p[1] * 38469L + p[0] * 7472L) >> 16;
-}
-
 static void draw_qrcode(struct window_t * w, void * o)
 {
 	struct wbt_qrcode_pdata_t * pdat = (struct wbt_qrcode_pdata_t *)o;
 	struct surface_t * s = pdat->w->s;
+	struct camera_buffer_t * b;
 	struct matrix_t m;
 	struct quirc_code code;
 	struct quirc_data data;
 	quirc_decode_error_t err;
 	int i;
 
-	if(camera_capture(pdat->c, &pdat->frame, 0))
+	if((b = camera_dequeue(pdat->c, 0)))
 	{
-		video_frame_to_argb(&pdat->frame, pdat->s->pixels);
-		surface_to_gray(pdat->s, quirc_begin(pdat->qr, NULL, NULL));
+		video_frame_to_argb(&b->frame, pdat->s->pixels);
+		video_frame_to_gray(&b->frame, quirc_begin(pdat->qr, NULL, NULL), pdat->frame.width, pdat->frame.height);
+		camera_enqueue(pdat->c, b);
 		quirc_end(pdat->qr);
 		for(i = 0; i < quirc_count(pdat->qr); i++)
 		{
@@ -154,7 +150,8 @@ static void qrcode_run(struct wboxtest_t * wbt, void * data)
 		{
 			ktime_t timeout = ktime_add_ms(ktime_get(), 16);
 			window_present(pdat->w, pdat, draw_qrcode);
-			while(ktime_before(ktime_get(), timeout));
+			if(ktime_before(ktime_get(), timeout))
+				task_sleep(ktime_to_ns(ktime_sub(timeout, ktime_get())));
 		}
 	}
 }